@@ -1,43 +1,10 @@
+#include "cv.hpp"
+
 #include <algorithm>
 #include <cmath>
-#include <cstdint>
-#include <opencv2/opencv.hpp>
-#include <utility>
-#include <vector>
-
-using namespace std;
-
-/**
- * @brief Structure to represent an image with pixel data and dimensions.
- */
-struct Image {
-    vector<vector<vector<uint8_t>>> data;  // Image pixel data
-    int height, width;  // Image dimensions (height and width)
-
-    /**
-     * @brief Constructor to initialize an Image object.
-     * @param data The pixel data of the image.
-     * @param height The height of the image.
-     * @param width The width of the image.
-     */
-    Image(vector<vector<vector<uint8_t>>> data, int height, int width)
-        : data(std::move(data)), height(height), width(width) {}
-};
-
-/**
- * @brief Structure to represent a point with x and y coordinates.
- */
-struct Point {
-    int x, y;  // x and y coordinates of a point
-};
+#include <stdexcept>
 
-/**
- * @brief Structure to represent a circle with center and radius.
- */
-struct Circle {
-    Point center;   // Center point of the circle
-    double radius;  // Radius of the circle
-};
+namespace aulas {
 
 /**
  * @brief Convert a cv::Mat object to an Image object.
@@ -83,7 +50,8 @@ cv::Mat imageToMat(Image img) {
 }
 
 /**
- * @brief Convert an RGB image to the HSV color space.
+ * @brief Convert an RGB image to the HSV color space, in OpenCV's 8-bit
+ * scale (H in [0, 180), S and V in [0, 255]).
  *
  * @param rgb The RGB image to convert.
  * @return The HSV image.
@@ -99,18 +67,21 @@ Image convertToHSV(Image rgb) {
             double max_val = max({r, g, b}), min_val = min({r, g, b});
             double diff = max_val - min_val;
 
+            // Hue in degrees, halved to fit in 8 bits
+            double hue = 0.0;
             if (max_val == min_val) {
-                hsv.data[i][j][0] = 0;
+                hue = 0.0;
             } else if (max_val == r) {
-                hsv.data[i][j][0] =
-                    static_cast<uint8_t>(60 * fmod(((g - b) / diff), 6));
+                hue = 60 * fmod(((g - b) / diff), 6);
             } else if (max_val == g) {
-                hsv.data[i][j][0] =
-                    static_cast<uint8_t>(60 * (((b - r) / diff) + 2));
+                hue = 60 * (((b - r) / diff) + 2);
             } else if (max_val == b) {
-                hsv.data[i][j][0] =
-                    static_cast<uint8_t>(60 * (((r - g) / diff) + 4));
+                hue = 60 * (((r - g) / diff) + 4);
+            }
+            if (hue < 0) {
+                hue += 360;
             }
+            hsv.data[i][j][0] = static_cast<uint8_t>(hue / 2);
 
             // Saturation
             hsv.data[i][j][1] =
@@ -176,7 +147,7 @@ cv::Mat getHSVSegmentedImage(cv::Mat& inputMat, vector<uint8_t>& lower,
  * @return The eroded image.
  * @throws std::invalid_argument If the kernel size is not odd.
  */
-static inline Image erode(Image img, int kernelSize) {
+Image erode(Image img, int kernelSize) {
     if (kernelSize % 2 == 0) {
         throw invalid_argument("Kernel size must be odd!");
     }
@@ -222,7 +193,7 @@ static inline Image erode(Image img, int kernelSize) {
  * @return The dilated image.
  * @throws std::invalid_argument If the kernel size is not odd.
  */
-static inline Image dilate(Image img, int kernelSize) {
+Image dilate(Image img, int kernelSize) {
     if (kernelSize % 2 == 0) {
         throw invalid_argument("Kernel size must be odd!");
     }
@@ -312,6 +283,9 @@ Image equalizeHistogram(Image hsv) {
     // Normalize CDF to range 0-255
     uint32_t cdf_min = *min_element(cdf.begin(), cdf.end());
     uint32_t cdf_max = cdf[0xff];
+    if (cdf_max == cdf_min) {
+        return hsv;  // Constant channel: nothing to spread
+    }
     for (int i = 0; i < 256; ++i) {
         cdf[i] = ((cdf[i] - cdf_min) * 0xff) / (cdf_max - cdf_min);
     }
@@ -327,8 +301,8 @@ Image equalizeHistogram(Image hsv) {
     return equalized;
 }
 
-vector<Point> directions = {{-1, 0}, {-1, 1}, {0, 1},  {1, 1},
-                            {1, 0},  {1, -1}, {0, -1}, {-1, -1}};
+static const vector<Point> directions = {{-1, 0}, {-1, 1}, {0, 1},  {1, 1},
+                                         {1, 0},  {1, -1}, {0, -1}, {-1, -1}};
 
 /**
  * @brief Get the next direction in the Moore-Neighbor Tracing algorithm.
@@ -340,10 +314,32 @@ static inline int getNextDirection(int currentDirection) {
     return (currentDirection + 1) % 8;
 }
 
+/**
+ * @brief Get the direction that leads from a point to one of its neighbors.
+ *
+ * @param from The point.
+ * @param to A neighbor of the point.
+ * @return The index of the direction in `directions`.
+ */
+static inline int getDirection(Point from, Point to) {
+    for (int d = 0; d < 8; ++d) {
+        if (from.x + directions[d].x == to.x &&
+            from.y + directions[d].y == to.y) {
+            return d;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief Find contours in a binary image using the Moore-Neighbor Tracing
  * algorithm.
  *
+ * Tracing starts from border pixels only, i.e. foreground pixels whose left
+ * neighbor is background, which finds the outer border of every blob and
+ * the border of its holes. A trace stops when it is about to repeat its
+ * first move (Jacob's stopping criterion).
+ *
  * @param binaryImage The binary image.
  * @return A vector of contours, where each contour is represented as a vector
  * of points.
@@ -355,38 +351,66 @@ vector<vector<Point>> findContours(const Image& binaryImage) {
     vector<vector<Point>> contours;
     vector<vector<bool>> visited(height, vector<bool>(width, false));
 
+    auto isForeground = [&](Point p) {
+        return p.x >= 0 && p.x < height && p.y >= 0 && p.y < width &&
+               binaryImage.data[p.x][p.y][0] == 0xff;
+    };
+
     for (int i = 0; i < height; ++i) {
         for (int j = 0; j < width; ++j) {
-            if (binaryImage.data[i][j][0] == 0xff && !visited[i][j]) {
-                // New contour
-                vector<Point> contour;
-
-                // Moore-Neighbor Tracing
-                Point p = {i, j};
-                int bDirection = 0;
-                do {
-                    contour.push_back(p);
-                    visited[p.x][p.y] = true;
+            if (!isForeground({i, j}) || visited[i][j] ||
+                isForeground({i, j - 1})) {
+                continue;
+            }
 
-                    int direction = bDirection;
-                    for (int d = 0; d < 8; ++d) {
-                        direction = getNextDirection(direction);
-                        Point pCandidate = {p.x + directions[direction].x,
-                                            p.y + directions[direction].y};
-
-                        if (pCandidate.x >= 0 && pCandidate.x < height &&
-                            pCandidate.y >= 0 && pCandidate.y < width &&
-                            binaryImage.data[pCandidate.x][pCandidate.y][0] ==
-                                0xff) {
-                            p = pCandidate;
-                            bDirection = (direction + 4) % 8;
-                            break;
-                        }
+            // New contour, entered from the background on its left
+            Point start = {i, j};
+            vector<Point> contour = {start};
+            visited[i][j] = true;
+
+            // Moore-Neighbor Tracing
+            Point p = start;
+            Point second = {-1, -1};
+            int bDirection = 6;  // Backtrack: the left neighbor
+            while (true) {
+                int direction = bDirection;
+                int found = -1;
+                for (int d = 0; d < 8; ++d) {
+                    direction = getNextDirection(direction);
+                    Point pCandidate = {p.x + directions[direction].x,
+                                        p.y + directions[direction].y};
+                    if (isForeground(pCandidate)) {
+                        found = direction;
+                        break;
                     }
-                } while (p.x != i || p.y != j);
+                }
+                if (found < 0) {
+                    break;  // Isolated pixel
+                }
+
+                Point next = {p.x + directions[found].x,
+                              p.y + directions[found].y};
+                if (p.x == start.x && p.y == start.y && second.x >= 0 &&
+                    next.x == second.x && next.y == second.y) {
+                    break;  // Back at the start, about to repeat the trace
+                }
+                if (second.x < 0) {
+                    second = next;
+                }
 
-                contours.push_back(contour);
+                // The last background neighbor checked becomes the backtrack
+                Point back = {p.x + directions[(found + 7) % 8].x,
+                              p.y + directions[(found + 7) % 8].y};
+                bDirection = getDirection(next, back);
+                p = next;
+
+                if (p.x != start.x || p.y != start.y) {
+                    contour.push_back(p);
+                    visited[p.x][p.y] = true;
+                }
             }
+
+            contours.push_back(contour);
         }
     }
 
@@ -399,7 +423,7 @@ vector<vector<Point>> findContours(const Image& binaryImage) {
  * @param contour The contour represented as a vector of points.
  * @return The area of the contour.
  */
-static inline double calculateArea(const vector<Point>& contour) {
+double calculateArea(const vector<Point>& contour) {
     double area = 0.0;
     int n = contour.size();
     for (int i = 0; i < n; ++i) {
@@ -416,7 +440,7 @@ static inline double calculateArea(const vector<Point>& contour) {
  * @param binaryImage The binary image.
  * @return The centroid as a Point object.
  */
-static inline Point calculateCentroid(const Image& binaryImage) {
+Point calculateCentroid(const Image& binaryImage) {
     double pixelsX = 0, pixelsY = 0, totalP = 0;
     for (int i = 0; i < binaryImage.height; ++i) {
         for (int j = 0; j < binaryImage.width; ++j) {
@@ -441,7 +465,7 @@ static inline Point calculateCentroid(const Image& binaryImage) {
  * @param contour The contour represented as a vector of points.
  * @return The perimeter of the contour.
  */
-static inline double calculatePerimeter(const vector<Point>& contour) {
+double calculatePerimeter(const vector<Point>& contour) {
     double perimeter = 0.0;
     int n = contour.size();
     for (int i = 0; i < n; i++) {
@@ -458,7 +482,7 @@ static inline double calculatePerimeter(const vector<Point>& contour) {
  * @param contour The contour represented as a vector of points.
  * @return The circularity of the contour.
  */
-static inline double calculateCircularity(const vector<Point>& contour) {
+double calculateCircularity(const vector<Point>& contour) {
     double area = calculateArea(contour);
     double perimeter = calculatePerimeter(contour);
     return (4 * M_PI * area) / (perimeter * perimeter);
@@ -471,7 +495,7 @@ static inline double calculateCircularity(const vector<Point>& contour) {
  * @param contour The contour represented as a vector of points.
  * @return The fitted circle as a Circle object.
  */
-static inline Circle getCircleFromContour(const vector<Point>& contour) {
+Circle getCircleFromContour(const vector<Point>& contour) {
     double sumX = 0.0, sumY = 0.0;
     for (const auto& point : contour) {
         sumX += point.x;
@@ -490,6 +514,118 @@ static inline Circle getCircleFromContour(const vector<Point>& contour) {
     return {centroid, radius};
 }
 
+/**
+ * @brief Measure a closed contour in a single pass over its points.
+ *
+ * Coordinates are taken relative to the first point, which keeps the sums
+ * small and makes the cross product of the closing edge zero, so the loop
+ * runs over the edges ending at points 1 to n - 1 without wrapping around.
+ * The area and its moments follow from Green's theorem on each edge; the
+ * circle from the sums of the point coordinates up to the third power,
+ * solving the normal equations of x^2 + y^2 + Dx + Ey + F = 0 around the
+ * mean point.
+ *
+ * @param points The contour points, in order.
+ * @param count The number of points.
+ * @return The features of the contour.
+ */
+ContourFeatures measureContour(const Point* points, size_t count) {
+    ContourFeatures features = {};
+    if (count == 0) {
+        return features;
+    }
+
+    const int x0 = points[0].x, y0 = points[0].y;
+    double cross = 0, crossX = 0, crossY = 0;
+    double crossXX = 0, crossXY = 0, crossYY = 0, length = 0;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    double sxxx = 0, sxxy = 0, sxyy = 0, syyy = 0;
+    int lowX = x0, lowY = y0, highX = x0, highY = y0;
+
+#pragma omp simd reduction(+ : cross, crossX, crossY, crossXX, crossXY, \
+                               crossYY, length, sx, sy, sxx, sxy, syy,  \
+                               sxxx, sxxy, sxyy, syyy)                  \
+    reduction(min : lowX, lowY) reduction(max : highX, highY)
+    for (size_t i = 1; i < count; i++) {
+        double px = points[i - 1].x - x0, py = points[i - 1].y - y0;
+        double qx = points[i].x - x0, qy = points[i].y - y0;
+
+        double c = px * qy - qx * py;
+        cross += c;
+        crossX += (px + qx) * c;
+        crossY += (py + qy) * c;
+        crossXX += (px * px + px * qx + qx * qx) * c;
+        crossXY += (2 * px * py + px * qy + qx * py + 2 * qx * qy) * c;
+        crossYY += (py * py + py * qy + qy * qy) * c;
+
+        double dx = qx - px, dy = qy - py;
+        length += sqrt(dx * dx + dy * dy);
+
+        sx += qx;
+        sy += qy;
+        sxx += qx * qx;
+        sxy += qx * qy;
+        syy += qy * qy;
+        sxxx += qx * qx * qx;
+        sxxy += qx * qx * qy;
+        sxyy += qx * qy * qy;
+        syyy += qy * qy * qy;
+
+        lowX = min(lowX, points[i].x);
+        lowY = min(lowY, points[i].y);
+        highX = max(highX, points[i].x);
+        highY = max(highY, points[i].y);
+    }
+    // The closing edge only adds to the perimeter
+    double closeX = points[count - 1].x - x0, closeY = points[count - 1].y - y0;
+    length += sqrt(closeX * closeX + closeY * closeY);
+
+    // The sign of the area gives the orientation of the contour
+    double sign = cross < 0 ? -1.0 : 1.0;
+    double area = sign * cross / 2;
+    double m10 = sign * crossX / 6, m01 = sign * crossY / 6;
+    double m20 = sign * crossXX / 12, m02 = sign * crossYY / 12;
+    double m11 = sign * crossXY / 24;
+
+    features.area = area;
+    features.perimeter = length;
+    features.m10 = m10 + x0 * area;
+    features.m01 = m01 + y0 * area;
+    features.m20 = m20 + 2 * x0 * m10 + x0 * x0 * area;
+    features.m11 = m11 + x0 * m01 + y0 * m10 + x0 * y0 * area;
+    features.m02 = m02 + 2 * y0 * m01 + y0 * y0 * area;
+    features.low = {lowX, lowY};
+    features.high = {highX, highY};
+
+    // Central sums of the points, from the sums around the first one
+    double n = static_cast<double>(count);
+    double mx = sx / n, my = sy / n;
+    double suu = sxx - n * mx * mx;
+    double svv = syy - n * my * my;
+    double suv = sxy - n * mx * my;
+    double suuu = sxxx - 3 * mx * sxx + 3 * mx * mx * sx - n * mx * mx * mx;
+    double svvv = syyy - 3 * my * syy + 3 * my * my * sy - n * my * my * my;
+    double suvv = sxyy - 2 * my * sxy + my * my * sx - mx * syy +
+                  2 * mx * my * sy - n * mx * my * my;
+    double suuv = sxxy - 2 * mx * sxy + mx * mx * sy - my * sxx +
+                  2 * mx * my * sx - n * mx * mx * my;
+
+    double uc = 0.0, vc = 0.0;
+    double det = suu * svv - suv * suv;
+    if (fabs(det) > 1e-9) {
+        double bu = (suuu + suvv) / 2, bv = (svvv + suuv) / 2;
+        uc = (bu * svv - bv * suv) / det;
+        vc = (suu * bv - suv * bu) / det;
+    }
+    // Without a fit (fewer than three distinct points, or all on a line),
+    // the mean point and the RMS distance to it
+    features.circle.center = {static_cast<int>(lround(x0 + mx + uc)),
+                              static_cast<int>(lround(y0 + my + vc))};
+    features.circle.radius = sqrt(uc * uc + vc * vc + (suu + svv) / n);
+
+    return features;
+}
+
 /**
  * @brief Find circles in a binary image based on circularity criteria.
  *
@@ -502,10 +638,16 @@ vector<Circle> findCircles(const Image& binaryImage, double minCircularity) {
     vector<vector<Point>> contours = findContours(binaryImage);
     vector<Circle> circles;
     for (const auto& contour : contours) {
-        double circularity = calculateCircularity(contour);
+        // One pass gives the circularity and the circle
+        ContourFeatures features =
+            measureContour(contour.data(), contour.size());
+        double circularity = (4 * M_PI * features.area) /
+                             (features.perimeter * features.perimeter);
         if (circularity >= minCircularity) {
-            circles.push_back(getCircleFromContour(contour));
+            circles.push_back(features.circle);
         }
     }
     return circles;
 }
+
+}  // namespace aulas
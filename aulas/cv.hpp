@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Hand-written versions of the image processing kernels seen in the course.
+ * They work on a plain `Image` rather than on cv::Mat so that every step is
+ * explicit; `tests/bench_aulas.cpp` compares each of them with its OpenCV
+ * counterpart.
+ */
+namespace aulas {
+
+/**
+ * @brief Structure to represent an image with pixel data and dimensions.
+ */
+struct Image {
+    vector<vector<vector<uint8_t>>> data;  // Image pixel data
+    int height, width;  // Image dimensions (height and width)
+
+    /**
+     * @brief Constructor to initialize an Image object.
+     * @param data The pixel data of the image.
+     * @param height The height of the image.
+     * @param width The width of the image.
+     */
+    Image(vector<vector<vector<uint8_t>>> data, int height, int width)
+        : data(std::move(data)), height(height), width(width) {}
+};
+
+/**
+ * @brief Structure to represent a point with x and y coordinates. Contour
+ * points hold the row in `x` and the column in `y`.
+ */
+struct Point {
+    int x, y;  // x and y coordinates of a point
+};
+
+/**
+ * @brief Structure to represent a circle with center and radius.
+ */
+struct Circle {
+    Point center;   // Center point of the circle
+    double radius;  // Radius of the circle
+};
+
+/**
+ * @brief Features of a closed contour, gathered by `measureContour`. Like
+ * the contour points, they hold the row in `x` and the column in `y`.
+ */
+struct ContourFeatures {
+    double area;           // Enclosed area (shoelace formula)
+    double perimeter;      // Length of the closed polygon
+    double m10, m01;       // First moments of the enclosed area
+    double m20, m11, m02;  // Second moments of the enclosed area
+    Point low, high;       // Bounding box, inclusive
+    Circle circle;         // Least-squares circle through the points
+};
+
+/**
+ * @brief Convert a cv::Mat object to an Image object.
+ *
+ * @param mat The cv::Mat object to convert.
+ * @return The converted Image object.
+ */
+Image matToImage(cv::Mat mat);
+
+/**
+ * @brief Convert an Image object to a cv::Mat object.
+ *
+ * @param img The Image object to convert.
+ * @return The converted cv::Mat object.
+ */
+cv::Mat imageToMat(Image img);
+
+/**
+ * @brief Convert an RGB image to the HSV color space, in OpenCV's 8-bit
+ * scale (H in [0, 180), S and V in [0, 255]).
+ *
+ * @param rgb The RGB image to convert.
+ * @return The HSV image.
+ */
+Image convertToHSV(Image rgb);
+
+/**
+ * @brief Create a binary mask by thresholding an HSV image.
+ *
+ * @param hsv The input HSV image.
+ * @param lower The lower threshold values for each channel (H, S, V).
+ * @param upper The upper threshold values for each channel (H, S, V).
+ * @return The binary mask image.
+ */
+Image inRange(Image hsv, vector<uint8_t> lower, vector<uint8_t> upper);
+
+/**
+ * @brief Get the segmented image based on the HSV thresholding.
+ *
+ * @param inputMat The input image in cv::Mat format.
+ * @param lower The lower threshold values for each channel (H, S, V).
+ * @param upper The upper threshold values for each channel (H, S, V).
+ * @return The segmented image in cv::Mat format.
+ */
+cv::Mat getHSVSegmentedImage(cv::Mat& inputMat, vector<uint8_t>& lower,
+                             vector<uint8_t>& upper);
+
+/**
+ * @brief Perform erosion operation on an image.
+ *
+ * @param img The image to apply the operation on.
+ * @param kernelSize The size of the kernel to be used for the operation. This
+ * must be an odd number.
+ * @return The eroded image.
+ * @throws std::invalid_argument If the kernel size is not odd.
+ */
+Image erode(Image img, int kernelSize);
+
+/**
+ * @brief Perform dilation operation on an image.
+ *
+ * @param img The image to apply the operation on.
+ * @param kernelSize The size of the kernel to be used for the operation. This
+ * must be an odd number.
+ * @return The dilated image.
+ * @throws std::invalid_argument If the kernel size is not odd.
+ */
+Image dilate(Image img, int kernelSize);
+
+/**
+ * @brief Perform the morphological operation 'Opening' on an image.
+ *
+ * @param img The image to apply the operation on.
+ * @param kernelSize The size of the kernel to be used for the operation.
+ * @return The image after the 'Opening' operation.
+ */
+Image open(Image img, int kernelSize);
+
+/**
+ * @brief Perform the morphological operation 'Closing' on an image.
+ *
+ * @param img The image to apply the operation on.
+ * @param kernelSize The size of the kernel to be used for the operation.
+ * @return The image after the 'Closing' operation.
+ */
+Image close(Image img, int kernelSize);
+
+/**
+ * @brief Perform histogram equalization on the Value channel of an HSV image.
+ *
+ * @param hsv The input HSV image.
+ * @return The equalized HSV image.
+ */
+Image equalizeHistogram(Image hsv);
+
+/**
+ * @brief Find contours in a binary image using the Moore-Neighbor Tracing
+ * algorithm.
+ *
+ * @param binaryImage The binary image.
+ * @return A vector of contours, where each contour is represented as a vector
+ * of points.
+ */
+vector<vector<Point>> findContours(const Image& binaryImage);
+
+/**
+ * @brief Calculate the area of a contour using the shoelace formula.
+ *
+ * @param contour The contour represented as a vector of points.
+ * @return The area of the contour.
+ */
+double calculateArea(const vector<Point>& contour);
+
+/**
+ * @brief Calculate the centroid of a binary image.
+ *
+ * @param binaryImage The binary image.
+ * @return The centroid as a Point object (column in `x`, row in `y`).
+ */
+Point calculateCentroid(const Image& binaryImage);
+
+/**
+ * @brief Calculate the perimeter of a contour.
+ *
+ * @param contour The contour represented as a vector of points.
+ * @return The perimeter of the contour.
+ */
+double calculatePerimeter(const vector<Point>& contour);
+
+/**
+ * @brief Calculate the circularity of a contour.
+ *
+ * @param contour The contour represented as a vector of points.
+ * @return The circularity of the contour.
+ */
+double calculateCircularity(const vector<Point>& contour);
+
+/**
+ * @brief Get a circle fitted to a contour using the centroid and average
+ * distance to points.
+ *
+ * @param contour The contour represented as a vector of points.
+ * @return The fitted circle as a Circle object.
+ */
+Circle getCircleFromContour(const vector<Point>& contour);
+
+/**
+ * @brief Measure a closed contour in a single pass over its points: area,
+ * perimeter, moments of the enclosed area, bounding box and an algebraic
+ * least-squares (Kasa) circle fit.
+ *
+ * @param points The contour points, in order.
+ * @param count The number of points.
+ * @return The features of the contour.
+ */
+ContourFeatures measureContour(const Point* points, size_t count);
+
+/**
+ * @brief Find circles in a binary image based on circularity criteria.
+ *
+ * @param binaryImage The binary image.
+ * @param minCircularity The minimum circularity value for a circle to be
+ * considered.
+ * @return A vector of circles, each represented as a Circle object.
+ */
+vector<Circle> findCircles(const Image& binaryImage, double minCircularity);
+
+}  // namespace aulas
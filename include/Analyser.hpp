@@ -1,13 +1,55 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+#include "BandPipeline.hpp"
+#include "ChangeDetector.hpp"
 #include "ColorDetector.hpp"
+#include "Detection.hpp"
+#include "DetectionRing.hpp"
+#include "FrameScheduler.hpp"
+#include "LatencyHistogram.hpp"
+#include "PnmDataset.hpp"
+#include "Session.hpp"
 #include "ShapeDetector.hpp"
+#include "StageTimings.hpp"
+#include "VideoSink.hpp"
+#include "YuvFrame.hpp"
 
 using namespace std;
 
+/**
+ * @brief What `Analyser::detectIncremental` keeps between frames.
+ */
+struct IncrementalState {
+    ChangeDetector changes;
+    cv::Mat equalizationLut;     // Table of the last full frame
+    bool equalized = true;       // Whether the masks used equalisation
+    cv::Mat redMask, blueMask;   // Denoised colour masks
+    cv::Mat colorMask;           // Last combined mask
+    vector<Detection> detections;
+
+    explicit IncrementalState(double threshold = CHANGE_THRESHOLD,
+                              int refreshInterval = CHANGE_REFRESH_INTERVAL)
+        : changes(threshold, refreshInterval) {}
+};
+
+/**
+ * @brief Options of `Analyser::processVideo`.
+ */
+struct VideoOptions {
+    double frameBudgetMs = SCHEDULER_FRAME_BUDGET_MS;
+    double changeThreshold = CHANGE_THRESHOLD;  // Block luma difference
+    int refreshInterval = CHANGE_REFRESH_INTERVAL;  // Frames between refreshes
+    VideoSink* sink = nullptr;  // Archives the annotated frames when set
+    DetectionPublisher* ring = nullptr;  // Shares the detections when set
+    bool profile = false;  // Report per-stage timings and hardware counters
+    bool display = true;   // Show the annotated frames and the colour mask
+};
+
 /**
  * Class `Analyser` is responsible for processing video streams and performing
  * color and shape detection. It can identify blue circles, red circles,
@@ -15,12 +57,126 @@ using namespace std;
  */
 class Analyser {
    public:
+    /**
+     * The `prepareFrame` function performs color conversion and histogram
+     * equalization on a frame.
+     *
+     * @param frame - The frame to equalise in place.
+     * @param rgb - True when the frame is in RGB rather than BGR order.
+     */
+    static void prepareFrame(cv::Mat& frame, bool rgb = false);
+    /**
+     * The `detect` function runs color and shape detection on a frame at the
+     * given quality level.
+     *
+     * @param frame - The frame to analyse. At full quality it is equalised
+     * in place, as the annotations are drawn over the equalised image.
+     * @param colorMask - Receives the combined red and blue mask.
+     * @param level - The quality level, e.g. as chosen by a `FrameScheduler`.
+     * @param rgb - True when the frame is in RGB rather than BGR order.
+     * @param timings - When not null, the time of each stage is added to it.
+     * @return vector<Detection> The detections, in frame coordinates.
+     */
+    static vector<Detection> detect(cv::Mat& frame, cv::Mat& colorMask,
+                                    QualityLevel level = QUALITY_FULL,
+                                    bool rgb = false,
+                                    StageTimings* timings = nullptr);
+    /**
+     * The `detectStreaming` function runs color and shape detection on a
+     * frame without any intermediate image of the frame's size: the pixel
+     * stages run over bands of rows and the masks are kept as runs.
+     *
+     * @param frame - The frame to analyse; it is not modified.
+     * @param pipeline - The band buffers, reused from frame to frame.
+     * @param equalize - Whether to equalise the frame (see `QualityLevel`).
+     * @param rgb - True when the frame is in RGB rather than BGR order.
+     * @param timings - When not null, the time of each stage is added to it.
+     * @return vector<Detection> The detections, in frame coordinates.
+     */
+    static vector<Detection> detectStreaming(const cv::Mat& frame,
+                                             BandPipeline& pipeline,
+                                             bool equalize = true,
+                                             bool rgb = false,
+                                             StageTimings* timings = nullptr);
+    /**
+     * The `detectYuv` function runs color and shape detection on a raw YUV
+     * frame. Colours are classified straight from YUV and the equalisation
+     * is applied to the Y plane, so no BGR or HSV image is produced.
+     *
+     * @param frame - The frame to analyse. At full quality its Y plane is
+     * equalised in place.
+     * @param colorMask - Receives the combined red and blue mask.
+     * @param level - The quality level, e.g. as chosen by a `FrameScheduler`.
+     * @param timings - When not null, the time of each stage is added to it.
+     * @return vector<Detection> The detections, in frame coordinates.
+     */
+    static vector<Detection> detectYuv(YuvFrame& frame, cv::Mat& colorMask,
+                                       QualityLevel level = QUALITY_FULL,
+                                       StageTimings* timings = nullptr);
+    /**
+     * The `annotate` function draws the detections on the frame and reports
+     * them on the standard output.
+     *
+     * @param detections - The detections of the frame.
+     * @param frame - The frame to draw on.
+     */
+    static void annotate(const vector<Detection>& detections, cv::Mat& frame);
+    /**
+     * The `detectIncremental` function runs detection only on what changed
+     * since the previous frame, reusing the previous results for the rest.
+     *
+     * @param frame - The BGR frame to analyse; it is not modified, the
+     * equalisation works on a copy.
+     * @param colorMask - Receives the combined red and blue mask.
+     * @param state - The change detector and the results of previous frames.
+     * @param equalize - Whether to equalise the frame (see `QualityLevel`).
+     * @param timings - When not null, the time of each stage is added to it.
+     * @return vector<Detection> The detections, in frame coordinates.
+     */
+    static vector<Detection> detectIncremental(
+        const cv::Mat& frame, cv::Mat& colorMask, IncrementalState& state,
+        bool equalize = true, StageTimings* timings = nullptr);
     /**
      * The `processVideo` function reads frames from a video source, performs
      * color and shape detection, and processes each frame accordingly.
      *
-     * @param cap - A reference to a cv::VideoCapture object representing the
-     * video source.
+     * @param source - The video source: a camera or a recorded session.
+     * @param options - The frame budget, change gating and output options.
+     */
+    static void processVideo(FrameSource& source,
+                             const VideoOptions& options = VideoOptions());
+    /**
+     * The `recordSession` function records the frames of a video source,
+     * with their capture times, into a session file for later replay.
+     *
+     * @param source - The video source.
+     * @param writer - The session file.
+     * @param display - Whether to show the frames being recorded.
+     */
+    static void recordSession(FrameSource& source, SessionWriter& writer,
+                              bool display = true);
+    /**
+     * The `processDataset` function runs detection over every image of a
+     * memory-mapped PGM/PPM dataset, without any window, and reports the
+     * throughput.
+     *
+     * @param dataset - The dataset to sweep.
+     * @param profile - Whether to report per-stage timings and hardware
+     * counters.
+     * @param stream - Whether to detect through `detectStreaming`.
+     */
+    static void processDataset(PnmDataset& dataset, bool profile = false,
+                               bool stream = false);
+    /**
+     * The `processYuv` function runs detection over every frame of a raw
+     * YUV file and reports the throughput. Frames are converted to BGR only
+     * when the overlay is shown.
+     *
+     * @param reader - The raw YUV frames.
+     * @param overlay - Whether to show the annotated frames in a window.
+     * @param profile - Whether to report per-stage timings and hardware
+     * counters.
      */
-    static void processVideo(cv::VideoCapture& cap);
+    static void processYuv(YuvReader& reader, bool overlay = false,
+                           bool profile = false);
 };
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "RunMask.hpp"
+#include "StageTimings.hpp"
+
+#define STREAM_BAND_ROWS 16    // Rows converted and classified at a time
+#define STREAM_CLOSE_RADIUS 4  // As the closing of findCandidates
+
+using namespace std;
+
+/**
+ * @brief Returns the lookup table `cv::equalizeHist` applies to a channel
+ * with the given histogram.
+ *
+ * @param histogram The number of pixels at each level.
+ * @param total The number of pixels.
+ * @return cv::Mat The 1x256 CV_8U lookup table.
+ */
+cv::Mat equalizationLut(const int histogram[256], int total);
+
+/**
+ * @brief The operations of a `RowMorphology`. Both work bit by bit, so the
+ * bits of a class-bits row are eroded or dilated all at once.
+ */
+enum RowMorphOp {
+    ROW_ERODE = 0,  // AND over the structuring element
+    ROW_DILATE,     // OR over the structuring element
+};
+
+/**
+ * @brief One erosion or dilation over a stream of rows, keeping only the
+ * rows the structuring element spans, in a ring.
+ *
+ * The element is the 3x3 cross (what `cv::MORPH_ELLIPSE` gives at 3x3) or
+ * a square of side `2 * radius + 1`. Pixels outside the frame take no part,
+ * as with the default border of `cv::morphologyEx`. Each output row is
+ * complete once the rows within reach below it have been pushed, so the
+ * output lags the input by the radius; the last rows come out of `drain`.
+ */
+class RowMorphology {
+   public:
+    /**
+     * @brief Sets up the ring for rows of `width` bytes.
+     *
+     * @param width The row width.
+     * @param op Erosion or dilation.
+     * @param radius The reach of the element; 1 with the cross.
+     * @param cross Whether the element is the 3x3 cross, else a square.
+     */
+    RowMorphology(int width, RowMorphOp op, int radius, bool cross);
+
+    /**
+     * @brief Starts a new frame.
+     */
+    void reset() { pushed = emitted = 0; }
+    /**
+     * @brief Pushes the next input row.
+     *
+     * @param row The row, `width` bytes.
+     * @return const uint8_t* The output row that became complete, or null
+     * while the first rows are buffered. It is valid until the next call.
+     */
+    const uint8_t* push(const uint8_t* row);
+    /**
+     * @brief After the last input row, returns the remaining output rows,
+     * one per call, then null.
+     */
+    const uint8_t* drain();
+    /**
+     * @brief Returns the bytes held by the ring and the output row.
+     */
+    size_t bytes() const { return ring.size() + out.size(); }
+
+   private:
+    const uint8_t* emit();
+    uint8_t* slot(int y) { return ring.data() + (y % rows) * width; }
+
+    int width;
+    int radius;
+    int rows;  // Rows of the ring, 2 * radius + 1
+    RowMorphOp op;
+    bool cross;
+    int pushed = 0;   // Input rows so far
+    int emitted = 0;  // Output rows so far
+    // The input rows with the cross; with the square, the input rows
+    // already reduced along the row
+    vector<uint8_t> ring;
+    vector<uint8_t> out;
+};
+
+/**
+ * @brief Runs the pixel stages of the BGR pipeline over bands of rows, so
+ * that no intermediate image of the frame's size is made.
+ *
+ * A first pass over the frame counts the histogram of V, the largest of B,
+ * G and R, for the equalisation table. The second pass converts each band
+ * of `STREAM_BAND_ROWS` rows to HSV, equalises V, converts it back and
+ * classifies it. Each row of red and blue class bits then goes through the
+ * denoising of `ColorDetector::detect` and the closing of
+ * `ShapeDetector::findCandidates`, as a chain of `RowMorphology` stages
+ * carrying both colours at once, and is encoded straight into run masks.
+ *
+ * Besides the frame and the masks, the working set is two bands and a few
+ * rows per stage: it grows with the frame width and the height of the
+ * structuring elements, not with the frame area. The masks are those the
+ * whole-frame pipeline makes, pixel for pixel.
+ */
+class BandPipeline {
+   public:
+    /**
+     * @brief Runs the pixel stages over a frame.
+     *
+     * @param frame The frame, CV_8UC3; it is not modified.
+     * @param red Receives the red mask, denoised and closed.
+     * @param blue Receives the blue mask, denoised and closed.
+     * @param equalize Whether to equalise the frame, as
+     * `Analyser::prepareFrame` does.
+     * @param rgb True when the frame is in RGB rather than BGR order.
+     * @param timings When not null, the histogram pass is added to the
+     * prepare stage and the band pass to the classify stage.
+     */
+    void run(const cv::Mat& frame, RunMask& red, RunMask& blue,
+             bool equalize = true, bool rgb = false,
+             StageTimings* timings = nullptr);
+    /**
+     * @brief Returns the bytes held by the band buffers and the morphology
+     * rings: the working set of `run`, besides the frame and the masks.
+     */
+    size_t workingSetBytes() const;
+
+   private:
+    void setWidth(int width);
+    void feed(size_t stage, const uint8_t* row, RunMask& red, RunMask& blue);
+
+    int width = 0;
+    cv::Mat hsv;           // One band in HSV
+    cv::Mat band;          // One band, equalised back to BGR
+    vector<uint8_t> bits;  // The class bits of one row
+    vector<RowMorphology> stages;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define BATCH_IO_THREADS 2
+#define BATCH_QUEUE_DEPTH 32
+#define BATCH_CHECKPOINT_EVERY 256
+#define BATCH_PROGRESS_SECONDS 2.0
+
+using namespace std;
+
+/**
+ * @brief Configuration of a batch run.
+ */
+struct BatchConfig {
+    string input;   // A directory to walk, or a file listing one image a line
+    string output;  // The results file
+    int ioThreads = BATCH_IO_THREADS;
+    int detectThreads = 0;  // 0 uses one thread per core
+    bool resume = false;    // Continue from the checkpoint of `output`
+};
+
+/**
+ * @brief Summary of a batch run.
+ */
+struct BatchStats {
+    size_t total = 0;      // Images in the input
+    size_t skipped = 0;    // Images already done by a previous run
+    size_t processed = 0;  // Images processed by this run
+    size_t failed = 0;     // Images that could not be decoded or analysed
+    double seconds = 0.0;
+};
+
+/**
+ * @brief This class runs the detector over large image archives. Images are
+ * decoded by a pool of I/O threads and analysed by a separate pool of
+ * detection threads, so decoding and detection overlap. Results are written
+ * to a single file in input order, one line per image:
+ *
+ *     <path>\t<count>\t<kind> <direction> <x> <y> <radius>\t...
+ *
+ * A checkpoint next to the output (`<output>.checkpoint`) records how many
+ * images are safely written and a hash of the input list, so that an
+ * interrupted run can be resumed over the same inputs, and only those.
+ */
+class BatchProcessor {
+   public:
+    /**
+     * @brief Lists the images of a directory (recursively, in path order) or
+     * of a list file.
+     */
+    static vector<string> listInputs(const string& input);
+    /**
+     * @brief Processes every image of the input.
+     *
+     * @param config The input, output, pool sizes and resume flag.
+     * @return BatchStats The summary of the run.
+     * @throws std::runtime_error If the input or output cannot be opened, or
+     * the checkpoint to resume from does not match the input list.
+     */
+    static BatchStats run(const BatchConfig& config);
+};
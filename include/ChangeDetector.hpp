@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#define CHANGE_DOWNSAMPLE 8         // Frame pixels per luma pixel, per axis
+#define CHANGE_BLOCK_SIZE 4         // Luma pixels per block, per axis
+#define CHANGE_THRESHOLD 6.0        // Mean absolute luma difference per block
+#define CHANGE_FULL_RATIO 0.5       // Dirty block ratio forcing a full refresh
+#define CHANGE_REFRESH_INTERVAL 30  // Frames between forced full refreshes
+#define CHANGE_HALO 8  // Reach of the colour denoising morphology, in pixels
+
+using namespace std;
+
+/**
+ * @brief How much of a frame has to be reprocessed.
+ */
+enum ChangeKind {
+    CHANGE_NONE = 0,  // Nothing changed: reuse the previous results
+    CHANGE_PARTIAL,   // Only `dirty` changed
+    CHANGE_FULL       // Reprocess the whole frame
+};
+
+/**
+ * @brief The verdict of the change detector for one frame.
+ */
+struct ChangeResult {
+    ChangeKind kind = CHANGE_FULL;
+    cv::Rect dirty;  // Changed area in frame coordinates, for CHANGE_PARTIAL
+    int dirtyBlocks = 0;
+};
+
+/**
+ * @brief This class decides which part of a frame changed since it was last
+ * processed. Frames are reduced to a heavily downsampled luma image and
+ * compared block by block (mean absolute difference) against a reference
+ * that is only refreshed where the frame gets reprocessed, so slow drift
+ * accumulates until it is picked up.
+ */
+class ChangeDetector {
+   public:
+    /**
+     * @param threshold The mean absolute luma difference above which a block
+     * is considered changed.
+     * @param refreshInterval Forces a full refresh every that many frames,
+     * bounding how long a missed change can persist.
+     */
+    explicit ChangeDetector(double threshold = CHANGE_THRESHOLD,
+                            int refreshInterval = CHANGE_REFRESH_INTERVAL);
+
+    /**
+     * @brief Compares a frame against the reference and updates the
+     * reference where the frame will be reprocessed.
+     *
+     * @param frame The BGR frame.
+     * @return ChangeResult What has to be reprocessed.
+     */
+    ChangeResult update(const cv::Mat& frame);
+    /**
+     * @brief Forgets the reference, so that the next frame is a full refresh.
+     */
+    void invalidate();
+
+    uint64_t staticFrames = 0;
+    uint64_t partialFrames = 0;
+    uint64_t fullFrames = 0;
+
+   private:
+    double threshold;
+    int refreshInterval;
+    int sinceRefresh = 0;
+    cv::Mat reference;
+};
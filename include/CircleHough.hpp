@@ -0,0 +1,84 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#define HOUGH_MIN_CONTOUR_POINTS 16
+#define HOUGH_MIN_RADIUS_RATIO 0.5
+#define HOUGH_TANGENT_SPAN_MIN 3
+#define HOUGH_TANGENT_SPAN_MAX 32
+#define HOUGH_CENTER_VOTE_RATIO 0.2
+#define HOUGH_MIN_SUPPORT 0.5
+#define HOUGH_MAX_CIRCLES_PER_BLOB 4
+#define HOUGH_PARALLEL_POINTS 1024
+#define HOUGH_TILE_ROWS 32
+
+using namespace std;
+
+/**
+ * @brief The circle detectors `ShapeDetector::detectCircles` can run.
+ */
+enum CircleBackend {
+    CIRCLE_BACKEND_OPENCV = 0,  // cv::HoughCircles on the mask
+    CIRCLE_BACKEND_CONTOUR      // CircleHough on the mask's contours
+};
+
+/**
+ * @brief Parses a backend name ("opencv" or "contour").
+ *
+ * @return bool False when the name is not a known backend.
+ */
+bool parseCircleBackend(const string& name, CircleBackend& backend);
+
+/**
+ * @brief A circle Hough transform for binary masks.
+ *
+ * `cv::HoughCircles` runs Canny and Sobel over the whole image to find edge
+ * points and their gradients. A mask already has its edges: they are the
+ * contours of its blobs, and the normal at each point follows from the
+ * contour tangent. Each outer contour votes on its own, along its inward
+ * normals only, and only for radii that fit in the blob's bounding box, into
+ * an accumulator covering that bounding box. Large contours are split
+ * between threads, each voting into its own partial accumulator, and the
+ * partials are merged in parallel, one band of `HOUGH_TILE_ROWS` rows per
+ * task.
+ *
+ * Peaks holding at least `HOUGH_CENTER_VOTE_RATIO` of the contour's points
+ * are centre candidates. The radius is the most common distance from the
+ * centre to the contour, kept when the points at that distance cover
+ * `HOUGH_MIN_SUPPORT` of the circumference.
+ */
+class CircleHough {
+   public:
+    /**
+     * @brief Finds circles in a binary mask, with the output of
+     * `cv::HoughCircles`.
+     *
+     * @param mask The CV_8UC1 mask.
+     * @param circles Receives (x, y, radius) of each circle, the strongest
+     * first.
+     * @param minDist The minimum distance between the centres of two circles.
+     * @param minRadius The minimum radius.
+     * @param maxRadius The maximum radius.
+     */
+    static void detect(const cv::Mat& mask, vector<cv::Vec3f>& circles,
+                       double minDist, int minRadius, int maxRadius);
+
+   private:
+    /**
+     * @brief Votes for the centres of one contour.
+     *
+     * @return cv::Mat A CV_32SC1 accumulator over the contour's bounding box.
+     */
+    static cv::Mat accumulate(const vector<cv::Point>& contour, cv::Rect box,
+                              int minRadius, int maxRadius);
+    /**
+     * @brief Finds the radius of a circle around a centre.
+     *
+     * @return bool False when no radius is supported by enough points.
+     */
+    static bool fitRadius(const vector<cv::Point>& contour,
+                          cv::Point2f center, int minRadius, int maxRadius,
+                          float& radius);
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <utility>
+
+#define COLOR_CLASS_MAX_RANGES 2
+#define BGR_LUT_BITS 6
+#define BGR_LUT_AMBIGUOUS 0x80
+
+using namespace std;
+
+class TileOccupancy;
+
+/**
+ * @brief An inclusive HSV box, in OpenCV's 8-bit HSV scale (H in [0, 180],
+ * S and V in [0, 255]).
+ */
+struct HsvRange {
+    uint8_t hLow, hHigh;
+    uint8_t sLow, sHigh;
+    uint8_t vLow, vHigh;
+};
+
+/**
+ * @brief A named colour class made of up to `COLOR_CLASS_MAX_RANGES` HSV
+ * boxes. Colours whose hue wraps around 0 (red) use two boxes.
+ */
+struct ColorClass {
+    const char* name;
+    int numRanges;
+    HsvRange ranges[COLOR_CLASS_MAX_RANGES];
+};
+
+/**
+ * @brief Index of each colour class in `COLOR_CLASSES`; also the bit it
+ * occupies in a class-bits image.
+ */
+enum ColorClassId {
+    COLOR_RED = 0,
+    COLOR_BLUE,
+    COLOR_YELLOW,
+    COLOR_WHITE,
+    COLOR_CLASS_COUNT
+};
+
+constexpr ColorClass COLOR_CLASSES[] = {
+    {"red", 2, {{0, 10, 130, 255, 80, 255}, {165, 180, 130, 255, 80, 255}}},
+    {"blue", 1, {{104, 124, 110, 255, 80, 255}, {}}},
+    {"yellow", 1, {{18, 34, 120, 255, 100, 255}, {}}},
+    {"white", 1, {{0, 180, 0, 40, 170, 255}, {}}},
+};
+
+static_assert(sizeof(COLOR_CLASSES) / sizeof(COLOR_CLASSES[0]) ==
+                  COLOR_CLASS_COUNT,
+              "COLOR_CLASSES must have one entry per ColorClassId");
+static_assert(COLOR_CLASS_COUNT <= 8, "class bits must fit in one byte");
+
+namespace color_kernel {
+
+/**
+ * @brief Tests one HSV box of one class. Unused boxes fold to zero at
+ * compile time, and the comparisons are combined with `&` so the result is
+ * branch-free.
+ */
+template <size_t C, size_t R>
+inline uint8_t inBox(uint8_t h, uint8_t s, uint8_t v) {
+    if constexpr (R >= static_cast<size_t>(COLOR_CLASSES[C].numRanges)) {
+        return 0;
+    } else {
+        constexpr HsvRange r = COLOR_CLASSES[C].ranges[R];
+        return static_cast<uint8_t>((h >= r.hLow) & (h <= r.hHigh) &
+                                    (s >= r.sLow) & (s <= r.sHigh) &
+                                    (v >= r.vLow) & (v <= r.vHigh));
+    }
+}
+
+/**
+ * @brief Returns the bit of class `C` for one pixel.
+ */
+template <size_t C, size_t... R>
+inline uint8_t classBit(uint8_t h, uint8_t s, uint8_t v,
+                        index_sequence<R...>) {
+    return static_cast<uint8_t>((inBox<C, R>(h, s, v) | ...) << C);
+}
+
+/**
+ * @brief Returns the bits of every class in the table for one pixel.
+ */
+template <size_t... C>
+inline uint8_t classify(uint8_t h, uint8_t s, uint8_t v, index_sequence<C...>) {
+    return static_cast<uint8_t>(
+        (classBit<C>(h, s, v, make_index_sequence<COLOR_CLASS_MAX_RANGES>{}) |
+         ...));
+}
+
+}  // namespace color_kernel
+
+/**
+ * @brief Classifies HSV pixels against every entry of `COLOR_CLASSES` in a
+ * single pass. The per-pixel test is expanded from the table at compile
+ * time, so adding a class adds a few comparisons to the kernel instead of
+ * another full-frame `cv::inRange`.
+ *
+ * BGR images can skip the HSV image altogether: a 64x64x64 table indexed by
+ * the top `BGR_LUT_BITS` bits of B, G and R holds the class bits shared by
+ * every colour of a cell, built from `COLOR_CLASSES` on first use. The cells
+ * straddling a class boundary are flagged `BGR_LUT_AMBIGUOUS`, and their
+ * pixels go through `classifyBgrPixel`, so the result is identical to
+ * converting the image to HSV and classifying it.
+ */
+class ColorClassifier {
+   public:
+    /**
+     * @brief Classifies one HSV pixel.
+     *
+     * @return uint8_t Bit `i` is set when the pixel belongs to class `i`.
+     */
+    static inline uint8_t classifyPixel(uint8_t h, uint8_t s, uint8_t v) {
+        return color_kernel::classify(
+            h, s, v, make_index_sequence<COLOR_CLASS_COUNT>{});
+    }
+
+    /**
+     * @brief Classifies one BGR pixel, reproducing bit for bit the 8-bit
+     * conversion of `cv::cvtColor(COLOR_BGR2HSV)`, so that the result equals
+     * that of `classify` on the converted image.
+     *
+     * @return uint8_t Bit `i` is set when the pixel belongs to class `i`.
+     */
+    static uint8_t classifyBgrPixel(uint8_t b, uint8_t g, uint8_t r);
+
+    /**
+     * @brief Classifies an HSV image.
+     *
+     * @param hsv The input image, CV_8UC3 in OpenCV's HSV scale.
+     * @param occupancy When not null, receives the per-tile counts of each
+     * class, gathered as the rows are classified.
+     * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+     */
+    static cv::Mat classify(const cv::Mat& hsv,
+                            TileOccupancy* occupancy = nullptr);
+    /**
+     * @brief Classifies a BGR image through the cell table.
+     *
+     * @param bgr The input image, CV_8UC3.
+     * @param rgb True when the image is in RGB rather than BGR order.
+     * @param occupancy When not null, receives the per-tile counts of each
+     * class, gathered as the rows are classified.
+     * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+     */
+    static cv::Mat classifyBgr(const cv::Mat& bgr, bool rgb = false,
+                               TileOccupancy* occupancy = nullptr);
+    /**
+     * @brief Classifies one row of BGR pixels through the cell table, as
+     * `classifyBgr` does for each row of an image.
+     *
+     * @param bgr The pixels, three bytes each.
+     * @param width The number of pixels.
+     * @param rgb True when the pixels are in RGB rather than BGR order.
+     * @param bits Receives the class bits of each pixel.
+     */
+    static void classifyBgrRow(const uint8_t* bgr, int width, bool rgb,
+                               uint8_t* bits);
+
+    /**
+     * @brief Extracts the 0/255 mask of one class from a class-bits image.
+     *
+     * @param bits The class-bits image returned by `classify`.
+     * @param id The class to extract.
+     * @return cv::Mat The CV_8UC1 mask of the class.
+     */
+    static cv::Mat extract(const cv::Mat& bits, ColorClassId id);
+
+   private:
+    /**
+     * @brief Returns the BGR cell table, built on first use.
+     */
+    static const uint8_t* bgrTable();
+};
@@ -3,13 +3,10 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 
-#define RED_LOWER_BOUND1 cv::Scalar(0, 130, 80)
-#define RED_UPPER_BOUND1 cv::Scalar(10, 255, 255)
-#define RED_LOWER_BOUND2 cv::Scalar(165, 130, 80)
-#define RED_UPPER_BOUND2 cv::Scalar(180, 255, 255)
+#include "ColorClassifier.hpp"
+#include "TileOccupancy.hpp"
 
-#define BLUE_LOWER_BOUND cv::Scalar(104, 110, 80)
-#define BLUE_UPPER_BOUND cv::Scalar(124, 255, 255)
+#define COLOR_DENOISE_HALO 8  // Reach of the denoising morphology, in pixels
 
 using namespace std;
 
@@ -19,6 +16,29 @@ using namespace std;
  */
 class ColorDetector {
    public:
+    /**
+     * @brief Classifies every pixel of the input image against all colour
+     * classes in one pass.
+     *
+     * @param img The input image, BGR unless `code` says otherwise.
+     * @param code The cv::cvtColor code converting `img` to HSV.
+     * @param occupancy When not null, receives the per-tile counts of each
+     * class.
+     * @return cv::Mat The class-bits image (see `ColorClassifier`).
+     */
+    static cv::Mat classify(const cv::Mat& img, int code = cv::COLOR_BGR2HSV,
+                            TileOccupancy* occupancy = nullptr);
+    /**
+     * @brief Extracts and denoises the mask of one colour class.
+     *
+     * @param classBits The class-bits image returned by `classify`.
+     * @param id The colour class to extract.
+     * @param occupancy When not null, the tile counts of `classBits`: only
+     * the regions holding the class are processed.
+     * @return cv::Mat The mask of the detected color.
+     */
+    static cv::Mat detect(const cv::Mat& classBits, ColorClassId id,
+                          const TileOccupancy* occupancy = nullptr);
     /**
      * @brief Detects the red color in the input image.
      *
@@ -33,4 +53,31 @@ class ColorDetector {
      * @return cv::Mat The mask of the detected blue color.
      */
     static cv::Mat detectBlue(const cv::Mat& img);
+    /**
+     * @brief Extracts and denoises the mask of one colour class in each
+     * image of a batch, as `detect(classify(img), id)` does for one image,
+     * with a single dispatch to the thread pool for the whole batch.
+     *
+     * @param imgs The BGR input images, e.g. crops of a frame around
+     * tracked signs. Empty images get an empty mask.
+     * @param id The colour class to extract.
+     * @return vector<cv::Mat> The mask of each image, in order. They are
+     * views into one buffer allocated for the batch.
+     */
+    static vector<cv::Mat> detectBatch(const vector<cv::Mat>& imgs,
+                                       ColorClassId id);
+    /**
+     * @brief Detects the red color in each image of a batch.
+     *
+     * @param imgs The input images.
+     * @return vector<cv::Mat> The mask of each image, in one shared buffer.
+     */
+    static vector<cv::Mat> detectRed(const vector<cv::Mat>& imgs);
+    /**
+     * @brief Detects the blue color in each image of a batch.
+     *
+     * @param imgs The input images.
+     * @return vector<cv::Mat> The mask of each image, in one shared buffer.
+     */
+    static vector<cv::Mat> detectBlue(const vector<cv::Mat>& imgs);
 };
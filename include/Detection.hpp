@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief The kinds of sign the `Analyser` recognises.
+ */
+enum SignKind {
+    SIGN_BLUE_CIRCLE = 0,  // Mandatory direction (turn left / right)
+    SIGN_RED_CIRCLE,       // Forbidden
+    SIGN_OCTAGON,          // Stop
+    SIGN_SQUARE,           // Highway / car road
+    SIGN_KIND_COUNT
+};
+
+/**
+ * @brief The direction read from a sign, when it has one.
+ */
+enum SignDirection {
+    DIRECTION_NONE = 0,
+    DIRECTION_LEFT,
+    DIRECTION_RIGHT,
+    DIRECTION_HIGHWAY,
+    DIRECTION_CAR,
+    DIRECTION_COUNT
+};
+
+/**
+ * @brief One sign detected in a frame, in frame coordinates.
+ */
+struct Detection {
+    SignKind kind = SIGN_BLUE_CIRCLE;
+    SignDirection direction = DIRECTION_NONE;
+    cv::Point2f center;        // Circle centre, or polygon centre
+    float radius = 0.0f;       // Circles only
+    cv::Point2f centerOfMass;  // Centre of mass of the sign's mask
+    vector<cv::Point> polygon;  // Octagons and squares only
+    chrono::steady_clock::time_point captured;  // Capture of its frame
+};
+
+/**
+ * @brief Returns the lower-case name of a sign kind ("blue_circle", ...).
+ */
+const char* signKindName(SignKind kind);
+/**
+ * @brief Returns the lower-case name of a direction ("none", "left", ...).
+ */
+const char* signDirectionName(SignDirection direction);
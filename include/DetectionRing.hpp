@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "Detection.hpp"
+#include "LatencyHistogram.hpp"
+
+#define RING_MAGIC "VISAORNG"
+#define RING_VERSION 1
+#define RING_SLOTS 64
+#define RING_MAX_DETECTIONS 16
+#define RING_THUMB_WIDTH 80
+#define RING_THUMB_HEIGHT 60
+
+using namespace std;
+
+/**
+ * @brief One detection as published in the ring: a fixed-size copy of a
+ * `Detection`, with the polygon reduced to its bounding box.
+ */
+struct RingDetection {
+    uint8_t kind;                    // SignKind
+    uint8_t direction;               // SignDirection
+    uint16_t reserved;               // Zero
+    float x, y;                      // Centre
+    float radius;                    // Circles only
+    float massX, massY;              // Centre of mass of the sign's mask
+    float left, top, right, bottom;  // Bounding box
+};
+
+/**
+ * @brief The header of the shared memory object, followed by the slots. The
+ * geometry is fixed by the publisher; subscribers read it from here.
+ */
+struct RingHeader {
+    char magic[8];               // RING_MAGIC, without the terminator
+    uint32_t version;            // RING_VERSION
+    uint32_t slotCount;          // Slots in the ring
+    uint32_t slotBytes;          // Size of a slot, thumbnail included
+    uint32_t maxDetections;      // Detections a slot holds
+    uint32_t thumbWidth;         // Thumbnail size; 0 without thumbnails
+    uint32_t thumbHeight;
+    atomic<uint64_t> published;  // Records published so far
+};
+
+/**
+ * @brief The fixed part of a slot. The detections and the thumbnail follow.
+ */
+struct RingSlot {
+    // Seqlock: 2n + 1 while record n is written into the slot, 2n + 2 once
+    // it is complete
+    atomic<uint64_t> sequence;
+    uint64_t frame;       // Frame number at the publisher
+    int64_t capturedNs;   // Capture time on the monotonic clock
+    int64_t publishedNs;  // Publication time on the monotonic clock
+    int32_t width;        // Frame size, to scale the thumbnail back
+    int32_t height;
+    uint32_t count;       // Detections in the slot
+    uint32_t truncated;   // Detections that did not fit in the slot
+};
+
+/**
+ * @brief One record read from the ring.
+ */
+struct RingRecord {
+    uint64_t sequence = 0;  // Record number, from 0
+    uint64_t frame = 0;
+    int64_t capturedNs = 0;
+    int64_t publishedNs = 0;
+    cv::Size frameSize;
+    uint32_t truncated = 0;
+    vector<RingDetection> detections;
+    cv::Mat thumbnail;      // CV_8UC1 colour mask; empty without thumbnails
+};
+
+/**
+ * @brief Publishes detections into a POSIX shared memory ring for other
+ * processes on the same machine. There is a single writer and any number
+ * of readers; each slot is guarded by a seqlock, so the writer never waits
+ * for a reader, and a reader that falls behind by a whole ring loses the
+ * oldest records rather than holding the writer back.
+ */
+class DetectionPublisher {
+   public:
+    /**
+     * @brief Creates the shared memory object, replacing any stale one of
+     * the same name.
+     *
+     * @param name The object name, e.g. "/visao".
+     * @param slots The number of records the ring keeps.
+     * @param thumbnail The size of the mask thumbnails; empty for none.
+     * @throws std::runtime_error If the object cannot be created.
+     */
+    DetectionPublisher(const string& name, uint32_t slots = RING_SLOTS,
+                       cv::Size thumbnail = cv::Size(RING_THUMB_WIDTH,
+                                                     RING_THUMB_HEIGHT));
+    ~DetectionPublisher();
+
+    DetectionPublisher(const DetectionPublisher&) = delete;
+    DetectionPublisher& operator=(const DetectionPublisher&) = delete;
+
+    /**
+     * @brief Publishes the detections of a frame.
+     *
+     * @param frame The frame number.
+     * @param captured The capture time of the frame.
+     * @param frameSize The size of the frame.
+     * @param detections The detections, in frame coordinates.
+     * @param mask The colour mask, thumbnailed when the ring has thumbnails;
+     * may be empty.
+     */
+    void publish(uint64_t frame, LatencyClock::time_point captured,
+                 cv::Size frameSize, const vector<Detection>& detections,
+                 const cv::Mat& mask);
+
+    uint64_t published() const;
+
+   private:
+    string name;
+    void* base = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * @brief Reads the records of a `DetectionPublisher` from another process.
+ */
+class DetectionSubscriber {
+   public:
+    /**
+     * @brief Maps the shared memory object of a publisher, read-only.
+     *
+     * @param name The object name, as given to the publisher.
+     * @param fromOldest Whether to start with the oldest record still in
+     * the ring rather than with the next one published.
+     * @throws std::runtime_error If the object does not exist or is not a
+     * detection ring.
+     */
+    explicit DetectionSubscriber(const string& name, bool fromOldest = false);
+    ~DetectionSubscriber();
+
+    DetectionSubscriber(const DetectionSubscriber&) = delete;
+    DetectionSubscriber& operator=(const DetectionSubscriber&) = delete;
+
+    /**
+     * @brief Reads the next record, without waiting.
+     *
+     * @param record Receives the record.
+     * @return bool False when no new record has been published.
+     */
+    bool poll(RingRecord& record);
+
+    /**
+     * @brief Returns how many records were overwritten before they could
+     * be read.
+     */
+    uint64_t lost() const { return missed; }
+
+   private:
+    const void* base = nullptr;
+    size_t length = 0;
+    uint64_t next = 0;
+    uint64_t missed = 0;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+
+#include "FrameSource.hpp"
+#include "LatencyHistogram.hpp"
+
+#define SCHEDULER_FRAME_BUDGET_MS 33.0
+#define SCHEDULER_OVERLOAD_FRAMES 5
+#define SCHEDULER_HEADROOM_FRAMES 30
+#define SCHEDULER_HEADROOM_RATIO 0.6
+
+using namespace std;
+
+/**
+ * @brief Quality levels the scheduler steps through under sustained
+ * overload, from best to cheapest. Each level keeps the degradations of the
+ * levels above it.
+ */
+enum QualityLevel {
+    QUALITY_FULL = 0,          // Full pipeline
+    QUALITY_NO_EQUALIZE,       // Skip histogram equalisation
+    QUALITY_HALF_RESOLUTION,   // Detect on one pyramid level down
+    QUALITY_ALTERNATE_FRAMES,  // Detect every other frame only
+    QUALITY_LEVEL_COUNT
+};
+
+/**
+ * @brief Counters exported by the scheduler.
+ */
+struct SchedulerStats {
+    uint64_t captured = 0;      // Frames read from the source
+    uint64_t processed = 0;     // Frames handed to the pipeline
+    uint64_t dropped = 0;       // Stale frames replaced before processing
+    uint64_t skipped = 0;       // Frames handed out without detection
+    uint64_t overBudget = 0;    // Processed frames that missed the budget
+    uint64_t degradations = 0;  // Steps down in quality
+    uint64_t recoveries = 0;    // Steps back up in quality
+    QualityLevel level = QUALITY_FULL;
+};
+
+/**
+ * @brief This class decouples capture from processing so that the pipeline
+ * always works on the newest frame. A capture thread keeps only the latest
+ * frame, counting the ones it overwrites as dropped, and the processing
+ * side reports how long each frame took so the quality level can follow
+ * the per-frame latency budget. Each frame carries the capture time given
+ * by its source. Sources that are not live, such as a replay as fast as
+ * possible, are read one frame at a time instead and never drop frames.
+ */
+class FrameScheduler {
+   public:
+    /**
+     * @brief Starts the capture thread.
+     *
+     * @param source The frame source; only the capture thread reads from it.
+     * @param budgetMs The per-frame processing budget in milliseconds.
+     */
+    FrameScheduler(FrameSource& source,
+                   double budgetMs = SCHEDULER_FRAME_BUDGET_MS);
+    ~FrameScheduler();
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    /**
+     * @brief Waits for a frame newer than the previous one.
+     *
+     * @param frame Receives the newest captured frame.
+     * @param times When not null, receives the capture time of the frame and
+     * the time it was handed out.
+     * @return bool False once the source is exhausted.
+     */
+    bool next(cv::Mat& frame, FrameTimes* times = nullptr);
+    /**
+     * @brief Tells whether the frame returned by the last `next` should run
+     * detection at the current quality level.
+     */
+    bool shouldDetect() const;
+    /**
+     * @brief Reports the processing time of the last frame and steps the
+     * quality level down or up accordingly.
+     *
+     * @param elapsedMs The time spent on the frame, in milliseconds.
+     */
+    void report(double elapsedMs);
+    /**
+     * @brief Stops the capture thread. Called by the destructor.
+     */
+    void stop();
+
+    QualityLevel level() const;
+    SchedulerStats stats() const;
+
+   private:
+    void captureLoop();
+
+    FrameSource& source;
+    double budgetMs;
+
+    mutable mutex lock;
+    condition_variable frameReady;
+    condition_variable frameTaken;
+    cv::Mat latest;
+    LatencyClock::time_point latestCaptured;
+    bool fresh = false;
+    bool finished = false;
+    bool stopping = false;
+
+    SchedulerStats counters;
+    int overloadStreak = 0;
+    int headroomStreak = 0;
+
+    thread worker;
+};
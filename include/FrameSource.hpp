@@ -0,0 +1,52 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "LatencyHistogram.hpp"
+
+using namespace std;
+
+/**
+ * @brief A source of timestamped frames for `FrameScheduler`.
+ */
+class FrameSource {
+   public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @brief Reads the next frame.
+     *
+     * @param frame Receives the frame.
+     * @param captured Receives the time the frame was captured.
+     * @return bool False once the source is exhausted.
+     */
+    virtual bool read(cv::Mat& frame, LatencyClock::time_point& captured) = 0;
+    /**
+     * @brief Whether frames arrive on their own schedule, so that a frame
+     * the pipeline has not picked up yet is stale once the next one arrives.
+     * Frames of other sources wait for the pipeline and are never dropped.
+     */
+    virtual bool live() const { return true; }
+};
+
+/**
+ * @brief Frames of a `cv::VideoCapture`, stamped with the driver's timestamp
+ * when the backend reports one on the monotonic clock, and with the time
+ * they were read otherwise.
+ */
+class CameraSource : public FrameSource {
+   public:
+    explicit CameraSource(cv::VideoCapture& cap) : cap(cap) {}
+
+    /**
+     * @brief Reads the next frame.
+     *
+     * @param frame Receives the frame.
+     * @param captured Receives the time the frame was captured.
+     * @return bool False once the capture ends.
+     */
+    bool read(cv::Mat& frame, LatencyClock::time_point& captured) override;
+
+   private:
+    cv::VideoCapture& cap;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#define LATENCY_SUB_BUCKET_BITS 7
+#define LATENCY_MAX_BITS 32
+#define LATENCY_REPORT_SECONDS 10.0
+#define LATENCY_MAX_CAPTURE_AGE_MS 1000
+
+using namespace std;
+
+using LatencyClock = chrono::steady_clock;
+
+/**
+ * @brief The spans of a frame's way from capture to decision.
+ */
+enum LatencyStage {
+    LATENCY_QUEUE = 0,   // Capture to pick-up by the pipeline
+    LATENCY_DETECT,      // Pick-up to detections
+    LATENCY_EMIT,        // Detections to the decision being reported
+    LATENCY_END_TO_END,  // Capture to the decision being reported
+    LATENCY_STAGE_COUNT
+};
+
+/**
+ * @brief Returns the name of a latency stage ("queue", ...).
+ */
+const char* latencyStageName(LatencyStage stage);
+
+/**
+ * @brief When a frame reached each point of the pipeline.
+ */
+struct FrameTimes {
+    LatencyClock::time_point captured;  // Capture, as reported by the source
+    LatencyClock::time_point dequeued;  // Handed to the pipeline
+    LatencyClock::time_point detected;  // Detections ready
+    LatencyClock::time_point emitted;   // Decision drawn and reported
+};
+
+/**
+ * @brief A latency histogram in the manner of HdrHistogram: values in
+ * microseconds go into log-linear buckets, `2^LATENCY_SUB_BUCKET_BITS` per
+ * power of two, so any percentile is read back within 1% whatever its
+ * magnitude, from 1 us up to `2^LATENCY_MAX_BITS` us. Recording is a
+ * couple of shifts and an increment, and the memory is fixed.
+ */
+class LatencyHistogram {
+   public:
+    LatencyHistogram();
+
+    /**
+     * @brief Records one latency.
+     *
+     * @param ms The latency in milliseconds; negative values count as 0.
+     */
+    void record(double ms);
+    /**
+     * @brief Returns the latency at or below which `percent` of the
+     * recorded values fall, in milliseconds; 0 when empty.
+     */
+    double percentile(double percent) const;
+    /**
+     * @brief Returns the largest recorded latency, in milliseconds.
+     */
+    double maximum() const { return maxUs / 1000.0; }
+    uint64_t count() const { return total; }
+    void reset();
+
+   private:
+    vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t maxUs = 0;
+};
+
+/**
+ * @brief One latency histogram per stage, fed with the times of each frame
+ * that reached a decision.
+ */
+class LatencyTracker {
+   public:
+    /**
+     * @brief Records the stage latencies of one frame.
+     */
+    void record(const FrameTimes& times);
+    const LatencyHistogram& histogram(LatencyStage stage) const {
+        return histograms[stage];
+    }
+    uint64_t frames() const { return histograms[LATENCY_END_TO_END].count(); }
+    void reset();
+
+   private:
+    LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+};
+
+/**
+ * @brief Prints p50, p95, p99 and the maximum of every stage.
+ */
+void printLatencyReport(const LatencyTracker& tracker, const char* title,
+                        ostream& out);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief The hardware events sampled by `PerfCounters`.
+ */
+enum PerfEvent {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+/**
+ * @brief A reading (or a difference of readings) of every event. Readings
+ * are raw counts, with the time the group was enabled and running; only a
+ * difference is scaled for multiplexing, by `since`.
+ */
+struct PerfSample {
+    uint64_t value[PERF_EVENT_COUNT] = {};
+    uint64_t enabled = 0;  // Time the group was enabled, in ns
+    uint64_t running = 0;  // Time the group was on the PMU, in ns
+
+    PerfSample& operator+=(const PerfSample& other) {
+        for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+            value[i] += other.value[i];
+        }
+        enabled += other.enabled;
+        running += other.running;
+        return *this;
+    }
+
+    /**
+     * @brief Returns the counts between an earlier reading and this one,
+     * extrapolated to the whole interval when the group was multiplexed
+     * during it. Scaling each reading instead would give them different
+     * ratios, and their difference could go negative.
+     */
+    PerfSample since(const PerfSample& start) const {
+        PerfSample delta;
+        delta.enabled = enabled - start.enabled;
+        delta.running = running - start.running;
+        for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+            uint64_t count =
+                value[i] > start.value[i] ? value[i] - start.value[i] : 0;
+            if (delta.running > 0 && delta.running < delta.enabled) {
+                count = static_cast<uint64_t>(static_cast<double>(count) *
+                                              delta.enabled / delta.running);
+            }
+            delta.value[i] = count;
+        }
+        return delta;
+    }
+};
+
+/**
+ * @brief This class reads the hardware performance counters of the calling
+ * thread through `perf_event_open`. The events are opened as one group so
+ * that they are scheduled together, and differences of readings are scaled
+ * when the kernel multiplexes them.
+ *
+ * When counters cannot be opened (no PMU in a container or VM,
+ * `perf_event_paranoid` too strict, non-Linux build), `available` is false,
+ * `reason` tells why and every reading is zero. Events the PMU lacks are
+ * left out individually.
+ *
+ * Work done by OpenCV's worker threads is not counted.
+ */
+class PerfCounters {
+   public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /**
+     * @brief Reads the current raw count of every event, with the enabled
+     * and running times of the group.
+     */
+    PerfSample read() const;
+
+    bool available() const { return leader >= 0; }
+    bool has(PerfEvent event) const { return slot[event] >= 0; }
+    const string& reason() const { return why; }
+
+   private:
+    int leader = -1;
+    int fds[PERF_EVENT_COUNT];
+    int slot[PERF_EVENT_COUNT];  // Position of the event in a group read
+    int opened = 0;
+    string why;
+};
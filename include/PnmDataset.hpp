@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#define PNM_PREFETCH_DEPTH 4
+
+using namespace std;
+
+/**
+ * @brief A binary PPM (P6) or PGM (P5) file mapped into memory. The image is
+ * a cv::Mat header pointing straight into the mapping: nothing is decoded or
+ * copied. The mapping is private, so writing to the image only copies the
+ * touched pages and never modifies the file.
+ *
+ * PPM samples are stored in RGB order; check `isRgb` before handing the
+ * image to code that expects BGR.
+ */
+class MappedPnm {
+   public:
+    MappedPnm() = default;
+    /**
+     * @brief Maps a file and parses its header.
+     *
+     * @param path The path of the P5 or P6 file.
+     * @throws std::runtime_error If the file cannot be mapped or is not an
+     * 8-bit binary PGM/PPM.
+     */
+    explicit MappedPnm(const string& path);
+    ~MappedPnm();
+
+    MappedPnm(MappedPnm&& other) noexcept;
+    MappedPnm& operator=(MappedPnm&& other) noexcept;
+    MappedPnm(const MappedPnm&) = delete;
+    MappedPnm& operator=(const MappedPnm&) = delete;
+
+    /**
+     * @brief Asks the kernel to read the pixel data ahead of use.
+     */
+    void prefetch() const;
+
+    const cv::Mat& image() const { return mat; }
+    const string& path() const { return filePath; }
+    bool isRgb() const { return mat.channels() == 3; }
+    bool empty() const { return mat.empty(); }
+
+   private:
+    void unmap();
+
+    string filePath;
+    void* base = nullptr;
+    size_t length = 0;
+    cv::Mat mat;
+};
+
+/**
+ * @brief A sequential sweep over a list of PGM/PPM files. While one file is
+ * being processed, the next `prefetchDepth` files are already mapped with
+ * their pages requested from the kernel, so the sweep is bound by compute
+ * rather than by I/O.
+ */
+class PnmDataset {
+   public:
+    /**
+     * @brief Builds a dataset from a directory (every *.ppm and *.pgm in it,
+     * in name order) or from a single file.
+     *
+     * @param path A directory or a file.
+     * @param prefetchDepth How many files to map ahead of the current one.
+     */
+    explicit PnmDataset(const string& path,
+                        int prefetchDepth = PNM_PREFETCH_DEPTH);
+    /**
+     * @brief Builds a dataset from an explicit list of files.
+     */
+    explicit PnmDataset(vector<string> paths,
+                        int prefetchDepth = PNM_PREFETCH_DEPTH);
+
+    /**
+     * @brief Moves to the next file of the sweep.
+     *
+     * @param image Receives the mapped file.
+     * @return bool False once every file has been returned.
+     */
+    bool next(MappedPnm& image);
+
+    size_t size() const { return paths.size(); }
+
+   private:
+    void fillAhead();
+
+    vector<string> paths;
+    size_t nextToMap = 0;
+    int prefetchDepth;
+    deque<MappedPnm> ahead;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief A horizontal run of set pixels: columns [start, end) of a row.
+ */
+struct MaskRun {
+    int row;
+    int start;
+    int end;
+};
+
+/**
+ * @brief A binary mask stored as runs of set pixels, row after row and left
+ * to right within a row.
+ *
+ * Sign masks are a few solid blobs on an empty background, so they hold
+ * far fewer runs than pixels. Areas, moments, connected components and
+ * intersections are computed from the runs, in time proportional to their
+ * number rather than to the size of the frame; `toDense` converts back for
+ * the OpenCV functions that need pixels.
+ */
+class RunMask {
+   public:
+    RunMask() = default;
+    /**
+     * @brief Starts an empty mask of the given size, to be filled from the
+     * top with `appendRow`.
+     */
+    explicit RunMask(cv::Size size);
+
+    /**
+     * @brief Encodes the pixels of an image where any of `bits` is set: a
+     * binary mask with the default, or one class straight from a class-bits
+     * image (see `ColorClassifier`).
+     *
+     * @param img The CV_8UC1 image.
+     * @param bits The bits that make a pixel part of the mask.
+     */
+    static RunMask encode(const cv::Mat& img, uint8_t bits = 0xFF);
+    /**
+     * @brief Encodes the next row of the mask, as `encode` does for each row
+     * of an image. Rows past the height of the mask are ignored.
+     *
+     * @param row The pixels of the row, as wide as the mask.
+     * @param bits The bits that make a pixel part of the mask.
+     */
+    void appendRow(const uint8_t* row, uint8_t bits = 0xFF);
+
+    /**
+     * @brief Returns the mask as a CV_8UC1 image of 0 and 255.
+     */
+    cv::Mat toDense() const;
+    /**
+     * @brief Writes the mask into a CV_8UC1 image of its size, as 0 and 255.
+     */
+    void toDense(cv::Mat& dense) const;
+
+    cv::Size size() const { return canvas; }
+    const vector<MaskRun>& runs() const { return spans; }
+    bool empty() const { return spans.empty(); }
+
+    /**
+     * @brief Returns the number of set pixels.
+     */
+    int64_t area() const;
+    /**
+     * @brief Returns the spatial moments of the set pixels, each weighing 1,
+     * as `cv::moments(mask, true)` does.
+     */
+    cv::Moments moments() const;
+
+    /**
+     * @brief Whether any set pixel lies inside a rectangle.
+     */
+    bool intersects(cv::Rect roi) const;
+    /**
+     * @brief Returns the part of the mask inside a rectangle, in the
+     * rectangle's coordinates.
+     */
+    RunMask crop(cv::Rect roi) const;
+    /**
+     * @brief Returns the pixels set in both masks, which must have the same
+     * size.
+     */
+    RunMask intersection(const RunMask& other) const;
+    /**
+     * @brief Returns the pixels set in either mask, which must have the same
+     * size.
+     */
+    RunMask unite(const RunMask& other) const;
+
+    /**
+     * @brief Labels the 4- or 8-connected components of the mask.
+     *
+     * @param labels Receives the label of each run, from 0.
+     * @param connectivity 4 or 8, as in `cv::connectedComponents`.
+     * @return int The number of components.
+     */
+    int label(vector<int>& labels, int connectivity = 8) const;
+    /**
+     * @brief Keeps the runs of the selected components.
+     *
+     * @param labels The labels returned by `label`.
+     * @param keep Whether to keep each component.
+     */
+    RunMask select(const vector<int>& labels, const vector<bool>& keep) const;
+
+   private:
+    /**
+     * @brief Returns the runs of a row, as [first, last) indexes into `spans`.
+     */
+    pair<size_t, size_t> rowRuns(int row) const {
+        return {rowStart[row], rowStart[row + 1]};
+    }
+    void indexRows();
+
+    cv::Size canvas;
+    vector<MaskRun> spans;
+    vector<size_t> rowStart;  // First run of each row, and the total at the end
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "FrameSource.hpp"
+#include "LatencyHistogram.hpp"
+
+#define SESSION_MAGIC "VISAOSES"
+#define SESSION_RECORD_MAGIC "FRAM"
+#define SESSION_VERSION 1
+#define SESSION_PNG_COMPRESSION 1
+
+using namespace std;
+
+/**
+ * @brief How the pixels of a recorded frame are stored.
+ */
+enum SessionEncoding {
+    SESSION_RAW = 0,  // The frame's bytes, row after row
+    SESSION_PNG       // Lossless PNG, smaller but slower to decode
+};
+
+/**
+ * @brief The fixed header at the start of a session file. `indexOffset` and
+ * `frames` are filled in when the recording is closed; a file whose index
+ * is missing, e.g. after a crash, is indexed by walking its records.
+ */
+struct SessionHeader {
+    char magic[8];         // SESSION_MAGIC, without the terminator
+    uint32_t version;      // SESSION_VERSION
+    uint32_t reserved;     // Zero
+    uint64_t frames;       // Frames in the index
+    uint64_t indexOffset;  // Offset of the index, 0 until closed
+};
+
+/**
+ * @brief The header of one frame record. The pixels follow it directly.
+ */
+struct SessionRecord {
+    char magic[4];        // SESSION_RECORD_MAGIC, without the terminator
+    uint32_t encoding;    // SessionEncoding
+    int32_t rows;         // Frame height
+    int32_t cols;         // Frame width
+    int32_t type;         // OpenCV type of the frame, e.g. CV_8UC3
+    uint32_t reserved;    // Zero
+    int64_t timestampNs;  // Capture time on the monotonic clock
+    uint64_t bytes;       // Size of the pixels that follow
+};
+
+/**
+ * @brief One entry of the index at the end of a session file.
+ */
+struct SessionIndexEntry {
+    uint64_t offset;      // Offset of the frame's `SessionRecord`
+    int64_t timestampNs;  // Capture time, as in the record
+};
+
+/**
+ * @brief Records timestamped frames into a session file: a fixed header,
+ * then one record per frame appended as it arrives, then an index written
+ * on close. All fields are in the byte order of the machine.
+ */
+class SessionWriter {
+   public:
+    /**
+     * @brief Creates a session file, replacing any file at that path.
+     *
+     * @param path The path of the file.
+     * @param encoding How to store the pixels of each frame.
+     * @throws std::runtime_error If the file cannot be created.
+     */
+    SessionWriter(const string& path, SessionEncoding encoding = SESSION_RAW);
+    ~SessionWriter();
+
+    SessionWriter(const SessionWriter&) = delete;
+    SessionWriter& operator=(const SessionWriter&) = delete;
+
+    /**
+     * @brief Appends a frame.
+     *
+     * @param frame The frame.
+     * @param captured The time it was captured.
+     * @throws std::runtime_error If the frame cannot be encoded or written.
+     */
+    void append(const cv::Mat& frame, LatencyClock::time_point captured);
+    /**
+     * @brief Writes the index and the final header. Called by the
+     * destructor.
+     */
+    void close();
+
+    size_t frames() const { return index.size(); }
+    uint64_t bytes() const { return offset; }
+
+   private:
+    string path;
+    SessionEncoding encoding;
+    ofstream out;
+    vector<SessionIndexEntry> index;
+    vector<uint8_t> buffer;
+    uint64_t offset = 0;
+};
+
+/**
+ * @brief Reads a session file, mapped read-only into memory: raw frames are
+ * views into the mapping that must not be modified, and stay valid as long
+ * as the reader.
+ */
+class SessionReader {
+   public:
+    /**
+     * @brief Maps a session file and loads or rebuilds its index.
+     *
+     * @param path The path of the file.
+     * @throws std::runtime_error If the file cannot be mapped or is not a
+     * session.
+     */
+    explicit SessionReader(const string& path);
+    ~SessionReader();
+
+    SessionReader(const SessionReader&) = delete;
+    SessionReader& operator=(const SessionReader&) = delete;
+
+    size_t frameCount() const { return index.size(); }
+    /**
+     * @brief Returns the capture time of a frame, in ns on the clock of the
+     * recording.
+     */
+    int64_t timestampNs(size_t i) const { return index[i].timestampNs; }
+    /**
+     * @brief Returns a frame.
+     *
+     * @param i The index of the frame.
+     * @param frame Receives a read-only view of a raw frame, or a decoded
+     * PNG frame.
+     * @return bool False when the frame cannot be decoded.
+     */
+    bool frame(size_t i, cv::Mat& frame) const;
+
+   private:
+    void rebuildIndex();
+
+    void* base = nullptr;
+    size_t length = 0;
+    vector<SessionIndexEntry> index;
+};
+
+/**
+ * @brief Replays a session as a `FrameSource`, either at the speed it was
+ * recorded or as fast as the pipeline takes the frames. At recorded speed
+ * the replay is live: frames are stamped with the time they are due and
+ * the scheduler drops those the pipeline is too slow for, as it would with
+ * the camera. As fast as possible, every frame is processed, stamped with
+ * the time it was read.
+ */
+class SessionReplay : public FrameSource {
+   public:
+    /**
+     * @brief Prepares the replay of a session.
+     *
+     * @param reader The session; it must outlive the replay.
+     * @param realtime Whether to replay at the recorded speed.
+     */
+    SessionReplay(const SessionReader& reader, bool realtime)
+        : reader(reader), realtime(realtime) {}
+
+    /**
+     * @brief Reads the next frame, waiting until it is due at recorded
+     * speed.
+     *
+     * @param frame Receives a copy of the frame; its buffer is reused when
+     * it has the frame's size and type.
+     * @param captured Receives the time the frame is replayed as captured.
+     * @return bool False after the last frame.
+     */
+    bool read(cv::Mat& frame, LatencyClock::time_point& captured) override;
+    bool live() const override { return realtime; }
+
+   private:
+    const SessionReader& reader;
+    bool realtime;
+    size_t position = 0;
+    LatencyClock::time_point start;
+};
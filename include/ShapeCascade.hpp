@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <vector>
+
+#include "RunMask.hpp"
+
+#define CASCADE_MIN_AREA 300              // Pixels
+#define CASCADE_MIN_ASPECT 0.5            // Shorter over longer box side
+#define CASCADE_MIN_CONVEXITY 0.5         // Row hull over box; any convex blob
+#define CASCADE_MIN_FILL 0.4              // Pixels over row hull
+#define CASCADE_ROUND_MIN_CONVEXITY 0.65  // Circles and octagons, any angle
+#define CASCADE_ROUND_MAX_CONVEXITY 0.92  // Above it, an upright rectangle
+#define CASCADE_SQUARE_MIN_CONVEXITY 0.7  // Squares turned up to 13 degrees
+#define CASCADE_SQUARE_MIN_BOX_AREA 1000  // As the area test of detectSquares
+#define CASCADE_CIRCLE_MIN_FILL 0.6       // As the fill test of detectCircles
+
+using namespace std;
+
+/**
+ * @brief The shape tests a blob can be routed to, as bits.
+ */
+enum ShapeRoute {
+    SHAPE_ROUTE_CIRCLE = 1 << 0,
+    SHAPE_ROUTE_OCTAGON = 1 << 1,
+    SHAPE_ROUTE_SQUARE = 1 << 2,
+};
+
+/**
+ * @brief The stages of the cascade, in the order they run. A blob is
+ * counted against the first stage that rejects it.
+ */
+enum CascadeStage {
+    CASCADE_AREA = 0,   // Too small for any sign
+    CASCADE_ASPECT,     // Too elongated
+    CASCADE_CONVEXITY,  // Outline too far from convex
+    CASCADE_FILL,       // Too sparse within its outline
+    CASCADE_UNROUTED,   // Plausible, but fits no shape test
+    CASCADE_STAGE_COUNT
+};
+
+/**
+ * @brief Returns the name of a cascade stage ("area", ...).
+ */
+const char* cascadeStageName(CascadeStage stage);
+
+/**
+ * @brief Blobs rejected by each stage of the cascade and routed to each
+ * shape test, accumulated over the frames they were passed to.
+ */
+struct CascadeCounters {
+    uint64_t blobs = 0;  // Blobs measured
+    uint64_t rejected[CASCADE_STAGE_COUNT] = {};
+    uint64_t circles = 0;
+    uint64_t octagons = 0;
+    uint64_t squares = 0;
+
+    void reset() { *this = CascadeCounters(); }
+};
+
+/**
+ * @brief Prints the blobs rejected by each stage and routed to each test.
+ */
+void printCascadeReport(const CascadeCounters& counters, ostream& out);
+
+/**
+ * @brief Features of a blob that take constant time each once its runs
+ * have been summed.
+ */
+struct BlobFeatures {
+    int64_t area = 0;      // Set pixels
+    int64_t hullArea = 0;  // Over its rows, first to last set pixel
+    cv::Rect box;
+
+    double aspect() const {
+        return static_cast<double>(min(box.width, box.height)) /
+               max(box.width, box.height);
+    }
+    double convexity() const {
+        return static_cast<double>(hullArea) / box.area();
+    }
+    double fill() const { return static_cast<double>(area) / hullArea; }
+};
+
+/**
+ * @brief This class rejects blobs that cannot be signs before the shape
+ * tests run, and routes the others to the tests that fit them.
+ *
+ * Every feature comes from the runs of the labelled mask in one pass:
+ * area, bounding box, and the row hull, which fills each row of a blob from
+ * its first to its last pixel. The row hull over the box estimates how
+ * convex the outline is, since a convex blob covers at least half of its
+ * box; the pixels over the row hull estimate how solid the blob is within
+ * it, holes included. Their product is the extent, pixels over box.
+ *
+ * An upright disc covers about 0.79 of its box and an octagon 0.83, and
+ * both stay between 0.65 and 0.92 when turned. An upright square covers
+ * all of it, falling towards 0.5 as it turns to 45 degrees.
+ */
+class ShapeCascade {
+   public:
+    /**
+     * @brief Measures the blobs of a labelled mask.
+     *
+     * @param runs The mask.
+     * @param labels The label of each run, from `RunMask::label`.
+     * @param count The number of labels.
+     * @return vector<BlobFeatures> The features of each label.
+     */
+    static vector<BlobFeatures> measure(const RunMask& runs,
+                                        const vector<int>& labels, int count);
+    /**
+     * @brief Runs a blob through the cascade.
+     *
+     * @param blob The features of the blob.
+     * @param counters When not null, the blob is counted against the stage
+     * that rejected it or the tests it was routed to.
+     * @return uint8_t The `ShapeRoute` bits of the tests the blob fits; 0
+     * when it was rejected.
+     */
+    static uint8_t route(const BlobFeatures& blob, CascadeCounters* counters);
+};
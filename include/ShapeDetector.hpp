@@ -1,17 +1,43 @@
 #pragma once
 
+#include <climits>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+#include "CircleHough.hpp"
+#include "RunMask.hpp"
+#include "ShapeCascade.hpp"
+
 #define CIRCLE_DETECTION_PARAM1 40
 #define CIRCLE_DETECTION_PARAM2 10
 #define MIN_RADIUS 30
 #define MAX_RADIUS 600
 #define OCTAGON_APPROXIMATION_PARAM 0.02
 #define OCTAGON_CIRCULARITY_THRESHOLD 0.65
+#define CIRCLE_BACKEND_DEFAULT CIRCLE_BACKEND_OPENCV
+#define SHAPE_WHOLE_IMAGE cv::Rect(0, 0, INT_MAX, INT_MAX)
+#define SHAPE_ROI_MARGIN 4  // Background kept around the candidates
+#define SQUARE_HIGHWAY_OFFSET 0.025  // Rise of the mass, in heights
 
 using namespace std;
 
+/**
+ * @brief The components of a mask that are large enough, and those routed
+ * to each shape test by the `ShapeCascade`, kept as runs. Each mask has the
+ * size of the input; each rectangle bounds the components of its mask, with
+ * a margin of `SHAPE_ROI_MARGIN`, and is empty without any. The shape tests
+ * only make an image of the part inside their rectangle.
+ */
+struct ShapeCandidateRuns {
+    RunMask mask;
+    RunMask circles;
+    RunMask octagons;
+    RunMask squares;
+    cv::Rect circleRoi;
+    cv::Rect octagonRoi;
+    cv::Rect squareRoi;
+};
+
 /**
  * @brief This class provides functionality to detect red and blue colors in a
  * given image.
@@ -22,41 +48,140 @@ class ShapeDetector {
      * @brief Removes small components from the image based on their area.
      *
      * @param img The input image.
+     * @param regions When not null, areas covering every set pixel of `img`
+     * with a margin wider than `morphSize`: the closing only runs on them.
      * @param minComponentArea The minimum area of the components to keep.
      * @param morphSize The size of the structuring element used for
      * morphological operations.
      * @return cv::Mat The image after removing small components.
      */
-    static cv::Mat removeSmallComponents(const cv::Mat& img,
-                                         double minComponentArea = 200.0,
-                                         int morphSize = 4);
+    static cv::Mat removeSmallComponents(
+        const cv::Mat& img, const vector<cv::Rect>* regions = nullptr,
+        double minComponentArea = 200.0, int morphSize = 4);
+    /**
+     * @brief Removes small components from the image, as
+     * `removeSmallComponents` does, and runs the others through the
+     * `ShapeCascade`.
+     *
+     * @param img The input image.
+     * @param regions When not null, areas covering every set pixel of `img`
+     * with a margin wider than `morphSize`: the closing only runs on them.
+     * @param counters When not null, receives the outcome of the cascade.
+     * @param minComponentArea The minimum area of the components to keep.
+     * @param morphSize The size of the structuring element used for
+     * morphological operations.
+     * @return ShapeCandidateRuns The components kept, and those routed to
+     * each shape test.
+     */
+    static ShapeCandidateRuns findCandidates(
+        const cv::Mat& img, const vector<cv::Rect>* regions = nullptr,
+        CascadeCounters* counters = nullptr, double minComponentArea = 200.0,
+        int morphSize = 4);
+    /**
+     * @brief Runs the components of a closed mask through the
+     * `ShapeCascade`, as `findCandidates` does once it has closed the image,
+     * and keeps the candidates as runs.
+     *
+     * @param runs The closed mask.
+     * @param counters When not null, receives the outcome of the cascade.
+     * @param minComponentArea The minimum area of the components to keep.
+     * @return ShapeCandidateRuns The components kept, and those routed to
+     * each shape test.
+     */
+    static ShapeCandidateRuns routeCandidates(
+        const RunMask& runs, CascadeCounters* counters = nullptr,
+        double minComponentArea = 200.0);
+    /**
+     * @brief Selects the circle detector of `detectCircles` for the whole
+     * process. Call it before detection starts.
+     *
+     * @param backend The circle detector.
+     */
+    static void setCircleBackend(CircleBackend backend);
     /**
-     * @brief Detects circles in the input image.
+     * @brief Detects circles in the input image, with the detector chosen by
+     * `setCircleBackend`.
      *
      * @param img The input image.
+     * @param roi The only part of `img` that can hold set pixels; the search
+     * is limited to it.
      * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> A vector of pairs,
      * each consisting of a circle and its centroid.
      */
     static vector<pair<cv::Vec3f, cv::Point2f>> detectCircles(
-        const cv::Mat& img);
+        const cv::Mat& img, cv::Rect roi = SHAPE_WHOLE_IMAGE);
+    /**
+     * @brief Detects circles in a mask kept as runs, as `detectCircles` does
+     * on the image of the mask. Only the part inside `roi` is made an image.
+     *
+     * @param mask The input mask.
+     * @param roi The only part of `mask` that can hold set pixels; the
+     * search is limited to it.
+     * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> A vector of
+     * pairs, each consisting of a circle and its centroid.
+     */
+    static vector<pair<cv::Vec3f, cv::Point2f>> detectCircles(
+        const RunMask& mask, cv::Rect roi = SHAPE_WHOLE_IMAGE);
 
     /**
      * @brief Detects octagons in the input image.
      *
      * @param img The input image.
      * @param minPerimeter The minimum perimeter of the octagons to detect.
+     * @param roi The only part of `img` that can hold set pixels; the search
+     * is limited to it.
+     * @return std::vector<std::vector<cv::Point>> A vector of detected
+     * octagons, each represented by a vector of its vertices.
+     */
+    static vector<vector<cv::Point>> detectOctagons(
+        const cv::Mat& img, double minPerimeter = 50.0,
+        cv::Rect roi = SHAPE_WHOLE_IMAGE);
+    /**
+     * @brief Detects octagons in a mask kept as runs, as `detectOctagons`
+     * does on the image of the mask. Only the part inside `roi` is made an
+     * image.
+     *
+     * @param mask The input mask.
+     * @param minPerimeter The minimum perimeter of the octagons to detect.
+     * @param roi The only part of `mask` that can hold set pixels; the
+     * search is limited to it.
      * @return std::vector<std::vector<cv::Point>> A vector of detected
      * octagons, each represented by a vector of its vertices.
      */
-    static vector<vector<cv::Point>> detectOctagons(const cv::Mat& img,
-                                                    double minPerimeter = 50.0);
+    static vector<vector<cv::Point>> detectOctagons(
+        const RunMask& mask, double minPerimeter = 50.0,
+        cv::Rect roi = SHAPE_WHOLE_IMAGE);
     /**
      * @brief Detects squares in the input image.
      *
      * @param img The input image.
+     * @param roi The only part of `img` that can hold set pixels; the search
+     * is limited to it.
      * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> A
-     * vector of pairs, each consisting of a square and its centroid.
+     * vector of pairs, each consisting of a square and the center of mass
+     * of the pixels inside it.
      */
     static vector<pair<vector<cv::Point>, cv::Point2f>> detectSquares(
-        const cv::Mat& img);
+        const cv::Mat& img, cv::Rect roi = SHAPE_WHOLE_IMAGE);
+    /**
+     * @brief Detects squares in a mask kept as runs, as `detectSquares` does
+     * on the image of the mask. Only the part inside `roi` is made an image.
+     *
+     * @param mask The input mask.
+     * @param roi The only part of `mask` that can hold set pixels; the
+     * search is limited to it.
+     * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> A
+     * vector of pairs, each consisting of a square and the center of mass
+     * of the pixels inside it.
+     */
+    static vector<pair<vector<cv::Point>, cv::Point2f>> detectSquares(
+        const RunMask& mask, cv::Rect roi = SHAPE_WHOLE_IMAGE);
+
+   private:
+    static RunMask closeComponents(const cv::Mat& img,
+                                   const vector<cv::Rect>* regions,
+                                   int morphSize);
+    static vector<cv::Vec3f> houghCircles(const cv::Mat& view, int minDist);
+
+    static CircleBackend circleBackend;
 };
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include "PerfCounters.hpp"
+#include "ShapeCascade.hpp"
+
+using namespace std;
+
+/**
+ * @brief The stages of the per-frame pipeline run by the `Analyser`.
+ */
+enum PipelineStage {
+    STAGE_PREPARE = 0,      // Colour conversion and equalisation
+    STAGE_CLASSIFY,         // Colour classification
+    STAGE_RED_MASK,         // Red mask extraction and denoising
+    STAGE_BLUE_MASK,        // Blue mask extraction and denoising
+    STAGE_RED_COMPONENTS,   // Small component removal on the red mask
+    STAGE_BLUE_COMPONENTS,  // Small component removal on the blue mask
+    STAGE_BLUE_CIRCLES,     // Circle detection on the blue mask
+    STAGE_RED_CIRCLES,      // Circle detection on the red mask
+    STAGE_OCTAGONS,         // Octagon detection on the red mask
+    STAGE_SQUARES,          // Square detection on the colour mask
+    STAGE_ANNOTATE,         // Handlers: drawing and reporting
+    STAGE_COUNT
+};
+
+/**
+ * @brief Returns the name of a pipeline stage ("prepare", ...).
+ */
+const char* stageName(PipelineStage stage);
+
+/**
+ * @brief Wall-clock time spent in each pipeline stage, accumulated over the
+ * frames the timings were passed to. When `perf` is set, the hardware
+ * counters of each stage are accumulated as well. The outcome of the shape
+ * cascade is counted along.
+ */
+struct StageTimings {
+    double ms[STAGE_COUNT] = {};
+    PerfSample counters[STAGE_COUNT];
+    PerfCounters* perf = nullptr;
+    uint64_t frames = 0;  // Frames accumulated
+    uint64_t pixels = 0;  // Input pixels over those frames
+    CascadeCounters cascade;
+
+    void reset() {
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            ms[stage] = 0.0;
+            counters[stage] = PerfSample();
+        }
+        frames = 0;
+        pixels = 0;
+        cascade.reset();
+    }
+
+    void addFrame(uint64_t framePixels) {
+        frames++;
+        pixels += framePixels;
+    }
+};
+
+/**
+ * @brief Prints, per stage, the mean time per frame and, when hardware
+ * counters were sampled, the IPC and the cache and branch misses per pixel,
+ * then the outcome of the shape cascade.
+ */
+void printStageReport(const StageTimings& timings, ostream& out);
+
+/**
+ * @brief Adds the lifetime of the scope to one stage of a `StageTimings`.
+ * A null `StageTimings` makes the scope a no-op.
+ */
+class StageScope {
+   public:
+    StageScope(StageTimings* timings, PipelineStage stage)
+        : timings(timings), stage(stage) {
+        if (timings != nullptr) {
+            if (timings->perf != nullptr) {
+                counters = timings->perf->read();
+            }
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    ~StageScope() {
+        if (timings != nullptr) {
+            chrono::duration<double, milli> elapsed =
+                chrono::steady_clock::now() - start;
+            timings->ms[stage] += elapsed.count();
+            if (timings->perf != nullptr) {
+                timings->counters[stage] +=
+                    timings->perf->read().since(counters);
+            }
+        }
+    }
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+   private:
+    StageTimings* timings;
+    PipelineStage stage;
+    chrono::steady_clock::time_point start;
+    PerfSample counters;
+};
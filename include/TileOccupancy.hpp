@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "ColorClassifier.hpp"
+
+#define OCCUPANCY_TILE_SIZE 32     // Pixels per tile, per axis
+#define OCCUPANCY_DENSE_RATIO 0.5  // Occupied tiles making it the whole frame
+
+using namespace std;
+
+/**
+ * @brief Counts the pixels of each colour class in every
+ * `OCCUPANCY_TILE_SIZE` square tile of a class-bits image, as it is
+ * classified.
+ *
+ * Most of a road frame holds no red or blue at all. The stages after
+ * classification only change pixels near the classified ones: the denoising
+ * morphology and the component closing reach a few pixels, far less than a
+ * tile. So they can run on the occupied tiles and the tiles around them,
+ * grouped into `regions`, and leave the rest of the frame empty; where the
+ * regions cover most of the frame, a single region is the whole frame.
+ */
+class TileOccupancy {
+   public:
+    /**
+     * @brief Clears the counts for a class-bits image of the given size.
+     */
+    void reset(cv::Size size);
+    /**
+     * @brief Adds one row of class bits to the counts. Rows are expected in
+     * order, the whole width at once.
+     *
+     * @param y The row.
+     * @param bits The class bits of the row.
+     */
+    void addRow(int y, const uint8_t* bits);
+
+    cv::Size size() const { return frame; }
+    cv::Size grid() const { return tiles; }
+    /**
+     * @brief Returns the number of pixels of a class in a tile.
+     */
+    int count(int tileX, int tileY, ColorClassId id) const {
+        return counts[(tileY * tiles.width + tileX) * COLOR_CLASS_COUNT + id];
+    }
+    /**
+     * @brief Returns the share of tiles holding a pixel of any class in
+     * `classes`, a set of class bits.
+     */
+    double occupiedRatio(uint8_t classes) const;
+    /**
+     * @brief Returns rectangles, in pixels, that together cover every pixel
+     * within one tile of a pixel of any class in `classes`: the bounding
+     * boxes of the groups of touching occupied tiles, each grown by a tile.
+     * Above `OCCUPANCY_DENSE_RATIO` it is the whole frame.
+     *
+     * @param classes A set of class bits, e.g. `1 << COLOR_RED`.
+     * @return vector<cv::Rect> The regions; empty when no pixel is of those
+     * classes.
+     */
+    vector<cv::Rect> regions(uint8_t classes) const;
+    /**
+     * @brief Returns the bounding box of a set of regions; empty without
+     * any.
+     */
+    static cv::Rect bounds(const vector<cv::Rect>& regions);
+
+   private:
+    bool holds(int tile, uint8_t classes) const;
+
+    cv::Size frame;
+    cv::Size tiles;
+    vector<int32_t> counts;  // Per tile, then per class
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+
+#define SINK_QUEUE_CAPACITY 8
+#define SINK_PRE_ROLL 30
+#define SINK_POST_ROLL 60
+#define SINK_FPS 30.0
+
+using namespace std;
+
+/**
+ * @brief What to discard when the encoder cannot keep up.
+ */
+enum SinkDropPolicy {
+    SINK_DROP_OLDEST = 0,  // Keep the newest frames
+    SINK_DROP_NEWEST       // Keep the queued frames, discard the new one
+};
+
+/**
+ * @brief Which frames the sink writes.
+ */
+enum SinkMode {
+    SINK_ALL = 0,            // Every `decimation`-th frame
+    SINK_AROUND_DETECTIONS   // Frames with detections, plus pre/post-roll
+};
+
+/**
+ * @brief Configuration of a `VideoSink`.
+ */
+struct VideoSinkConfig {
+    string path;      // Annotated frames
+    string maskPath;  // Masks; empty to skip them
+    int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    double fps = SINK_FPS;
+    // Raised to preRoll + 1 with SINK_AROUND_DETECTIONS, so that the
+    // pre-roll fits in the queue along with the detection
+    size_t queueCapacity = SINK_QUEUE_CAPACITY;
+    SinkDropPolicy dropPolicy = SINK_DROP_OLDEST;
+    SinkMode mode = SINK_ALL;
+    int decimation = 1;          // SINK_ALL: write one frame out of this many
+    int preRoll = SINK_PRE_ROLL;  // SINK_AROUND_DETECTIONS: frames before
+    int postRoll = SINK_POST_ROLL;  // SINK_AROUND_DETECTIONS: frames after
+};
+
+/**
+ * @brief Counters of a `VideoSink`.
+ */
+struct SinkStats {
+    uint64_t submitted = 0;  // Frames passed to `push`
+    uint64_t selected = 0;   // Frames chosen by the mode for writing
+    uint64_t written = 0;    // Frames handed to the encoder
+    uint64_t dropped = 0;    // Selected frames lost to a full queue
+    uint64_t failed = 0;     // Frames lost to a writer that did not open
+};
+
+/**
+ * @brief This class archives annotated frames (and optionally the masks)
+ * without slowing the detector down. Frames go through a bounded queue to a
+ * dedicated encoder thread; when the queue is full, frames are dropped
+ * according to the drop policy instead of waiting for the encoder.
+ */
+class VideoSink {
+   public:
+    /**
+     * @brief Starts the encoder thread. The writers are opened on the first
+     * frame, once the frame size is known; when one cannot be opened, the
+     * sink says so on the standard error and counts the frames it loses.
+     */
+    explicit VideoSink(VideoSinkConfig config);
+    ~VideoSink();
+
+    VideoSink(const VideoSink&) = delete;
+    VideoSink& operator=(const VideoSink&) = delete;
+
+    /**
+     * @brief Offers a frame to the sink. Never waits for the encoder.
+     *
+     * @param frame The annotated frame; copied if it is kept.
+     * @param mask The mask of the frame, or an empty Mat.
+     * @param hasDetections Whether the frame has detections, for
+     * `SINK_AROUND_DETECTIONS`.
+     */
+    void push(const cv::Mat& frame, const cv::Mat& mask, bool hasDetections);
+    /**
+     * @brief Writes the queued frames and closes the files. Called by the
+     * destructor.
+     */
+    void close();
+
+    SinkStats stats() const;
+
+   private:
+    struct Item {
+        cv::Mat frame;
+        cv::Mat mask;
+    };
+
+    void enqueue(Item item);
+    void encodeLoop();
+
+    VideoSinkConfig config;
+
+    // Owned by the caller thread
+    uint64_t frameIndex = 0;
+    int postRollLeft = 0;
+    deque<Item> preRoll;
+
+    mutable mutex lock;
+    condition_variable itemReady;
+    deque<Item> queue;
+    bool closing = false;
+    SinkStats counters;
+
+    thread worker;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+#include "TileOccupancy.hpp"
+
+#define YUV_LUT_BITS 6
+#define YUV_LUT_AMBIGUOUS 0x80
+
+using namespace std;
+
+/**
+ * @brief The raw YUV layouts accepted by the pipeline, all 8-bit BT.601 as
+ * produced by cameras and decoders.
+ */
+enum YuvFormat {
+    YUV_YUYV = 0,  // Packed 4:2:2: Y0 U Y1 V
+    YUV_NV12,      // Planar 4:2:0: Y plane, then interleaved UV
+    YUV_I420,      // Planar 4:2:0: Y plane, then U plane, then V plane
+    YUV_FORMAT_COUNT
+};
+
+/**
+ * @brief Parses a format name ("yuyv", "nv12" or "i420").
+ *
+ * @return bool False when the name is not a known format.
+ */
+bool parseYuvFormat(const string& name, YuvFormat& format);
+
+/**
+ * @brief Returns the size in bytes of one frame.
+ */
+size_t yuvFrameBytes(YuvFormat format, int width, int height);
+
+/**
+ * @brief A raw YUV frame. `data` holds the whole frame as one matrix: a
+ * height x width CV_8UC2 for YUYV, and a (height * 3 / 2) x width CV_8UC1
+ * for the 4:2:0 formats. Width and height must be even.
+ */
+struct YuvFrame {
+    YuvFormat format = YUV_I420;
+    int width = 0;
+    int height = 0;
+    cv::Mat data;
+
+    YuvFrame() = default;
+    /**
+     * @brief Wraps a buffer holding one frame, without copying it.
+     */
+    YuvFrame(YuvFormat format, int width, int height, void* buffer);
+
+    bool empty() const { return data.empty(); }
+    cv::Size size() const { return cv::Size(width, height); }
+
+    /**
+     * @brief Equalises the histogram of the Y plane in place.
+     */
+    void equalizeLuma();
+    /**
+     * @brief Converts the frame to BGR, e.g. to draw an overlay on it.
+     */
+    void toBgr(cv::Mat& bgr) const;
+};
+
+/**
+ * @brief Classifies YUV pixels against the colour class table without going
+ * through BGR or HSV images.
+ *
+ * A 64x64x64 table indexed by the top `YUV_LUT_BITS` bits of Y, U and V
+ * holds the class bits shared by every YUV value of a cell. The few cells
+ * straddling a class boundary are flagged `YUV_LUT_AMBIGUOUS`, and their
+ * pixels take the exact path: the same integer YUV to BGR conversion as
+ * `cv::cvtColor`, then `ColorClassifier::classifyBgrPixel`. The result is
+ * therefore identical to converting the frame to BGR and classifying it.
+ */
+class YuvClassifier {
+   public:
+    /**
+     * @brief Classifies one YUV pixel exactly.
+     *
+     * @return uint8_t Bit `i` is set when the pixel belongs to class `i`.
+     */
+    static uint8_t classifyPixel(uint8_t y, uint8_t u, uint8_t v);
+
+    /**
+     * @brief Classifies a frame.
+     *
+     * @param frame The YUV frame.
+     * @param step 1 for full resolution; 2 samples every other pixel and row,
+     * which for the 4:2:0 formats is the resolution of the chroma planes.
+     * @param occupancy When not null, receives the per-tile counts of each
+     * class, gathered as the rows are classified.
+     * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+     */
+    static cv::Mat classify(const YuvFrame& frame, int step = 1,
+                            TileOccupancy* occupancy = nullptr);
+
+   private:
+    /**
+     * @brief Returns the cell table, built on first use.
+     */
+    static const uint8_t* table();
+};
+
+/**
+ * @brief Reads fixed-size frames from a raw YUV file, such as one written by
+ * `ffmpeg -f rawvideo`. The file is mapped privately into memory, so frames
+ * are views into the mapping that can be modified in place without touching
+ * the file; each is valid until the next frame is read, which releases the
+ * memory its modifications took.
+ */
+class YuvReader {
+   public:
+    /**
+     * @brief Maps a raw YUV file.
+     *
+     * @param path The path of the file.
+     * @param format The layout of the frames.
+     * @param width The frame width, even.
+     * @param height The frame height, even.
+     * @throws std::runtime_error If the file cannot be mapped or the size is
+     * not valid for the format.
+     */
+    YuvReader(const string& path, YuvFormat format, int width, int height);
+    ~YuvReader();
+
+    YuvReader(const YuvReader&) = delete;
+    YuvReader& operator=(const YuvReader&) = delete;
+
+    /**
+     * @brief Returns the next frame, releasing the pages of the previous one.
+     *
+     * @param frame Receives a view of the frame, valid until the next call.
+     * @return bool False once every frame has been read.
+     */
+    bool next(YuvFrame& frame);
+
+    size_t frameCount() const { return frames; }
+
+   private:
+    YuvFormat format;
+    int width, height;
+    void* base = nullptr;
+    size_t length = 0;
+    size_t frameBytes = 0;
+    size_t frames = 0;
+    size_t position = 0;
+};
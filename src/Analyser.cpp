@@ -5,261 +5,1016 @@
  */
 #include "Analyser.hpp"
 
+/**
+ * The `equalizationLut` function computes the lookup table `cv::equalizeHist`
+ * would apply to a channel, so that the same mapping can be reused later on
+ * part of a frame.
+ *
+ * @param channel - A single 8-bit channel.
+ * @return cv::Mat The 1x256 CV_8U lookup table.
+ */
+static cv::Mat equalizationLut(const cv::Mat& channel) {
+    int histogram[256] = {};
+    for (int y = 0; y < channel.rows; y++) {
+        const uint8_t* row = channel.ptr<uint8_t>(y);
+        for (int x = 0; x < channel.cols; x++) {
+            histogram[row[x]]++;
+        }
+    }
+    return equalizationLut(histogram, channel.rows * channel.cols);
+}
+
 /**
  * The `processFrame` function performs color conversion and histogram
  * equalization on a frame.
  *
  * @param frame - A reference to a cv::Mat object representing the frame to
  * be processed.
+ * @param rgb - True when the frame is in RGB rather than BGR order.
+ * @param lut - When not null and not empty, the equalisation lookup table to
+ * apply instead of the frame's own; when not null and empty, receives the
+ * frame's table.
  */
-static inline void processFrame(cv::Mat& frame) {
+static inline void processFrame(cv::Mat& frame, bool rgb = false,
+                                cv::Mat* lut = nullptr) {
     cv::Mat hsv;
-    cv::cvtColor(frame, hsv, cv::COLOR_BGR2HSV);
+    cv::cvtColor(frame, hsv, rgb ? cv::COLOR_RGB2HSV : cv::COLOR_BGR2HSV);
 
     // Split the image into H, S, and V channels
     vector<cv::Mat> hsv_channels;
     cv::split(hsv, hsv_channels);
     // Apply histogram equalization to the V channel
-    cv::equalizeHist(hsv_channels[2], hsv_channels[2]);
+    if (lut != nullptr && !lut->empty()) {
+        cv::LUT(hsv_channels[2], *lut, hsv_channels[2]);
+    } else if (lut != nullptr) {
+        *lut = equalizationLut(hsv_channels[2]);
+        cv::LUT(hsv_channels[2], *lut, hsv_channels[2]);
+    } else {
+        cv::equalizeHist(hsv_channels[2], hsv_channels[2]);
+    }
     // Merge the H, S, and V channels back into a single image
     cv::merge(hsv_channels, hsv);
     // Convert back to BGR color space for color detection
-    cv::cvtColor(hsv, frame, cv::COLOR_HSV2BGR);
+    cv::cvtColor(hsv, frame, rgb ? cv::COLOR_HSV2RGB : cv::COLOR_HSV2BGR);
 }
 
 /**
- * The `handleBlueCircles` function processes detected blue circles, drawing
- * them on the frame, indicating their centers, and displaying a direction
- * of movement based on the circle's center of mass.
+ * The `handleBlueCircle` function processes a detected blue circle, drawing
+ * it on the frame, indicating its center, and displaying a direction of
+ * movement based on the circle's center of mass.
  *
- * @param blueCircles - A vector of pairs. Each pair contains a cv::Vec3f
- * representing the detected circle and a cv::Point2f representing the
- * center of mass of the corresponding circle.
+ * @param detection - The detected blue circle.
  * @param frame - A reference to a cv::Mat object representing the frame to
  * be modified.
  */
-static inline void handleBlueCircles(
-    const vector<pair<cv::Vec3f, cv::Point2f>>& blueCircles, cv::Mat& frame) {
-    for (const auto& bcircle : blueCircles) {
-        cv::Vec3f circle = bcircle.first;
-        cv::Point2f center_of_mass = bcircle.second;
-
-        cv::circle(
-            frame,
-            cv::Point(static_cast<int>(circle[0]), static_cast<int>(circle[1])),
-            static_cast<int>(circle[2]), cv::Scalar(0, 255, 0), 3, cv::LINE_AA);
-
-        double delta = cv::Point2f(circle[0], circle[1]).x - center_of_mass.x;
-
-        string circle_center = "(" + to_string((int)circle[0]) + ", " +
-                               to_string((int)circle[1]) + ")";
-        cv::putText(frame, circle_center,
-                    cv::Point(static_cast<int>(circle[0] - 40),
-                              static_cast<int>(circle[1] + 20)),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
-                    2);
-
-        if (center_of_mass.x > circle[0]) {
-            cv::putText(frame, "Turn Left",
-                        cv::Point(static_cast<int>(circle[0] - 40),
-                                  static_cast<int>(circle[1] - 20)),
-                        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50),
-                        2);
-
-            cout << "TurnLeft\tDetected blue circle: center: (" << circle[0]
-                 << ", " << circle[1] << "), center of Mass: ("
-                 << center_of_mass.x << ", " << center_of_mass.y
-                 << "), delta: " << delta << endl;
-        } else {
-            cv::putText(frame, "Turn Right",
-                        cv::Point(static_cast<int>(circle[0] - 40),
-                                  static_cast<int>(circle[1] - 20)),
-                        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50),
-                        2);
-
-            cout << "TurnRight\tDetected blue circle: center: (" << circle[0]
-                 << ", " << circle[1] << "), center of Mass: ("
-                 << center_of_mass.x << ", " << center_of_mass.y
-                 << "), delta: " << delta << endl;
-        }
+static inline void handleBlueCircle(const Detection& detection,
+                                    cv::Mat& frame) {
+    const cv::Point2f& center = detection.center;
+    const cv::Point2f& center_of_mass = detection.centerOfMass;
+
+    cv::circle(frame,
+               cv::Point(static_cast<int>(center.x),
+                         static_cast<int>(center.y)),
+               static_cast<int>(detection.radius), cv::Scalar(0, 255, 0), 3,
+               cv::LINE_AA);
+
+    double delta = center.x - center_of_mass.x;
+
+    string circle_center = "(" + to_string((int)center.x) + ", " +
+                           to_string((int)center.y) + ")";
+    cv::putText(frame, circle_center,
+                cv::Point(static_cast<int>(center.x - 40),
+                          static_cast<int>(center.y + 20)),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
+                2);
+
+    if (detection.direction == DIRECTION_LEFT) {
+        cv::putText(frame, "Turn Left",
+                    cv::Point(static_cast<int>(center.x - 40),
+                              static_cast<int>(center.y - 20)),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50), 2);
+
+        cout << "TurnLeft\tDetected blue circle: center: (" << center.x << ", "
+             << center.y << "), center of Mass: (" << center_of_mass.x << ", "
+             << center_of_mass.y << "), delta: " << delta << endl;
+    } else {
+        cv::putText(frame, "Turn Right",
+                    cv::Point(static_cast<int>(center.x - 40),
+                              static_cast<int>(center.y - 20)),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50), 2);
+
+        cout << "TurnRight\tDetected blue circle: center: (" << center.x
+             << ", " << center.y << "), center of Mass: (" << center_of_mass.x
+             << ", " << center_of_mass.y << "), delta: " << delta << endl;
     }
 }
 
 /**
- * The `handleRedCircles` function processes detected red circles, drawing
- * them on the frame, indicating their centers, and labeling them as
- * forbidden.
+ * The `handleRedCircle` function processes a detected red circle, drawing it
+ * on the frame, indicating its center, and labeling it as forbidden.
  *
- * @param redCircles - A vector of pairs. Each pair contains a cv::Vec3f
- * representing the detected circle and a cv::Point2f representing the
- * center of mass of the corresponding circle.
+ * @param detection - The detected red circle.
  * @param frame - A reference to a cv::Mat object representing the frame to
  * be modified.
  */
-static inline void handleRedCircles(
-    const vector<pair<cv::Vec3f, cv::Point2f>>& redCircles, cv::Mat& frame) {
-    for (const auto& rcircle : redCircles) {
-        cv::Vec3f circle = rcircle.first;
+static inline void handleRedCircle(const Detection& detection,
+                                   cv::Mat& frame) {
+    const cv::Point2f& center = detection.center;
+
+    cv::circle(frame,
+               cv::Point(static_cast<int>(center.x),
+                         static_cast<int>(center.y)),
+               static_cast<int>(detection.radius), cv::Scalar(0, 255, 0), 3,
+               cv::LINE_AA);
+
+    cout << "STOP\t\tDetected red circle: center: (" << center.x << ", "
+         << center.y << endl;
+
+    string circle_center = "(" + to_string((int)center.x) + ", " +
+                           to_string((int)center.y) + ")";
+    cv::putText(frame, circle_center,
+                cv::Point(static_cast<int>(center.x - 40),
+                          static_cast<int>(center.y + 20)),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
+                2);
+
+    cv::putText(frame, "Forbidden",
+                cv::Point(static_cast<int>(center.x - 40),
+                          static_cast<int>(center.y - 20)),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50), 2);
+}
+
+/**
+ * The `handleOctagon` function processes a detected octagon, drawing it on
+ * the frame, indicating its center, and labeling it as "Stop".
+ *
+ * @param detection - The detected octagon.
+ * @param frame - A reference to a cv::Mat object representing the frame to
+ * be modified.
+ */
+static inline void handleOctagon(const Detection& detection, cv::Mat& frame) {
+    cv::polylines(frame, detection.polygon, true, cv::Scalar(0, 255, 0), 3,
+                  cv::LINE_AA);
+
+    int cX = static_cast<int>(detection.center.x);
+    int cY = static_cast<int>(detection.center.y);
+
+    string octagon_center = "(" + to_string(cX) + ", " + to_string(cY) + ")";
+    cv::putText(frame, octagon_center, cv::Point(cX - 40, cY + 20),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);
 
-        if (circle[2] < 10 || circle[2] > 500) {
+    cv::putText(frame, "Stop", cv::Point(cX, cY), cv::FONT_HERSHEY_SIMPLEX,
+                0.5, cv::Scalar(255, 255, 255), 2);
+}
+
+/**
+ * The `handleSquare` function processes a detected square, drawing it on the
+ * frame, indicating its center, and displaying a direction of movement based
+ * on the square's center of mass.
+ *
+ * @param detection - The detected square.
+ * @param frame - A reference to a cv::Mat object representing the frame to
+ * be modified.
+ */
+static inline void handleSquare(const Detection& detection, cv::Mat& frame) {
+    const cv::Point2f& center_of_square = detection.center;
+    const cv::Point2f& center_of_mass = detection.centerOfMass;
+
+    cv::polylines(frame, detection.polygon, true, cv::Scalar(255, 0, 0), 3,
+                  cv::LINE_AA);
+
+    string square_center = "(" + to_string((int)center_of_square.x) + ", " +
+                           to_string((int)center_of_square.y) + ")";
+    cv::putText(frame, square_center,
+                cv::Point(static_cast<int>(center_of_square.x - 40),
+                          static_cast<int>(center_of_square.y + 20)),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
+                2);
+
+    double delta = center_of_mass.y - center_of_square.y;
+
+    string direction =
+        detection.direction == DIRECTION_HIGHWAY ? "Highway" : "Vram";
+
+    cout << "Square: Center of Square: (" << center_of_square.x << ", "
+         << center_of_square.y << "), Center of Mass: (" << center_of_mass.x
+         << ", " << center_of_mass.y << "), Delta: " << delta
+         << ", Direction: " << direction << endl;
+
+    cv::putText(frame, direction,
+                cv::Point(static_cast<int>(center_of_square.x),
+                          static_cast<int>(center_of_square.y - 20)),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
+                2);
+}
+
+/**
+ * The `addCircles` function turns the circles found by `ShapeDetector` into
+ * detections of the given kind.
+ *
+ * @param circles - Pairs of a circle and the center of mass of its mask.
+ * @param kind - `SIGN_BLUE_CIRCLE` or `SIGN_RED_CIRCLE`.
+ * @param detections - The detections to append to.
+ */
+static inline void addCircles(
+    const vector<pair<cv::Vec3f, cv::Point2f>>& circles, SignKind kind,
+    vector<Detection>& detections) {
+    for (const auto& candidate : circles) {
+        cv::Vec3f circle = candidate.first;
+
+        if (kind == SIGN_RED_CIRCLE && (circle[2] < 10 || circle[2] > 500)) {
             continue;
         }
 
-        cv::circle(
-            frame,
-            cv::Point(static_cast<int>(circle[0]), static_cast<int>(circle[1])),
-            static_cast<int>(circle[2]), cv::Scalar(0, 255, 0), 3, cv::LINE_AA);
-
-        cout << "STOP\t\tDetected red circle: center: (" << circle[0] << ", "
-             << circle[1] << endl;
-
-        string circle_center = "(" + to_string((int)circle[0]) + ", " +
-                               to_string((int)circle[1]) + ")";
-        cv::putText(frame, circle_center,
-                    cv::Point(static_cast<int>(circle[0] - 40),
-                              static_cast<int>(circle[1] + 20)),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
-                    2);
-
-        cv::putText(frame, "Forbidden",
-                    cv::Point(static_cast<int>(circle[0] - 40),
-                              static_cast<int>(circle[1] - 20)),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(40, 255, 50), 2);
+        Detection detection;
+        detection.kind = kind;
+        detection.center = cv::Point2f(circle[0], circle[1]);
+        detection.radius = circle[2];
+        detection.centerOfMass = candidate.second;
+        if (kind == SIGN_BLUE_CIRCLE) {
+            // The arrow shifts the mass towards the side it points to
+            detection.direction = candidate.second.x > circle[0]
+                                      ? DIRECTION_LEFT
+                                      : DIRECTION_RIGHT;
+        }
+        detections.push_back(detection);
     }
 }
 
 /**
- * The `handleOctagons` function processes detected octagons, drawing them
- * on the frame, indicating their centers, and labeling them as "Stop".
+ * The `addOctagons` function turns the octagons found by `ShapeDetector`
+ * into detections.
  *
- * @param octagons - A vector of cv::Point vectors, each representing an
- * octagon.
- * @param frame - A reference to a cv::Mat object representing the frame to
- * be modified.
+ * @param octagons - The vertices of each octagon.
+ * @param detections - The detections to append to.
  */
-static inline void handleOctagons(const vector<vector<cv::Point>>& octagons,
-                                  cv::Mat& frame) {
+static inline void addOctagons(const vector<vector<cv::Point>>& octagons,
+                               vector<Detection>& detections) {
     for (const auto& octagon : octagons) {
-        cv::polylines(frame, octagon, true, cv::Scalar(0, 255, 0), 3,
-                      cv::LINE_AA);
-
         // Calculate the center of the contour
         cv::Moments M = cv::moments(octagon);
-        int cX = static_cast<int>(M.m10 / M.m00);
-        int cY = static_cast<int>(M.m01 / M.m00);
 
-        string octagon_center =
-            "(" + to_string(cX) + ", " + to_string(cY) + ")";
-        cv::putText(frame, octagon_center, cv::Point(cX - 40, cY + 20),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255),
-                    2);
-
-        cv::putText(frame, "Stop", cv::Point(cX, cY), cv::FONT_HERSHEY_SIMPLEX,
-                    0.5, cv::Scalar(255, 255, 255), 2);
+        Detection detection;
+        detection.kind = SIGN_OCTAGON;
+        detection.center = cv::Point2f(static_cast<float>(M.m10 / M.m00),
+                                       static_cast<float>(M.m01 / M.m00));
+        detection.centerOfMass = detection.center;
+        detection.polygon = octagon;
+        detections.push_back(detection);
     }
 }
 
 /**
- * The `handleSquares` function processes detected squares, drawing them on
- * the frame, indicating their centers, and displaying a direction of
- * movement based on the square's center of mass.
+ * The `addSquares` function turns the squares found by `ShapeDetector` into
+ * detections, reading the direction from the vertical offset of the center
+ * of mass. The road of the highway sign widens downwards, which lifts the
+ * mass by about 5% of the height; the car sign is about balanced.
  *
- * @param squares - A vector of pairs. Each pair contains a vector of
- * cv::Point objects representing the square and a cv::Point2f representing
- * the center of mass of the corresponding square.
- * @param frame - A reference to a cv::Mat object representing the frame to
- * be modified.
+ * @param squares - Pairs of a square and the center of mass of the mask
+ * inside it.
+ * @param detections - The detections to append to.
  */
-static inline void handleSquares(
+static inline void addSquares(
     const vector<pair<vector<cv::Point>, cv::Point2f>>& squares,
-    cv::Mat& frame) {
+    vector<Detection>& detections) {
     for (const auto& square : squares) {
-        vector<cv::Point> contour = square.first;
-        cv::Point2f center_of_mass = square.second;
-
-        cv::Rect boundingRect = cv::boundingRect(contour);
-        cv::Point2f center_of_square =
-            (boundingRect.br() + boundingRect.tl()) * 0.5;
-
-        cv::polylines(frame, contour, true, cv::Scalar(255, 0, 0), 3,
-                      cv::LINE_AA);
-
-        string square_center = "(" + to_string((int)center_of_square.x) + ", " +
-                               to_string((int)center_of_square.y) + ")";
-        cv::putText(frame, square_center,
-                    cv::Point(static_cast<int>(center_of_square.x - 40),
-                              static_cast<int>(center_of_square.y + 20)),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
-                    2);
-
-        double delta = center_of_mass.y - center_of_square.y;
-
-        string direction;
-        if (delta < 0) {
-            direction = "Highway";
-        } else {
-            direction = "Vram";
+        cv::Rect boundingRect = cv::boundingRect(square.first);
+
+        Detection detection;
+        detection.kind = SIGN_SQUARE;
+        detection.center = (boundingRect.br() + boundingRect.tl()) * 0.5;
+        detection.centerOfMass = square.second;
+        detection.polygon = square.first;
+        detection.direction = detection.center.y - square.second.y >
+                                      SQUARE_HIGHWAY_OFFSET *
+                                          boundingRect.height
+                                  ? DIRECTION_HIGHWAY
+                                  : DIRECTION_CAR;
+        detections.push_back(detection);
+    }
+}
+
+/**
+ * The `scaleDetections` function maps detections found on a downscaled
+ * frame back to full-frame coordinates.
+ *
+ * @param detections - The detections to scale in place.
+ * @param scale - The factor from the detection frame to the output frame.
+ */
+static inline void scaleDetections(vector<Detection>& detections,
+                                   float scale) {
+    for (auto& detection : detections) {
+        detection.center *= scale;
+        detection.centerOfMass *= scale;
+        detection.radius *= scale;
+        for (auto& point : detection.polygon) {
+            point *= scale;
         }
+    }
+}
 
-        cout << "Square: Center of Square: (" << center_of_square.x << ", "
-             << center_of_square.y << "), Center of Mass: (" << center_of_mass.x
-             << ", " << center_of_mass.y << "), Delta: " << delta
-             << ", Direction: " << direction << endl;
+/**
+ * The `prepareFrame` function performs color conversion and histogram
+ * equalization on a frame.
+ *
+ * @param frame - The frame to equalise in place.
+ * @param rgb - True when the frame is in RGB rather than BGR order.
+ */
+void Analyser::prepareFrame(cv::Mat& frame, bool rgb) {
+    processFrame(frame, rgb);
+}
 
-        cv::putText(frame, direction,
-                    cv::Point(static_cast<int>(center_of_square.x),
-                              static_cast<int>(center_of_square.y - 20)),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00, 0x00, 0x00),
-                    2);
+/**
+ * The `extractMasks` function extracts the denoised red and blue masks from
+ * a class-bits image.
+ *
+ * @param classBits - The class bits of the frame.
+ * @param occupancy - The tile counts of the class bits, limiting the
+ * denoising to the occupied regions.
+ * @param redMask - Receives the red mask.
+ * @param blueMask - Receives the blue mask.
+ * @param timings - When not null, the time of each stage is added to it.
+ */
+static void extractMasks(const cv::Mat& classBits,
+                         const TileOccupancy& occupancy, cv::Mat& redMask,
+                         cv::Mat& blueMask, StageTimings* timings) {
+    {
+        StageScope scope(timings, STAGE_RED_MASK);
+        redMask = ColorDetector::detect(classBits, COLOR_RED, &occupancy);
+    }
+    {
+        StageScope scope(timings, STAGE_BLUE_MASK);
+        blueMask = ColorDetector::detect(classBits, COLOR_BLUE, &occupancy);
     }
 }
 
 /**
- * The `processVideo` function reads frames from a video source, performs
- * color and shape detection, and processes each frame accordingly.
+ * The `detectMasks` function classifies a prepared frame and extracts the
+ * denoised red and blue masks.
  *
- * @param cap - A reference to a cv::VideoCapture object representing the
- * video source.
+ * @param work - The prepared frame.
+ * @param rgb - True when the frame is in RGB rather than BGR order.
+ * @param redMask - Receives the red mask.
+ * @param blueMask - Receives the blue mask.
+ * @param occupancy - Receives the tile counts of the colour classes.
+ * @param timings - When not null, the time of each stage is added to it.
  */
-void Analyser::processVideo(cv::VideoCapture& cap) {
-    cv::Mat frame;
+static void detectMasks(const cv::Mat& work, bool rgb, cv::Mat& redMask,
+                        cv::Mat& blueMask, TileOccupancy& occupancy,
+                        StageTimings* timings) {
+    cv::Mat classBits;
+    {
+        // Classify all colour classes in a single pass over the frame,
+        // counting the occupied tiles on the way
+        StageScope scope(timings, STAGE_CLASSIFY);
+        classBits = ColorDetector::classify(
+            work, rgb ? cv::COLOR_RGB2HSV : cv::COLOR_BGR2HSV, &occupancy);
+    }
+    extractMasks(classBits, occupancy, redMask, blueMask, timings);
+}
 
-    while (cap.read(frame)) {
-        processFrame(frame);
-        cv::Mat redMask = ColorDetector::detectRed(frame);
-        cv::Mat blueMask = ColorDetector::detectBlue(frame);
+/**
+ * The `detectFromMasks` function removes small components from the colour
+ * masks, runs the others through the shape cascade and each shape detector
+ * on the components routed to it. The candidates stay as runs, made an
+ * image only inside the bounds each detector searches; the combined mask
+ * is the one image of the frame's size.
+ *
+ * @param redMask - The denoised red mask.
+ * @param blueMask - The denoised blue mask.
+ * @param colorMask - Receives the combined red and blue mask.
+ * @param occupancy - When not null, the tile counts the masks were extracted
+ * with: the component removal is limited to the regions holding its colour.
+ * @param timings - When not null, the time of each stage and the outcome of
+ * the cascade are added to it.
+ * @return vector<Detection> The detections, in mask coordinates.
+ */
+static vector<Detection> detectFromMasks(const cv::Mat& redMask,
+                                         const cv::Mat& blueMask,
+                                         cv::Mat& colorMask,
+                                         const TileOccupancy* occupancy,
+                                         StageTimings* timings) {
+    vector<Detection> detections;
+
+    // The regions have a tile of margin around every classified pixel,
+    // which covers what the denoising and the closing can add
+    vector<cv::Rect> redRegions, blueRegions;
+    const vector<cv::Rect>* redIn = nullptr;
+    const vector<cv::Rect>* blueIn = nullptr;
+    if (occupancy != nullptr) {
+        redRegions = occupancy->regions(1 << COLOR_RED);
+        blueRegions = occupancy->regions(1 << COLOR_BLUE);
+        redIn = &redRegions;
+        blueIn = &blueRegions;
+    }
+    CascadeCounters* cascade = timings != nullptr ? &timings->cascade : nullptr;
 
-        redMask = ShapeDetector::removeSmallComponents(redMask);
-        blueMask = ShapeDetector::removeSmallComponents(blueMask);
-        cv::Mat colorMask = redMask | blueMask;
+    ShapeCandidateRuns red, blue;
+    {
+        StageScope scope(timings, STAGE_RED_COMPONENTS);
+        red = ShapeDetector::findCandidates(redMask, redIn, cascade);
+    }
+    {
+        StageScope scope(timings, STAGE_BLUE_COMPONENTS);
+        blue = ShapeDetector::findCandidates(blueMask, blueIn, cascade);
+    }
+    colorMask = red.mask.unite(blue.mask).toDense();
 
+    {
         // Send blue mask to detect circles, and mass center
-        vector<pair<cv::Vec3f, cv::Point2f>> blueCircles =
-            ShapeDetector::detectCircles(blueMask);
+        StageScope scope(timings, STAGE_BLUE_CIRCLES);
+        addCircles(ShapeDetector::detectCircles(blue.circles, blue.circleRoi),
+                   SIGN_BLUE_CIRCLE, detections);
+    }
+    {
         // Send red mask to detect circles, and mass center
-        vector<pair<cv::Vec3f, cv::Point2f>> redCircles =
-            ShapeDetector::detectCircles(redMask);
+        StageScope scope(timings, STAGE_RED_CIRCLES);
+        addCircles(ShapeDetector::detectCircles(red.circles, red.circleRoi),
+                   SIGN_RED_CIRCLE, detections);
+    }
+    {
         // Send red mask to detect octagons
-        vector<vector<cv::Point>> octagons =
-            ShapeDetector::detectOctagons(redMask);
+        StageScope scope(timings, STAGE_OCTAGONS);
+        addOctagons(ShapeDetector::detectOctagons(red.octagons, 50.0,
+                                                  red.octagonRoi),
+                    detections);
+    }
+    {
         // Send color mask to detect squares
-        vector<pair<vector<cv::Point>, cv::Point2f>> squares =
-            ShapeDetector::detectSquares(colorMask);
+        StageScope scope(timings, STAGE_SQUARES);
+        cv::Rect squareRoi =
+            TileOccupancy::bounds({red.squareRoi, blue.squareRoi});
+        addSquares(ShapeDetector::detectSquares(
+                       red.squares.unite(blue.squares), squareRoi),
+                   detections);
+    }
+
+    return detections;
+}
+
+/**
+ * The `detect` function runs color and shape detection on a frame at the
+ * given quality level.
+ *
+ * @param frame - The frame to analyse. At full quality it is equalised in
+ * place, as the annotations are drawn over the equalised image.
+ * @param colorMask - Receives the combined red and blue mask.
+ * @param level - The quality level, e.g. as chosen by a `FrameScheduler`.
+ * @param rgb - True when the frame is in RGB rather than BGR order.
+ * @param timings - When not null, the time of each stage is added to it.
+ * @return vector<Detection> The detections, in frame coordinates.
+ */
+vector<Detection> Analyser::detect(cv::Mat& frame, cv::Mat& colorMask,
+                                   QualityLevel level, bool rgb,
+                                   StageTimings* timings) {
+    cv::Mat work = frame;
+    cv::Mat redMask, blueMask;
+    if (timings != nullptr) {
+        timings->addFrame(frame.total());
+    }
+
+    {
+        StageScope scope(timings, STAGE_PREPARE);
+        if (level >= QUALITY_HALF_RESOLUTION) {
+            cv::pyrDown(frame, work);
+        }
+        if (level < QUALITY_NO_EQUALIZE) {
+            processFrame(work, rgb);
+        }
+    }
+
+    TileOccupancy occupancy;
+    detectMasks(work, rgb, redMask, blueMask, occupancy, timings);
+    vector<Detection> detections =
+        detectFromMasks(redMask, blueMask, colorMask, &occupancy, timings);
+
+    if (level >= QUALITY_HALF_RESOLUTION) {
+        scaleDetections(detections, 2.0f);
+    }
+
+    return detections;
+}
+
+/**
+ * The `detectStreaming` function runs color and shape detection on a frame
+ * without any intermediate image of the frame's size. The pixel stages run
+ * over bands of rows through the `BandPipeline`, which hands over the masks
+ * as runs; the components and the shape cascade work on the runs, and each
+ * shape test only makes an image of its candidates, within their bounds.
+ * The detections are those of `detect` at full quality, or without
+ * equalisation when `equalize` is false; no combined mask is made.
+ *
+ * @param frame - The BGR frame to analyse; it is not modified.
+ * @param pipeline - The band buffers, reused from frame to frame.
+ * @param equalize - Whether to equalise the frame (see `QualityLevel`).
+ * @param rgb - True when the frame is in RGB rather than BGR order.
+ * @param timings - When not null, the time of each stage is added to it.
+ * @return vector<Detection> The detections, in frame coordinates.
+ */
+vector<Detection> Analyser::detectStreaming(const cv::Mat& frame,
+                                            BandPipeline& pipeline,
+                                            bool equalize, bool rgb,
+                                            StageTimings* timings) {
+    vector<Detection> detections;
+    if (timings != nullptr) {
+        timings->addFrame(frame.total());
+    }
+
+    RunMask redMask, blueMask;
+    pipeline.run(frame, redMask, blueMask, equalize, rgb, timings);
+
+    CascadeCounters* cascade = timings != nullptr ? &timings->cascade : nullptr;
+    ShapeCandidateRuns red, blue;
+    {
+        StageScope scope(timings, STAGE_RED_COMPONENTS);
+        red = ShapeDetector::routeCandidates(redMask, cascade);
+    }
+    {
+        StageScope scope(timings, STAGE_BLUE_COMPONENTS);
+        blue = ShapeDetector::routeCandidates(blueMask, cascade);
+    }
+
+    {
+        StageScope scope(timings, STAGE_BLUE_CIRCLES);
+        addCircles(ShapeDetector::detectCircles(blue.circles, blue.circleRoi),
+                   SIGN_BLUE_CIRCLE, detections);
+    }
+    {
+        StageScope scope(timings, STAGE_RED_CIRCLES);
+        addCircles(ShapeDetector::detectCircles(red.circles, red.circleRoi),
+                   SIGN_RED_CIRCLE, detections);
+    }
+    {
+        StageScope scope(timings, STAGE_OCTAGONS);
+        addOctagons(ShapeDetector::detectOctagons(red.octagons, 50.0,
+                                                  red.octagonRoi),
+                    detections);
+    }
+    {
+        StageScope scope(timings, STAGE_SQUARES);
+        cv::Rect squareRoi =
+            TileOccupancy::bounds({red.squareRoi, blue.squareRoi});
+        addSquares(ShapeDetector::detectSquares(
+                       red.squares.unite(blue.squares), squareRoi),
+                   detections);
+    }
 
-        handleBlueCircles(blueCircles, frame);
-        handleRedCircles(redCircles, frame);
-        handleOctagons(octagons, frame);
-        handleSquares(squares, frame);
+    return detections;
+}
+
+/**
+ * The `detectYuv` function runs color and shape detection on a raw YUV
+ * frame. Colours are classified straight from YUV and the equalisation is
+ * applied to the Y plane, so no BGR or HSV image is produced. At half
+ * resolution every other pixel and row is classified, which for the 4:2:0
+ * formats matches the chroma planes.
+ *
+ * @param frame - The frame to analyse. At full quality its Y plane is
+ * equalised in place.
+ * @param colorMask - Receives the combined red and blue mask.
+ * @param level - The quality level, e.g. as chosen by a `FrameScheduler`.
+ * @param timings - When not null, the time of each stage is added to it.
+ * @return vector<Detection> The detections, in frame coordinates.
+ */
+vector<Detection> Analyser::detectYuv(YuvFrame& frame, cv::Mat& colorMask,
+                                      QualityLevel level,
+                                      StageTimings* timings) {
+    int step = level >= QUALITY_HALF_RESOLUTION ? 2 : 1;
+    cv::Mat classBits, redMask, blueMask;
+    TileOccupancy occupancy;
+    if (timings != nullptr) {
+        timings->addFrame(static_cast<uint64_t>(frame.width) * frame.height);
+    }
 
+    {
+        StageScope scope(timings, STAGE_PREPARE);
+        if (level < QUALITY_NO_EQUALIZE) {
+            frame.equalizeLuma();
+        }
+    }
+    {
+        StageScope scope(timings, STAGE_CLASSIFY);
+        classBits = YuvClassifier::classify(frame, step, &occupancy);
+    }
+
+    extractMasks(classBits, occupancy, redMask, blueMask, timings);
+    vector<Detection> detections =
+        detectFromMasks(redMask, blueMask, colorMask, &occupancy, timings);
+
+    if (step > 1) {
+        scaleDetections(detections, static_cast<float>(step));
+    }
+
+    return detections;
+}
+
+/**
+ * The `detectIncremental` function runs detection only on what changed
+ * since the previous frame. Unchanged frames reuse the previous detections.
+ * For partially changed frames, the frame preparation, colour classification
+ * and mask denoising run on the dirty area padded by twice the reach of the
+ * morphology, reusing the equalisation table of the last full frame, and
+ * rewrite the masks over the dirty area padded by that reach, so that they
+ * match a full recompute; the component and shape stages then run on the
+ * updated masks. The equalisation works on a copy, so the frame is left as
+ * it was captured whatever the kind of change: equalising it in place would
+ * leave unchanged frames and the area outside the dirty region unequalised.
+ *
+ * @param frame - The BGR frame to analyse; it is not modified.
+ * @param colorMask - Receives the combined red and blue mask.
+ * @param state - The change detector and the results of previous frames.
+ * @param equalize - Whether to equalise the frame (see `QualityLevel`).
+ * @param timings - When not null, the time of each stage is added to it.
+ * @return vector<Detection> The detections, in frame coordinates.
+ */
+vector<Detection> Analyser::detectIncremental(const cv::Mat& frame,
+                                              cv::Mat& colorMask,
+                                              IncrementalState& state,
+                                              bool equalize,
+                                              StageTimings* timings) {
+    ChangeResult change = state.changes.update(frame);
+    if (timings != nullptr) {
+        timings->addFrame(frame.total());
+    }
+    if (state.redMask.size() != frame.size() || state.equalized != equalize) {
+        change.kind = CHANGE_FULL;
+    }
+
+    if (change.kind == CHANGE_NONE) {
+        colorMask = state.colorMask;
+        return state.detections;
+    }
+
+    // The tile counts cover the whole masks only after a full refresh
+    TileOccupancy occupancy;
+    const TileOccupancy* wholeFrame = nullptr;
+    if (change.kind == CHANGE_FULL) {
+        cv::Mat work = frame;
+        {
+            StageScope scope(timings, STAGE_PREPARE);
+            state.equalizationLut.release();
+            if (equalize) {
+                work = frame.clone();
+                processFrame(work, false, &state.equalizationLut);
+            }
+        }
+        detectMasks(work, false, state.redMask, state.blueMask, occupancy,
+                    timings);
+        wholeFrame = &occupancy;
+    } else {
+        // Mask pixels within CHANGE_HALO of the dirty area see the change, so
+        // they are rewritten too; they in turn read input up to CHANGE_HALO
+        // further out
+        cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+        cv::Rect affected(change.dirty.x - CHANGE_HALO,
+                          change.dirty.y - CHANGE_HALO,
+                          change.dirty.width + 2 * CHANGE_HALO,
+                          change.dirty.height + 2 * CHANGE_HALO);
+        affected &= frameRect;
+        cv::Rect region(change.dirty.x - 2 * CHANGE_HALO,
+                        change.dirty.y - 2 * CHANGE_HALO,
+                        change.dirty.width + 4 * CHANGE_HALO,
+                        change.dirty.height + 4 * CHANGE_HALO);
+        region &= frameRect;
+
+        cv::Mat work = frame(region);
+        {
+            StageScope scope(timings, STAGE_PREPARE);
+            if (equalize) {
+                work = work.clone();
+                processFrame(work, false, &state.equalizationLut);
+            }
+        }
+        cv::Mat redMask, blueMask;
+        detectMasks(work, false, redMask, blueMask, occupancy, timings);
+
+        // The affected area is exact, as it lies at least CHANGE_HALO inside
+        // the region or on the frame border; outside it nothing changed
+        cv::Rect inner = affected - region.tl();
+        redMask(inner).copyTo(state.redMask(affected));
+        blueMask(inner).copyTo(state.blueMask(affected));
+    }
+    state.equalized = equalize;
+
+    state.detections = detectFromMasks(state.redMask, state.blueMask, colorMask,
+                                       wholeFrame, timings);
+    state.colorMask = colorMask;
+
+    return state.detections;
+}
+
+/**
+ * The `annotate` function draws the detections on the frame and reports
+ * them on the standard output.
+ *
+ * @param detections - The detections of the frame.
+ * @param frame - The frame to draw on.
+ */
+void Analyser::annotate(const vector<Detection>& detections, cv::Mat& frame) {
+    for (const auto& detection : detections) {
+        switch (detection.kind) {
+            case SIGN_BLUE_CIRCLE:
+                handleBlueCircle(detection, frame);
+                break;
+            case SIGN_RED_CIRCLE:
+                handleRedCircle(detection, frame);
+                break;
+            case SIGN_OCTAGON:
+                handleOctagon(detection, frame);
+                break;
+            case SIGN_SQUARE:
+                handleSquare(detection, frame);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * The `processVideo` function reads frames from a video source, performs
+ * color and shape detection, and processes each frame accordingly. Frames
+ * are taken from a `FrameScheduler`, so the newest frame is always the one
+ * processed and quality degrades when the frame budget is missed. The
+ * latency from capture to the reported decision is tracked per frame and
+ * its percentiles are printed every `LATENCY_REPORT_SECONDS` and at exit.
+ * Each decision is also published to the detection ring, when one is set.
+ *
+ * @param source - The video source: a camera or a recorded session.
+ * @param options - The frame budget, change gating and output options.
+ */
+void Analyser::processVideo(FrameSource& source, const VideoOptions& options) {
+    FrameScheduler scheduler(source, options.frameBudgetMs);
+    IncrementalState state(options.changeThreshold, options.refreshInterval);
+    vector<Detection> detections;
+    cv::Mat frame, colorMask;
+
+    unique_ptr<PerfCounters> perf;
+    StageTimings profile;
+    StageTimings* timings = nullptr;
+    if (options.profile) {
+        perf = make_unique<PerfCounters>();
+        profile.perf = perf.get();
+        timings = &profile;
+    }
+
+    // The window is printed and cleared periodically, the total at exit
+    LatencyTracker latencyWindow, latencyTotal;
+    LatencyClock::time_point lastLatencyReport = LatencyClock::now();
+    FrameTimes times;
+    auto runStart = chrono::steady_clock::now();
+    uint64_t frameNumber = 0;
+
+    while (scheduler.next(frame, &times)) {
+        frameNumber++;
+        bool detected = scheduler.shouldDetect();
+        if (detected) {
+            auto start = chrono::steady_clock::now();
+            QualityLevel level = scheduler.level();
+            if (level < QUALITY_HALF_RESOLUTION) {
+                detections =
+                    detectIncremental(frame, colorMask, state,
+                                      level < QUALITY_NO_EQUALIZE, timings);
+            } else {
+                // The change state is kept at full resolution only
+                state.changes.invalidate();
+                detections = detect(frame, colorMask, level, false, timings);
+            }
+            times.detected = LatencyClock::now();
+            for (Detection& detection : detections) {
+                detection.captured = times.captured;
+            }
+            chrono::duration<double, milli> elapsed = times.detected - start;
+            scheduler.report(elapsed.count());
+        }
+        // Skipped frames are annotated with the previous detections
+        {
+            StageScope scope(timings, STAGE_ANNOTATE);
+            annotate(detections, frame);
+        }
+
+        // Only frames that ran detection reach a new decision
+        if (detected) {
+            if (options.ring != nullptr) {
+                options.ring->publish(frameNumber, times.captured, frame.size(),
+                                      detections, colorMask);
+            }
+            times.emitted = LatencyClock::now();
+            latencyWindow.record(times);
+            latencyTotal.record(times);
+            chrono::duration<double> sinceReport =
+                times.emitted - lastLatencyReport;
+            if (sinceReport.count() >= LATENCY_REPORT_SECONDS) {
+                printLatencyReport(latencyWindow, "Recent", cout);
+                latencyWindow.reset();
+                lastLatencyReport = times.emitted;
+            }
+        }
+
+        if (options.sink != nullptr) {
+            options.sink->push(frame, colorMask, !detections.empty());
+        }
+
+        if (!options.display) {
+            continue;
+        }
         cv::imshow("binary", colorMask);
         cv::imshow("Analyser", frame);
 
-        int key = cv::waitKey(30);
+        // The scheduler paces the loop; only poll the keyboard here
+        int key = cv::waitKey(1);
         if (key == 'x' || key == 'X') {
             cout << "Exiting program..." << endl;
             break;
         }
     }
 
+    scheduler.stop();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - runStart;
+    SchedulerStats stats = scheduler.stats();
+    cout << "Video: " << stats.processed << " frames in " << elapsed.count()
+         << " s (" << stats.processed / max(elapsed.count(), 1e-9)
+         << " frames/s)" << endl;
+    cout << "Scheduler: captured " << stats.captured << ", processed "
+         << stats.processed << ", dropped " << stats.dropped << ", skipped "
+         << stats.skipped << ", over budget " << stats.overBudget
+         << ", degradations " << stats.degradations << ", recoveries "
+         << stats.recoveries << ", final level " << stats.level << endl;
+    cout << "Changes: static " << state.changes.staticFrames << ", partial "
+         << state.changes.partialFrames << ", full "
+         << state.changes.fullFrames << endl;
+    if (options.sink != nullptr) {
+        options.sink->close();
+        SinkStats sinkStats = options.sink->stats();
+        cout << "Output: submitted " << sinkStats.submitted << ", selected "
+             << sinkStats.selected << ", written " << sinkStats.written
+             << ", dropped " << sinkStats.dropped << ", failed "
+             << sinkStats.failed << endl;
+    }
+    if (options.ring != nullptr) {
+        cout << "Ring: published " << options.ring->published() << endl;
+    }
+    printLatencyReport(latencyTotal, "Total", cout);
+    if (timings != nullptr) {
+        printStageReport(*timings, cout);
+    }
+
     cv::destroyAllWindows();
 }
+
+/**
+ * The `recordSession` function records the frames of a video source, with
+ * their capture times, into a session file for later replay with
+ * `processVideo`. Frames are written as they are read, without any
+ * detection, so that the recording keeps the source's own frame rate.
+ *
+ * @param source - The video source.
+ * @param writer - The session file.
+ * @param display - Whether to show the frames being recorded.
+ */
+void Analyser::recordSession(FrameSource& source, SessionWriter& writer,
+                             bool display) {
+    cv::Mat frame;
+    LatencyClock::time_point captured;
+    auto start = chrono::steady_clock::now();
+
+    while (source.read(frame, captured)) {
+        writer.append(frame, captured);
+
+        if (display) {
+            cv::imshow("Recording", frame);
+            int key = cv::waitKey(1);
+            if (key == 'x' || key == 'X') {
+                break;
+            }
+        }
+    }
+    writer.close();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Recorded: " << writer.frames() << " frames in "
+         << elapsed.count() << " s, " << writer.bytes() / (1024.0 * 1024.0)
+         << " MiB" << endl;
+    if (display) {
+        cv::destroyAllWindows();
+    }
+}
+
+/**
+ * The `processDataset` function runs detection over every image of a
+ * dataset without opening any window, and reports the throughput. Images
+ * are memory-mapped, so the sweep is bound by the detector and not by
+ * image decoding.
+ *
+ * @param dataset - The dataset to sweep.
+ * @param profile - Whether to report per-stage timings and hardware
+ * counters.
+ * @param stream - Whether to detect through `detectStreaming`, reporting
+ * its working set at the end.
+ */
+void Analyser::processDataset(PnmDataset& dataset, bool profile,
+                              bool stream) {
+    cv::Mat colorMask;
+    MappedPnm image;
+    BandPipeline pipeline;
+    size_t count = 0;
+
+    unique_ptr<PerfCounters> perf;
+    StageTimings stageTimings;
+    StageTimings* timings = nullptr;
+    if (profile) {
+        perf = make_unique<PerfCounters>();
+        stageTimings.perf = perf.get();
+        timings = &stageTimings;
+    }
+
+    auto start = chrono::steady_clock::now();
+    while (dataset.next(image)) {
+        cv::Mat frame = image.image();
+        bool rgb = image.isRgb();
+        if (frame.channels() == 1) {
+            cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
+        }
+
+        vector<Detection> detections =
+            stream ? detectStreaming(frame, pipeline, true, rgb, timings)
+                   : detect(frame, colorMask, QUALITY_FULL, rgb, timings);
+        {
+            StageScope scope(timings, STAGE_ANNOTATE);
+            annotate(detections, frame);
+        }
+        count++;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Dataset: " << count << " images in " << elapsed.count()
+         << " s (" << count / max(elapsed.count(), 1e-9) << " images/s)"
+         << endl;
+    if (stream) {
+        cout << "Streaming working set: "
+             << pipeline.workingSetBytes() / 1024.0 << " KiB" << endl;
+    }
+    if (timings != nullptr) {
+        printStageReport(*timings, cout);
+    }
+}
+
+/**
+ * The `processYuv` function runs detection over every frame of a raw YUV
+ * file and reports the throughput. Frames are converted to BGR only when
+ * the overlay is shown; otherwise the whole pipeline runs on the YUV data.
+ *
+ * @param reader - The raw YUV frames.
+ * @param overlay - Whether to show the annotated frames in a window.
+ * @param profile - Whether to report per-stage timings and hardware
+ * counters.
+ */
+void Analyser::processYuv(YuvReader& reader, bool overlay, bool profile) {
+    YuvFrame frame;
+    cv::Mat colorMask, bgr;
+    size_t count = 0, found = 0;
+
+    unique_ptr<PerfCounters> perf;
+    StageTimings stageTimings;
+    StageTimings* timings = nullptr;
+    if (profile) {
+        perf = make_unique<PerfCounters>();
+        stageTimings.perf = perf.get();
+        timings = &stageTimings;
+    }
+
+    auto start = chrono::steady_clock::now();
+    while (reader.next(frame)) {
+        vector<Detection> detections =
+            detectYuv(frame, colorMask, QUALITY_FULL, timings);
+        found += detections.size();
+        count++;
+
+        if (overlay) {
+            {
+                StageScope scope(timings, STAGE_ANNOTATE);
+                frame.toBgr(bgr);
+                annotate(detections, bgr);
+            }
+            cv::imshow("binary", colorMask);
+            cv::imshow("Analyser", bgr);
+
+            int key = cv::waitKey(1);
+            if (key == 'x' || key == 'X') {
+                cout << "Exiting program..." << endl;
+                break;
+            }
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "YUV: " << count << " frames in " << elapsed.count() << " s ("
+         << count / max(elapsed.count(), 1e-9) << " frames/s), " << found
+         << " detections" << endl;
+    if (timings != nullptr) {
+        printStageReport(*timings, cout);
+    }
+    if (overlay) {
+        cv::destroyAllWindows();
+    }
+}
@@ -0,0 +1,303 @@
+/**
+ * @brief The pixel stages of the pipeline over bands of rows.
+ */
+#include "BandPipeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ColorClassifier.hpp"
+
+/**
+ * @brief Returns the lookup table `cv::equalizeHist` applies to a channel
+ * with the given histogram.
+ *
+ * @param histogram The number of pixels at each level.
+ * @param total The number of pixels.
+ * @return cv::Mat The 1x256 CV_8U lookup table.
+ */
+cv::Mat equalizationLut(const int histogram[256], int total) {
+    cv::Mat lut(1, 256, CV_8U);
+    uint8_t* table = lut.ptr<uint8_t>();
+    int first = 0;
+    while (first < 255 && histogram[first] == 0) {
+        first++;
+    }
+    if (histogram[first] == total) {
+        // Constant channel: equalizeHist maps everything to that value
+        for (int i = 0; i < 256; i++) {
+            table[i] = static_cast<uint8_t>(first);
+        }
+        return lut;
+    }
+
+    // Same mapping as cv::equalizeHist: the first occupied level maps to 0
+    float scale = 255.0f / (total - histogram[first]);
+    int sum = 0;
+    for (int i = 0; i <= first; i++) {
+        table[i] = 0;
+    }
+    for (int i = first + 1; i < 256; i++) {
+        sum += histogram[i];
+        table[i] = cv::saturate_cast<uint8_t>(sum * scale);
+    }
+    return lut;
+}
+
+/**
+ * @brief Combines two bytes as erosion (AND) or dilation (OR).
+ */
+template <RowMorphOp Op>
+static inline uint8_t combine(uint8_t a, uint8_t b) {
+    return Op == ROW_ERODE ? a & b : a | b;
+}
+
+/**
+ * @brief Reduces a row along itself: each byte of `dst` combines the bytes
+ * of `src` within `radius`. One shift at a time, so the loops vectorise.
+ */
+template <RowMorphOp Op>
+static void reduceRow(const uint8_t* src, uint8_t* dst, int width,
+                      int radius) {
+    memcpy(dst, src, width);
+    for (int d = 1; d <= radius && d < width; d++) {
+        for (int x = 0; x < width - d; x++) {
+            dst[x] = combine<Op>(dst[x], src[x + d]);
+        }
+        for (int x = d; x < width; x++) {
+            dst[x] = combine<Op>(dst[x], src[x - d]);
+        }
+    }
+}
+
+/**
+ * @brief Combines `src` into `dst`, byte by byte.
+ */
+template <RowMorphOp Op>
+static void combineRow(uint8_t* dst, const uint8_t* src, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = combine<Op>(dst[x], src[x]);
+    }
+}
+
+/**
+ * @brief Sets up the ring for rows of `width` bytes.
+ *
+ * @param width The row width.
+ * @param op Erosion or dilation.
+ * @param radius The reach of the element; 1 with the cross.
+ * @param cross Whether the element is the 3x3 cross, else a square.
+ */
+RowMorphology::RowMorphology(int width, RowMorphOp op, int radius, bool cross)
+    : width(width),
+      radius(radius),
+      rows(2 * radius + 1),
+      op(op),
+      cross(cross),
+      ring(static_cast<size_t>(rows) * width),
+      out(width) {
+    CV_Assert(radius >= 1 && (!cross || radius == 1));
+}
+
+/**
+ * @brief Pushes the next input row. With the square, the row is reduced
+ * along itself on the way in, so that each output row only combines the
+ * rows of the ring.
+ *
+ * @param row The row, `width` bytes.
+ * @return const uint8_t* The output row that became complete, or null while
+ * the first rows are buffered. It is valid until the next call.
+ */
+const uint8_t* RowMorphology::push(const uint8_t* row) {
+    uint8_t* dst = slot(pushed);
+    if (cross) {
+        memcpy(dst, row, width);
+    } else if (op == ROW_ERODE) {
+        reduceRow<ROW_ERODE>(row, dst, width, radius);
+    } else {
+        reduceRow<ROW_DILATE>(row, dst, width, radius);
+    }
+    pushed++;
+
+    return pushed - emitted > radius ? emit() : nullptr;
+}
+
+/**
+ * @brief After the last input row, returns the remaining output rows, one
+ * per call, then null. Rows past the last one take no part.
+ */
+const uint8_t* RowMorphology::drain() {
+    return emitted < pushed ? emit() : nullptr;
+}
+
+/**
+ * @brief Writes the next output row from the rows of the ring within reach.
+ */
+const uint8_t* RowMorphology::emit() {
+    int y = emitted++;
+    int first = max(y - radius, 0);
+    int last = min(y + radius, pushed - 1);
+    uint8_t* dst = out.data();
+
+    if (op == ROW_ERODE) {
+        if (cross) {
+            // The arm of the cross along the row, then the rows around it
+            reduceRow<ROW_ERODE>(slot(y), dst, width, 1);
+        } else {
+            memcpy(dst, slot(y), width);
+        }
+        for (int row = first; row <= last; row++) {
+            if (row != y) {
+                combineRow<ROW_ERODE>(dst, slot(row), width);
+            }
+        }
+    } else {
+        if (cross) {
+            reduceRow<ROW_DILATE>(slot(y), dst, width, 1);
+        } else {
+            memcpy(dst, slot(y), width);
+        }
+        for (int row = first; row <= last; row++) {
+            if (row != y) {
+                combineRow<ROW_DILATE>(dst, slot(row), width);
+            }
+        }
+    }
+    return dst;
+}
+
+/**
+ * @brief Sets up the bands and the chain of morphology stages for frames of
+ * the given width.
+ */
+void BandPipeline::setWidth(int frameWidth) {
+    width = frameWidth;
+    hsv.create(STREAM_BAND_ROWS, width, CV_8UC3);
+    band.create(STREAM_BAND_ROWS, width, CV_8UC3);
+    bits.assign(width, 0);
+
+    stages.clear();
+    // The denoising of ColorDetector: an opening and a closing with the 3x3
+    // cross, each repeated twice
+    const RowMorphOp denoise[] = {ROW_ERODE,  ROW_ERODE,  ROW_DILATE,
+                                  ROW_DILATE, ROW_DILATE, ROW_DILATE,
+                                  ROW_ERODE,  ROW_ERODE};
+    for (RowMorphOp op : denoise) {
+        stages.emplace_back(width, op, 1, true);
+    }
+    // The closing of ShapeDetector::findCandidates
+    stages.emplace_back(width, ROW_DILATE, STREAM_CLOSE_RADIUS, false);
+    stages.emplace_back(width, ROW_ERODE, STREAM_CLOSE_RADIUS, false);
+}
+
+/**
+ * @brief Pushes a row of class bits through the stages from `stage` on, and
+ * encodes the row coming out of the last one, if any.
+ */
+void BandPipeline::feed(size_t stage, const uint8_t* row, RunMask& red,
+                        RunMask& blue) {
+    for (; stage < stages.size() && row != nullptr; stage++) {
+        row = stages[stage].push(row);
+    }
+    if (row != nullptr) {
+        red.appendRow(row, 1 << COLOR_RED);
+        blue.appendRow(row, 1 << COLOR_BLUE);
+    }
+}
+
+/**
+ * @brief Runs the pixel stages over a frame: the histogram of V in a first
+ * pass, then each band converted, equalised, classified and pushed row by
+ * row through the morphology stages, which are drained at the end.
+ *
+ * @param frame The frame, CV_8UC3; it is not modified.
+ * @param red Receives the red mask, denoised and closed.
+ * @param blue Receives the blue mask, denoised and closed.
+ * @param equalize Whether to equalise the frame, as `Analyser::prepareFrame`
+ * does.
+ * @param rgb True when the frame is in RGB rather than BGR order.
+ * @param timings When not null, the histogram pass is added to the prepare
+ * stage and the band pass to the classify stage.
+ */
+void BandPipeline::run(const cv::Mat& frame, RunMask& red, RunMask& blue,
+                       bool equalize, bool rgb, StageTimings* timings) {
+    CV_Assert(frame.type() == CV_8UC3);
+
+    if (frame.cols != width) {
+        setWidth(frame.cols);
+    }
+    for (RowMorphology& stage : stages) {
+        stage.reset();
+    }
+    red = RunMask(frame.size());
+    blue = RunMask(frame.size());
+
+    cv::Mat lut;
+    if (equalize) {
+        // V is the largest of the three channels, in either order
+        StageScope scope(timings, STAGE_PREPARE);
+        int histogram[256] = {};
+        for (int y = 0; y < frame.rows; y++) {
+            const uint8_t* row = frame.ptr<uint8_t>(y);
+            for (int x = 0; x < frame.cols; x++) {
+                histogram[max(max(row[3 * x], row[3 * x + 1]),
+                              row[3 * x + 2])]++;
+            }
+        }
+        lut = equalizationLut(histogram, frame.rows * frame.cols);
+    }
+
+    StageScope scope(timings, STAGE_CLASSIFY);
+    const uint8_t keep = (1 << COLOR_RED) | (1 << COLOR_BLUE);
+    for (int top = 0; top < frame.rows; top += STREAM_BAND_ROWS) {
+        int count = min(STREAM_BAND_ROWS, frame.rows - top);
+        cv::Mat source = frame.rowRange(top, top + count);
+        if (equalize) {
+            // Headers over the band buffers, so the last band reuses them
+            cv::Mat hsvRows = hsv.rowRange(0, count);
+            cv::Mat bandRows = band.rowRange(0, count);
+            cv::cvtColor(source, hsvRows,
+                         rgb ? cv::COLOR_RGB2HSV : cv::COLOR_BGR2HSV);
+            const uint8_t* table = lut.ptr<uint8_t>();
+            for (int y = 0; y < count; y++) {
+                uint8_t* row = hsvRows.ptr<uint8_t>(y);
+                for (int x = 0; x < width; x++) {
+                    row[3 * x + 2] = table[row[3 * x + 2]];
+                }
+            }
+            cv::cvtColor(hsvRows, bandRows,
+                         rgb ? cv::COLOR_HSV2RGB : cv::COLOR_HSV2BGR);
+            source = bandRows;
+        }
+
+        for (int y = 0; y < count; y++) {
+            ColorClassifier::classifyBgrRow(source.ptr<uint8_t>(y), width,
+                                            rgb, bits.data());
+            for (int x = 0; x < width; x++) {
+                bits[x] &= keep;
+            }
+            feed(0, bits.data(), red, blue);
+        }
+    }
+
+    // Each stage passes its last rows on through the stages after it
+    for (size_t stage = 0; stage < stages.size(); stage++) {
+        const uint8_t* row;
+        while ((row = stages[stage].drain()) != nullptr) {
+            feed(stage + 1, row, red, blue);
+        }
+    }
+}
+
+/**
+ * @brief Returns the bytes held by the band buffers and the morphology
+ * rings: the working set of `run`, besides the frame and the masks.
+ */
+size_t BandPipeline::workingSetBytes() const {
+    size_t total = hsv.total() * hsv.elemSize() +
+                   band.total() * band.elemSize() + bits.size();
+    for (const RowMorphology& stage : stages) {
+        total += stage.bytes();
+    }
+    return total;
+}
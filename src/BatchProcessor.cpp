@@ -0,0 +1,355 @@
+/**
+ * @brief Parallel offline processing of image archives, with decoding and
+ * detection overlapped on separate thread pools.
+ */
+#include "BatchProcessor.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Analyser.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief An image decoded by an I/O thread, waiting for a detection thread.
+ */
+struct DecodedImage {
+    size_t index;
+    cv::Mat image;
+};
+
+/**
+ * @brief The result line of an image, waiting for its turn to be written.
+ */
+struct BatchResult {
+    string line;
+    bool failed;
+};
+
+/**
+ * @brief What the three pools share. Every field is guarded by `lock`.
+ */
+struct BatchShared {
+    mutex lock;
+    condition_variable decoded;   // An image was queued, or decoding ended
+    condition_variable finished;  // A result is ready for the writer
+    condition_variable written;   // The writer moved the window forward
+
+    deque<DecodedImage> queue;    // Decoded images, in any order
+    map<size_t, BatchResult> results;  // Results waiting for their turn
+    size_t nextInput = 0;         // Next image to hand to an I/O thread
+    size_t nextOutput = 0;        // Next image the writer waits for
+    int decoding = 0;             // I/O threads still running
+};
+
+/**
+ * @brief Returns true when the path has the extension of an image format
+ * `cv::imread` decodes.
+ */
+static bool isImage(const fs::path& path) {
+    string extension = path.extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(),
+              [](unsigned char c) { return tolower(c); });
+    return extension == ".jpg" || extension == ".jpeg" ||
+           extension == ".png" || extension == ".bmp" ||
+           extension == ".ppm" || extension == ".pgm" ||
+           extension == ".pnm" || extension == ".tif" ||
+           extension == ".tiff" || extension == ".webp";
+}
+
+/**
+ * @brief Formats the result line of one image.
+ */
+static string formatResult(const string& path,
+                           const vector<Detection>& detections) {
+    ostringstream line;
+    line << path << '\t' << detections.size() << fixed << setprecision(1);
+    for (const Detection& detection : detections) {
+        line << '\t' << signKindName(detection.kind) << ' '
+             << signDirectionName(detection.direction) << ' '
+             << detection.center.x << ' ' << detection.center.y << ' '
+             << detection.radius;
+    }
+    line << '\n';
+    return line.str();
+}
+
+/**
+ * @brief Returns the FNV-1a hash of the input list, in order, so that a
+ * checkpoint is only resumed against the list it was written for.
+ */
+static uint64_t hashInputs(const vector<string>& inputs) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const string& path : inputs) {
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        hash = (hash ^ '\n') * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Atomically replaces the checkpoint with the number of images and
+ * bytes written so far, and the hash of the input list.
+ */
+static void writeCheckpoint(const string& path, size_t done, uintmax_t bytes,
+                            uint64_t inputsHash) {
+    string temporary = path + ".tmp";
+    {
+        ofstream out(temporary, ios::trunc);
+        out << done << ' ' << bytes << ' ' << hex << inputsHash << '\n';
+    }
+    fs::rename(temporary, path);
+}
+
+/**
+ * @brief Decodes images in input order until every image is taken. At most
+ * `BATCH_QUEUE_DEPTH` images are in flight past the writer, which bounds the
+ * memory held by decoded images and pending results.
+ */
+static void decodeLoop(const vector<string>& inputs, BatchShared& shared) {
+    for (;;) {
+        size_t index;
+        {
+            unique_lock<mutex> guard(shared.lock);
+            shared.written.wait(guard, [&] {
+                return shared.nextInput >= inputs.size() ||
+                       shared.nextInput < shared.nextOutput + BATCH_QUEUE_DEPTH;
+            });
+            if (shared.nextInput >= inputs.size()) {
+                break;
+            }
+            index = shared.nextInput++;
+        }
+
+        cv::Mat image;
+        try {
+            image = cv::imread(inputs[index], cv::IMREAD_COLOR);
+        } catch (const exception&) {
+            // cv::Exception, or e.g. bad_alloc on a corrupt header
+            image.release();
+        }
+
+        lock_guard<mutex> guard(shared.lock);
+        shared.queue.push_back({index, move(image)});
+        shared.decoded.notify_one();
+    }
+
+    lock_guard<mutex> guard(shared.lock);
+    shared.decoding--;
+    shared.decoded.notify_all();
+}
+
+/**
+ * @brief Runs detection on decoded images until decoding has ended and the
+ * queue is drained. Each worker keeps its own workspace, so the workers
+ * share nothing but the queues.
+ */
+static void detectLoop(const vector<string>& inputs, BatchShared& shared) {
+    cv::Mat colorMask;
+
+    for (;;) {
+        DecodedImage item;
+        {
+            unique_lock<mutex> guard(shared.lock);
+            shared.decoded.wait(guard, [&] {
+                return !shared.queue.empty() || shared.decoding == 0;
+            });
+            if (shared.queue.empty()) {
+                break;
+            }
+            item = move(shared.queue.front());
+            shared.queue.pop_front();
+        }
+
+        BatchResult result{inputs[item.index] + "\tfailed\n", true};
+        if (!item.image.empty()) {
+            try {
+                vector<Detection> detections =
+                    Analyser::detect(item.image, colorMask);
+                result = {formatResult(inputs[item.index], detections), false};
+            } catch (const exception&) {
+                // Reported as failed, like an image that does not decode;
+                // an exception escaping a worker would end the whole run
+            }
+        }
+
+        lock_guard<mutex> guard(shared.lock);
+        shared.results.emplace(item.index, move(result));
+        shared.finished.notify_one();
+    }
+}
+
+/**
+ * @brief Lists the images of a directory (recursively, in path order) or
+ * of a list file. A list file holds one path per line; empty lines and
+ * lines starting with '#' are ignored.
+ *
+ * @param input A directory or a list file.
+ * @return vector<string> The image paths.
+ * @throws std::runtime_error If the input cannot be read.
+ */
+vector<string> BatchProcessor::listInputs(const string& input) {
+    vector<string> inputs;
+
+    if (fs::is_directory(input)) {
+        for (const auto& entry : fs::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file() && isImage(entry.path())) {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        sort(inputs.begin(), inputs.end());
+        return inputs;
+    }
+
+    ifstream list(input);
+    if (!list) {
+        throw runtime_error("Cannot open " + input);
+    }
+    string line;
+    while (getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] != '#') {
+            inputs.push_back(line);
+        }
+    }
+    return inputs;
+}
+
+/**
+ * @brief Processes every image of the input. I/O threads decode images into
+ * a bounded queue, detection threads consume it, and the calling thread
+ * writes the results in input order, reports the progress and saves a
+ * checkpoint every `BATCH_CHECKPOINT_EVERY` images. A checkpoint is only
+ * resumed against the same input list, in the same order.
+ *
+ * OpenCV's own thread pool is disabled during the run: the batch already
+ * keeps every core busy with independent images, which scales better than
+ * splitting each image across cores.
+ *
+ * @param config The input, output, pool sizes and resume flag.
+ * @return BatchStats The summary of the run.
+ * @throws std::runtime_error If the input or output cannot be opened, or the
+ * checkpoint to resume from does not match the input list.
+ */
+BatchStats BatchProcessor::run(const BatchConfig& config) {
+    vector<string> inputs = listInputs(config.input);
+    uint64_t inputsHash = hashInputs(inputs);
+    string checkpoint = config.output + ".checkpoint";
+
+    BatchStats stats;
+    stats.total = inputs.size();
+
+    // Resume: drop whatever was written after the last checkpoint
+    uintmax_t bytes = 0;
+    if (config.resume && fs::exists(checkpoint)) {
+        ifstream in(checkpoint);
+        uint64_t hash = 0;
+        in >> stats.skipped >> bytes >> hex >> hash;
+        if (!in || stats.skipped > inputs.size() ||
+            !fs::exists(config.output) ||
+            fs::file_size(config.output) < bytes) {
+            throw runtime_error("Invalid checkpoint " + checkpoint);
+        }
+        if (hash != inputsHash) {
+            throw runtime_error("Checkpoint " + checkpoint +
+                                " was written for another input list");
+        }
+        fs::resize_file(config.output, bytes);
+    }
+
+    ofstream out(config.output, stats.skipped > 0 ? ios::app : ios::trunc);
+    if (!out) {
+        throw runtime_error("Cannot open " + config.output);
+    }
+
+    int ioThreads = max(config.ioThreads, 1);
+    int detectThreads = config.detectThreads > 0
+                            ? config.detectThreads
+                            : max<int>(thread::hardware_concurrency(), 1);
+
+    BatchShared shared;
+    shared.nextInput = stats.skipped;
+    shared.nextOutput = stats.skipped;
+    shared.decoding = ioThreads;
+
+    int openCvThreads = cv::getNumThreads();
+    cv::setNumThreads(1);
+
+    vector<thread> workers;
+    for (int i = 0; i < ioThreads; i++) {
+        workers.emplace_back(decodeLoop, cref(inputs), ref(shared));
+    }
+    for (int i = 0; i < detectThreads; i++) {
+        workers.emplace_back(detectLoop, cref(inputs), ref(shared));
+    }
+
+    auto start = chrono::steady_clock::now();
+    auto lastReport = start;
+    for (size_t index = stats.skipped; index < inputs.size(); index++) {
+        BatchResult result;
+        {
+            unique_lock<mutex> guard(shared.lock);
+            shared.finished.wait(
+                guard, [&] { return shared.results.count(index) > 0; });
+            auto pending = shared.results.find(index);
+            result = move(pending->second);
+            shared.results.erase(pending);
+            shared.nextOutput = index + 1;
+            shared.written.notify_all();
+        }
+
+        out << result.line;
+        bytes += result.line.size();
+        stats.processed++;
+        if (result.failed) {
+            stats.failed++;
+        }
+
+        if (stats.processed % BATCH_CHECKPOINT_EVERY == 0) {
+            out.flush();
+            writeCheckpoint(checkpoint, index + 1, bytes, inputsHash);
+        }
+
+        auto now = chrono::steady_clock::now();
+        chrono::duration<double> sinceReport = now - lastReport;
+        if (sinceReport.count() >= BATCH_PROGRESS_SECONDS) {
+            chrono::duration<double> elapsed = now - start;
+            cerr << "Batch: " << index + 1 << "/" << inputs.size() << " ("
+                 << fixed << setprecision(1)
+                 << stats.processed / elapsed.count() << " images/s)"
+                 << defaultfloat << endl;
+            lastReport = now;
+        }
+    }
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    cv::setNumThreads(openCvThreads);
+
+    out.flush();
+    if (!out) {
+        throw runtime_error("Cannot write " + config.output);
+    }
+    writeCheckpoint(checkpoint, inputs.size(), bytes, inputsHash);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    stats.seconds = elapsed.count();
+    return stats;
+}
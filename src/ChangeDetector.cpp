@@ -0,0 +1,108 @@
+/**
+ * @brief This class decides which part of a frame changed since it was last
+ * processed, from a downsampled luma image.
+ */
+#include "ChangeDetector.hpp"
+
+/**
+ * @param threshold The mean absolute luma difference above which a block is
+ * considered changed.
+ * @param refreshInterval Forces a full refresh every that many frames.
+ */
+ChangeDetector::ChangeDetector(double threshold, int refreshInterval)
+    : threshold(threshold), refreshInterval(refreshInterval) {}
+
+/**
+ * @brief Forgets the reference, so that the next frame is a full refresh.
+ */
+void ChangeDetector::invalidate() { reference.release(); }
+
+/**
+ * @brief Compares a frame against the reference and updates the reference
+ * where the frame will be reprocessed.
+ *
+ * @param frame The BGR frame.
+ * @return ChangeResult What has to be reprocessed.
+ */
+ChangeResult ChangeDetector::update(const cv::Mat& frame) {
+    ChangeResult result;
+
+    // Downsample first: the area filter reads every pixel once and the
+    // colour conversion then only runs on the small image
+    cv::Mat small, luma;
+    cv::resize(frame, small,
+               cv::Size(max(frame.cols / CHANGE_DOWNSAMPLE, 1),
+                        max(frame.rows / CHANGE_DOWNSAMPLE, 1)),
+               0, 0, cv::INTER_AREA);
+    cv::cvtColor(small, luma, cv::COLOR_BGR2GRAY);
+
+    if (reference.empty() || reference.size() != luma.size() ||
+        ++sinceRefresh >= refreshInterval) {
+        reference = luma;
+        sinceRefresh = 0;
+        fullFrames++;
+        result.kind = CHANGE_FULL;
+        result.dirty = cv::Rect(0, 0, frame.cols, frame.rows);
+        return result;
+    }
+
+    // Mean absolute difference per block
+    cv::Mat diff, blockDiff;
+    cv::absdiff(luma, reference, diff);
+    int blocksX = (luma.cols + CHANGE_BLOCK_SIZE - 1) / CHANGE_BLOCK_SIZE;
+    int blocksY = (luma.rows + CHANGE_BLOCK_SIZE - 1) / CHANGE_BLOCK_SIZE;
+    cv::resize(diff, blockDiff, cv::Size(blocksX, blocksY), 0, 0,
+               cv::INTER_AREA);
+
+    int minX = blocksX, minY = blocksY, maxX = -1, maxY = -1;
+    for (int by = 0; by < blocksY; by++) {
+        const uint8_t* row = blockDiff.ptr<uint8_t>(by);
+        for (int bx = 0; bx < blocksX; bx++) {
+            if (row[bx] > threshold) {
+                result.dirtyBlocks++;
+                minX = min(minX, bx);
+                minY = min(minY, by);
+                maxX = max(maxX, bx);
+                maxY = max(maxY, by);
+            }
+        }
+    }
+
+    if (result.dirtyBlocks == 0) {
+        staticFrames++;
+        result.kind = CHANGE_NONE;
+        return result;
+    }
+
+    if (result.dirtyBlocks > CHANGE_FULL_RATIO * blocksX * blocksY) {
+        reference = luma;
+        sinceRefresh = 0;
+        fullFrames++;
+        result.kind = CHANGE_FULL;
+        result.dirty = cv::Rect(0, 0, frame.cols, frame.rows);
+        return result;
+    }
+
+    // Only the reprocessed area gets a new reference
+    cv::Rect dirtyLuma(minX * CHANGE_BLOCK_SIZE, minY * CHANGE_BLOCK_SIZE,
+                       (maxX - minX + 1) * CHANGE_BLOCK_SIZE,
+                       (maxY - minY + 1) * CHANGE_BLOCK_SIZE);
+    dirtyLuma &= cv::Rect(0, 0, luma.cols, luma.rows);
+    luma(dirtyLuma).copyTo(reference(dirtyLuma));
+
+    partialFrames++;
+    result.kind = CHANGE_PARTIAL;
+    result.dirty = cv::Rect(dirtyLuma.x * CHANGE_DOWNSAMPLE,
+                            dirtyLuma.y * CHANGE_DOWNSAMPLE,
+                            dirtyLuma.width * CHANGE_DOWNSAMPLE,
+                            dirtyLuma.height * CHANGE_DOWNSAMPLE);
+    // The last luma row/column may cover the frame remainder
+    if (dirtyLuma.x + dirtyLuma.width == luma.cols) {
+        result.dirty.width = frame.cols - result.dirty.x;
+    }
+    if (dirtyLuma.y + dirtyLuma.height == luma.rows) {
+        result.dirty.height = frame.rows - result.dirty.y;
+    }
+
+    return result;
+}
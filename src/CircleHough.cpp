@@ -0,0 +1,260 @@
+/**
+ * @brief A circle Hough transform for binary masks, voting from the mask's
+ * contours.
+ */
+#include "CircleHough.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <utility>
+
+/**
+ * @brief Parses a backend name ("opencv" or "contour").
+ *
+ * @return bool False when the name is not a known backend.
+ */
+bool parseCircleBackend(const string& name, CircleBackend& backend) {
+    string lower = name;
+    transform(lower.begin(), lower.end(), lower.begin(),
+              [](unsigned char c) { return tolower(c); });
+
+    if (lower == "opencv") {
+        backend = CIRCLE_BACKEND_OPENCV;
+    } else if (lower == "contour") {
+        backend = CIRCLE_BACKEND_CONTOUR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Votes for the centres of one contour. Each point votes along its
+ * inward normal for every radius in range; the normal is perpendicular to
+ * the chord between the points `span` before and after it, which on a
+ * circle is parallel to the tangent.
+ *
+ * @param contour The contour, every point of it (CHAIN_APPROX_NONE).
+ * @param box The bounding box of the contour.
+ * @param minRadius The smallest radius voted for.
+ * @param maxRadius The largest radius voted for.
+ * @return cv::Mat A CV_32SC1 accumulator over the contour's bounding box.
+ */
+cv::Mat CircleHough::accumulate(const vector<cv::Point>& contour, cv::Rect box,
+                                int minRadius, int maxRadius) {
+    int n = static_cast<int>(contour.size());
+
+    // Longer chords average out the pixel steps of large contours
+    int span = min(max(minRadius / 4, HOUGH_TANGENT_SPAN_MIN),
+                   HOUGH_TANGENT_SPAN_MAX);
+    span = min(span, n / 4);
+
+    // Outer contours have a positive oriented area, and their left-hand
+    // normal then points into the blob
+    float inward = cv::contourArea(contour, true) > 0 ? 1.0f : -1.0f;
+
+    int parts = n < HOUGH_PARALLEL_POINTS ? 1 : max(1, cv::getNumThreads());
+    vector<cv::Mat> partial(parts);
+
+    cv::parallel_for_(cv::Range(0, parts), [&](const cv::Range& range) {
+        for (int part = range.start; part < range.end; part++) {
+            cv::Mat& votes = partial[part];
+            votes = cv::Mat::zeros(box.size(), CV_32SC1);
+
+            int first = n * part / parts;
+            int last = n * (part + 1) / parts;
+            for (int i = first; i < last; i++) {
+                cv::Point chord =
+                    contour[(i + span) % n] - contour[(i - span + n) % n];
+                float length = sqrt(static_cast<float>(chord.dot(chord)));
+                if (length == 0) {
+                    continue;
+                }
+
+                float nx = -chord.y * inward / length;
+                float ny = chord.x * inward / length;
+                float px = static_cast<float>(contour[i].x - box.x);
+                float py = static_cast<float>(contour[i].y - box.y);
+                for (int r = minRadius; r <= maxRadius; r++) {
+                    int cx = cvRound(px + r * nx);
+                    int cy = cvRound(py + r * ny);
+                    if (static_cast<unsigned>(cx) <
+                            static_cast<unsigned>(box.width) &&
+                        static_cast<unsigned>(cy) <
+                            static_cast<unsigned>(box.height)) {
+                        votes.ptr<int>(cy)[cx]++;
+                    }
+                }
+            }
+        }
+    });
+
+    if (parts == 1) {
+        return partial[0];
+    }
+
+    // Merge the partials into the first one, one band of rows per task
+    cv::Mat votes = partial[0];
+    int bands = (box.height + HOUGH_TILE_ROWS - 1) / HOUGH_TILE_ROWS;
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int band = range.start; band < range.end; band++) {
+            int top = band * HOUGH_TILE_ROWS;
+            int bottom = min(box.height, top + HOUGH_TILE_ROWS);
+            cv::Mat rows = votes.rowRange(top, bottom);
+            for (int part = 1; part < parts; part++) {
+                cv::add(rows, partial[part].rowRange(top, bottom), rows);
+            }
+        }
+    });
+
+    return votes;
+}
+
+/**
+ * @brief Finds the radius of a circle around a centre: the distance to the
+ * contour shared by most points, within one pixel, refined as the mean
+ * distance of those points.
+ *
+ * @param contour The contour.
+ * @param center The centre of the circle.
+ * @param minRadius The smallest radius accepted.
+ * @param maxRadius The largest radius accepted.
+ * @param radius Receives the radius.
+ * @return bool False when the points at that distance cover less than
+ * `HOUGH_MIN_SUPPORT` of the circumference.
+ */
+bool CircleHough::fitRadius(const vector<cv::Point>& contour,
+                            cv::Point2f center, int minRadius, int maxRadius,
+                            float& radius) {
+    vector<float> distances(contour.size());
+    vector<int> histogram(maxRadius + 3, 0);
+    for (size_t i = 0; i < contour.size(); i++) {
+        float dx = contour[i].x - center.x;
+        float dy = contour[i].y - center.y;
+        distances[i] = sqrt(dx * dx + dy * dy);
+        histogram[min(cvRound(distances[i]), maxRadius + 2)]++;
+    }
+
+    int best = minRadius, bestCount = -1;
+    for (int r = minRadius; r <= maxRadius; r++) {
+        int count = histogram[r - 1] + histogram[r] + histogram[r + 1];
+        if (count > bestCount) {
+            best = r;
+            bestCount = count;
+        }
+    }
+
+    double sum = 0;
+    int support = 0;
+    for (float distance : distances) {
+        if (abs(distance - best) <= 1.5f) {
+            sum += distance;
+            support++;
+        }
+    }
+    if (support == 0) {
+        return false;
+    }
+
+    radius = static_cast<float>(sum / support);
+    return support >= HOUGH_MIN_SUPPORT * 2 * CV_PI * radius;
+}
+
+/**
+ * @brief Finds circles in a binary mask, with the output of
+ * `cv::HoughCircles`.
+ *
+ * @param mask The CV_8UC1 mask.
+ * @param circles Receives (x, y, radius) of each circle, the strongest
+ * first.
+ * @param minDist The minimum distance between the centres of two circles.
+ * @param minRadius The minimum radius.
+ * @param maxRadius The maximum radius.
+ */
+void CircleHough::detect(const cv::Mat& mask, vector<cv::Vec3f>& circles,
+                         double minDist, int minRadius, int maxRadius) {
+    CV_Assert(mask.type() == CV_8UC1);
+
+    vector<vector<cv::Point>> contours;
+    cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+    // Circles found so far, with their votes
+    vector<pair<double, cv::Vec3f>> found;
+    int suppression = max(1, cvRound(minDist));
+
+    for (const auto& contour : contours) {
+        int n = static_cast<int>(contour.size());
+        if (n < HOUGH_MIN_CONTOUR_POINTS) {
+            continue;
+        }
+
+        // A whole circle of the blob fits in its bounding box, and one much
+        // smaller than the box is not what the blob is
+        cv::Rect box = cv::boundingRect(contour);
+        int rMax = min(maxRadius, (min(box.width, box.height) + 1) / 2);
+        int rMin = max({minRadius, 1,
+                        static_cast<int>(HOUGH_MIN_RADIUS_RATIO * rMax)});
+        if (rMin > rMax) {
+            continue;
+        }
+
+        cv::Mat votes = accumulate(contour, box, rMin, rMax);
+
+        // Peaks are taken over 3x3 sums, which absorb the rounding of votes
+        cv::Mat peaks;
+        votes.convertTo(peaks, CV_32F);
+        cv::boxFilter(peaks, peaks, -1, cv::Size(3, 3), cv::Point(-1, -1),
+                      false, cv::BORDER_CONSTANT);
+
+        for (int k = 0; k < HOUGH_MAX_CIRCLES_PER_BLOB; k++) {
+            double peak;
+            cv::Point at;
+            cv::minMaxLoc(peaks, nullptr, &peak, nullptr, &at);
+            if (peak < HOUGH_CENTER_VOTE_RATIO * n) {
+                break;
+            }
+
+            // Centre of mass of the votes around the peak
+            double weight = 0, sumX = 0, sumY = 0;
+            for (int y = max(at.y - 1, 0); y <= min(at.y + 1, box.height - 1);
+                 y++) {
+                for (int x = max(at.x - 1, 0);
+                     x <= min(at.x + 1, box.width - 1); x++) {
+                    int v = votes.at<int>(y, x);
+                    weight += v;
+                    sumX += v * x;
+                    sumY += v * y;
+                }
+            }
+            cv::Point2f center(static_cast<float>(box.x + sumX / weight),
+                               static_cast<float>(box.y + sumY / weight));
+
+            float radius;
+            bool separate = true;
+            for (const auto& f : found) {
+                if (hypot(f.second[0] - center.x, f.second[1] - center.y) <
+                    minDist) {
+                    separate = false;
+                }
+            }
+            if (separate && fitRadius(contour, center, rMin, rMax, radius)) {
+                found.emplace_back(peak,
+                                   cv::Vec3f(center.x, center.y, radius));
+            }
+
+            cv::circle(peaks, at, suppression, cv::Scalar(0), -1);
+        }
+    }
+
+    stable_sort(found.begin(), found.end(),
+                [](const pair<double, cv::Vec3f>& a,
+                   const pair<double, cv::Vec3f>& b) {
+                    return a.first > b.first;
+                });
+
+    circles.clear();
+    for (const auto& f : found) {
+        circles.push_back(f.second);
+    }
+}
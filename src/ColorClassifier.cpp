@@ -0,0 +1,217 @@
+/**
+ * @brief This class classifies HSV pixels against the colour class table in a
+ * single pass.
+ */
+#include "ColorClassifier.hpp"
+
+#include <vector>
+
+#include "TileOccupancy.hpp"
+
+#define HSV_SHIFT 12
+
+#define BGR_LUT_SHIFT (8 - BGR_LUT_BITS)
+#define BGR_LUT_SIZE (1 << (3 * BGR_LUT_BITS))
+
+/**
+ * @brief The division tables of OpenCV's 8-bit BGR to HSV conversion.
+ */
+struct HsvDivisionTables {
+    int saturation[256];
+    int hue[256];
+
+    HsvDivisionTables() {
+        saturation[0] = hue[0] = 0;
+        for (int i = 1; i < 256; i++) {
+            saturation[i] =
+                cv::saturate_cast<int>((255 << HSV_SHIFT) / (1. * i));
+            hue[i] = cv::saturate_cast<int>((180 << HSV_SHIFT) / (6. * i));
+        }
+    }
+};
+
+/**
+ * @brief Classifies one BGR pixel, reproducing bit for bit the 8-bit
+ * conversion of `cv::cvtColor(COLOR_BGR2HSV)`, so that the result equals
+ * that of `classify` on the converted image.
+ *
+ * @return uint8_t Bit `i` is set when the pixel belongs to class `i`.
+ */
+uint8_t ColorClassifier::classifyBgrPixel(uint8_t b, uint8_t g, uint8_t r) {
+    static const HsvDivisionTables tables;
+
+    int v = max(max(b, g), r);
+    int diff = v - min(min(b, g), r);
+    int vr = v == r ? -1 : 0;
+    int vg = v == g ? -1 : 0;
+
+    int s = (diff * tables.saturation[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    int h = (vr & (g - b)) +
+            (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+    h = (h * tables.hue[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    h += h < 0 ? 180 : 0;
+
+    return classifyPixel(static_cast<uint8_t>(h), static_cast<uint8_t>(s),
+                         static_cast<uint8_t>(v));
+}
+
+/**
+ * @brief Classifies an HSV image.
+ *
+ * @param hsv The input image, CV_8UC3 in OpenCV's HSV scale.
+ * @param occupancy When not null, receives the per-tile counts of each
+ * class, gathered as the rows are classified.
+ * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+ */
+cv::Mat ColorClassifier::classify(const cv::Mat& hsv,
+                                  TileOccupancy* occupancy) {
+    CV_Assert(hsv.type() == CV_8UC3);
+
+    cv::Mat bits(hsv.size(), CV_8UC1);
+    if (occupancy != nullptr) {
+        occupancy->reset(bits.size());
+    }
+    for (int y = 0; y < hsv.rows; y++) {
+        const uint8_t* src = hsv.ptr<uint8_t>(y);
+        uint8_t* dst = bits.ptr<uint8_t>(y);
+        for (int x = 0; x < hsv.cols; x++) {
+            dst[x] = classifyPixel(src[3 * x], src[3 * x + 1], src[3 * x + 2]);
+        }
+        // Counted while the row is still in cache
+        if (occupancy != nullptr) {
+            occupancy->addRow(y, dst);
+        }
+    }
+
+    return bits;
+}
+
+/**
+ * @brief Returns the BGR cell table, built on first use. Each cell holds the
+ * class bits of its colours when they all agree, and `BGR_LUT_AMBIGUOUS`
+ * otherwise. The classes are fixed at compile time, so a change of
+ * thresholds rebuilds the table with the program.
+ */
+const uint8_t* ColorClassifier::bgrTable() {
+    static_assert(COLOR_CLASS_COUNT < 8,
+                  "the top bit of a cell flags ambiguous cells");
+
+    static const vector<uint8_t> cells = [] {
+        vector<uint8_t> lut(BGR_LUT_SIZE);
+        const int side = 1 << BGR_LUT_BITS;
+        const int span = 1 << BGR_LUT_SHIFT;
+
+        // Every BGR value is classified once, one blue slice per task
+        cv::parallel_for_(cv::Range(0, side), [&](const cv::Range& range) {
+            for (int cellB = range.start; cellB < range.end; cellB++) {
+                for (int cellG = 0; cellG < side; cellG++) {
+                    for (int cellR = 0; cellR < side; cellR++) {
+                        int first = classifyBgrPixel(
+                            static_cast<uint8_t>(cellB * span),
+                            static_cast<uint8_t>(cellG * span),
+                            static_cast<uint8_t>(cellR * span));
+                        bool ambiguous = false;
+                        for (int i = 1; i < span * span * span; i++) {
+                            int b = cellB * span + i / (span * span);
+                            int g = cellG * span + i / span % span;
+                            int r = cellR * span + i % span;
+                            if (classifyBgrPixel(static_cast<uint8_t>(b),
+                                                 static_cast<uint8_t>(g),
+                                                 static_cast<uint8_t>(r)) !=
+                                first) {
+                                ambiguous = true;
+                                break;
+                            }
+                        }
+                        int index = (cellB << (2 * BGR_LUT_BITS)) |
+                                    (cellG << BGR_LUT_BITS) | cellR;
+                        lut[index] = static_cast<uint8_t>(
+                            ambiguous ? BGR_LUT_AMBIGUOUS : first);
+                    }
+                }
+            }
+        });
+
+        return lut;
+    }();
+
+    return cells.data();
+}
+
+/**
+ * @brief Classifies a BGR image through the cell table: one lookup per
+ * pixel, and the exact conversion only for pixels of ambiguous cells.
+ *
+ * @param bgr The input image, CV_8UC3.
+ * @param rgb True when the image is in RGB rather than BGR order.
+ * @param occupancy When not null, receives the per-tile counts of each
+ * class, gathered as the rows are classified.
+ * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+ */
+cv::Mat ColorClassifier::classifyBgr(const cv::Mat& bgr, bool rgb,
+                                     TileOccupancy* occupancy) {
+    CV_Assert(bgr.type() == CV_8UC3);
+
+    cv::Mat bits(bgr.size(), CV_8UC1);
+    if (occupancy != nullptr) {
+        occupancy->reset(bits.size());
+    }
+    for (int y = 0; y < bgr.rows; y++) {
+        uint8_t* dst = bits.ptr<uint8_t>(y);
+        classifyBgrRow(bgr.ptr<uint8_t>(y), bgr.cols, rgb, dst);
+        if (occupancy != nullptr) {
+            occupancy->addRow(y, dst);
+        }
+    }
+
+    return bits;
+}
+
+/**
+ * @brief Classifies one row of BGR pixels through the cell table.
+ *
+ * @param bgr The pixels, three bytes each.
+ * @param width The number of pixels.
+ * @param rgb True when the pixels are in RGB rather than BGR order.
+ * @param bits Receives the class bits of each pixel.
+ */
+void ColorClassifier::classifyBgrRow(const uint8_t* bgr, int width, bool rgb,
+                                     uint8_t* bits) {
+    const uint8_t* lut = bgrTable();
+    int blue = rgb ? 2 : 0;
+    int red = rgb ? 0 : 2;
+
+    for (int x = 0; x < width; x++) {
+        uint8_t b = bgr[3 * x + blue];
+        uint8_t g = bgr[3 * x + 1];
+        uint8_t r = bgr[3 * x + red];
+
+        uint8_t cell = lut[((b >> BGR_LUT_SHIFT) << (2 * BGR_LUT_BITS)) |
+                           ((g >> BGR_LUT_SHIFT) << BGR_LUT_BITS) |
+                           (r >> BGR_LUT_SHIFT)];
+        bits[x] = cell & BGR_LUT_AMBIGUOUS ? classifyBgrPixel(b, g, r) : cell;
+    }
+}
+
+/**
+ * @brief Extracts the 0/255 mask of one class from a class-bits image.
+ *
+ * @param bits The class-bits image returned by `classify`.
+ * @param id The class to extract.
+ * @return cv::Mat The CV_8UC1 mask of the class.
+ */
+cv::Mat ColorClassifier::extract(const cv::Mat& bits, ColorClassId id) {
+    CV_Assert(bits.type() == CV_8UC1);
+
+    cv::Mat mask(bits.size(), CV_8UC1);
+    for (int y = 0; y < bits.rows; y++) {
+        const uint8_t* src = bits.ptr<uint8_t>(y);
+        uint8_t* dst = mask.ptr<uint8_t>(y);
+        for (int x = 0; x < bits.cols; x++) {
+            // 0 or 1 negated to 0x00 or 0xff, without a branch
+            dst[x] = static_cast<uint8_t>(-((src[x] >> id) & 1));
+        }
+    }
+
+    return mask;
+}
@@ -4,30 +4,116 @@
  */
 #include "ColorDetector.hpp"
 
+#include <climits>
+
 /**
- * @brief Detects the red color in the input image.
+ * @brief Classifies every pixel of the input image against all colour
+ * classes in one pass. BGR and RGB images are classified straight from the
+ * colour table of `ColorClassifier`, with the same result as through HSV.
  *
- * @param img The input image.
- * @return cv::Mat The mask of the detected red color.
+ * @param img The input image, BGR unless `code` says otherwise.
+ * @param code The cv::cvtColor code converting `img` to HSV.
+ * @param occupancy When not null, receives the per-tile counts of each class.
+ * @return cv::Mat The class-bits image (see `ColorClassifier`).
  */
-cv::Mat ColorDetector::detectRed(const cv::Mat& img) {
+cv::Mat ColorDetector::classify(const cv::Mat& img, int code,
+                                TileOccupancy* occupancy) {
+    if (code == cv::COLOR_BGR2HSV || code == cv::COLOR_RGB2HSV) {
+        return ColorClassifier::classifyBgr(img, code == cv::COLOR_RGB2HSV,
+                                            occupancy);
+    }
+
     cv::Mat hsv;
-    cv::cvtColor(img, hsv, cv::COLOR_BGR2HSV);
+    cv::cvtColor(img, hsv, code);
 
-    cv::Mat mask1, mask2;
-    cv::inRange(hsv, RED_LOWER_BOUND1, RED_UPPER_BOUND1, mask1);
-    cv::inRange(hsv, RED_LOWER_BOUND2, RED_UPPER_BOUND2, mask2);
-    cv::Mat mask = mask1 | mask2;
+    return ColorClassifier::classify(hsv, occupancy);
+}
 
-    // Add noise reduction
-    cv::Mat kernel =
+/**
+ * @brief Returns the structuring element of `denoise`, built on first use and
+ * shared by every call.
+ */
+static const cv::Mat& denoiseKernel() {
+    static const cv::Mat kernel =
         cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 2);
-    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 2);
+    return kernel;
+}
+
+/**
+ * @brief Removes specks and fills pinholes of a mask in place. Each pixel of
+ * the result depends on the input within `COLOR_DENOISE_HALO` pixels.
+ *
+ * @param mask The mask to denoise.
+ * @param borderType The border mode of the morphology; masks that are views
+ * into a larger buffer need `cv::BORDER_ISOLATED` so that nothing outside
+ * the view is read.
+ */
+static void denoise(cv::Mat& mask, int borderType = cv::BORDER_CONSTANT) {
+    const cv::Mat& kernel = denoiseKernel();
+    cv::Scalar border = cv::morphologyDefaultBorderValue();
+    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 2,
+                     borderType, border);
+    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 2,
+                     borderType, border);
+}
+
+/**
+ * @brief Extracts and denoises the mask of one colour class.
+ *
+ * With the tile occupancy, each region of the class is extracted and
+ * denoised on its own, padded by `COLOR_DENOISE_HALO` so that the region
+ * itself comes out exactly as on the whole frame; nothing outside the
+ * regions can be set, so the rest of the mask stays empty.
+ *
+ * @param classBits The class-bits image returned by `classify`.
+ * @param id The colour class to extract.
+ * @param occupancy When not null, the tile counts of `classBits`: only the
+ * regions holding the class are processed.
+ * @return cv::Mat The mask of the detected color.
+ */
+cv::Mat ColorDetector::detect(const cv::Mat& classBits, ColorClassId id,
+                              const TileOccupancy* occupancy) {
+    cv::Rect frame(cv::Point(), classBits.size());
+    vector<cv::Rect> regions;
+    if (occupancy != nullptr) {
+        CV_Assert(occupancy->size() == classBits.size());
+        regions = occupancy->regions(static_cast<uint8_t>(1 << id));
+    }
 
+    if (occupancy == nullptr ||
+        (regions.size() == 1 && regions[0] == frame)) {
+        cv::Mat mask = ColorClassifier::extract(classBits, id);
+
+        // Add noise reduction
+        denoise(mask);
+        return mask;
+    }
+
+    cv::Mat mask = cv::Mat::zeros(classBits.size(), CV_8UC1);
+    for (const cv::Rect& region : regions) {
+        cv::Rect padded(region.x - COLOR_DENOISE_HALO,
+                        region.y - COLOR_DENOISE_HALO,
+                        region.width + 2 * COLOR_DENOISE_HALO,
+                        region.height + 2 * COLOR_DENOISE_HALO);
+        padded &= frame;
+
+        cv::Mat part = ColorClassifier::extract(classBits(padded), id);
+        denoise(part);
+        part(region - padded.tl()).copyTo(mask(region));
+    }
     return mask;
 }
 
+/**
+ * @brief Detects the red color in the input image.
+ *
+ * @param img The input image.
+ * @return cv::Mat The mask of the detected red color.
+ */
+cv::Mat ColorDetector::detectRed(const cv::Mat& img) {
+    return detect(classify(img), COLOR_RED);
+}
+
 /**
  * @brief Detects the blue color in the input image.
  *
@@ -35,17 +121,94 @@ cv::Mat ColorDetector::detectRed(const cv::Mat& img) {
  * @return cv::Mat The mask of the detected blue color.
  */
 cv::Mat ColorDetector::detectBlue(const cv::Mat& img) {
-    cv::Mat hsv;
-    cv::cvtColor(img, hsv, cv::COLOR_BGR2HSV);
+    return detect(classify(img), COLOR_BLUE);
+}
 
-    cv::Mat mask;
-    cv::inRange(hsv, BLUE_LOWER_BOUND, BLUE_UPPER_BOUND, mask);
+/**
+ * @brief Extracts and denoises the mask of one colour class in each image of
+ * a batch, as `detect(classify(img), id)` does for one image.
+ *
+ * The masks are slices of a single buffer, allocated once for the batch.
+ * Each image is classified row by row straight into its mask, without a
+ * class-bits image, and the images are shared out in one `parallel_for_`,
+ * one task each; the morphology of each mask then runs on the thread of its
+ * image rather than dispatching its own parallel work. The masks lie next to
+ * each other in the buffer, so the morphology is isolated to each slice:
+ * otherwise the first and last rows of a mask would be filtered against the
+ * neighbouring masks, which other tasks are rewriting at the same time.
+ *
+ * @param imgs The BGR input images, e.g. crops of a frame around tracked
+ * signs. Empty images get an empty mask.
+ * @param id The colour class to extract.
+ * @return vector<cv::Mat> The mask of each image, in order, each a view into
+ * the shared buffer.
+ */
+vector<cv::Mat> ColorDetector::detectBatch(const vector<cv::Mat>& imgs,
+                                           ColorClassId id) {
+    size_t total = 0;
+    for (const cv::Mat& img : imgs) {
+        CV_Assert(img.empty() || img.type() == CV_8UC3);
+        total += img.total();
+    }
+    vector<cv::Mat> masks(imgs.size());
+    if (total == 0) {
+        return masks;
+    }
+    CV_Assert(total <= static_cast<size_t>(INT_MAX));
 
-    // Add noise reduction
-    cv::Mat kernel =
-        cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 2);
-    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 2);
+    // A single row holds every mask, one continuous slice each
+    cv::Mat buffer(1, static_cast<int>(total), CV_8UC1);
+    int offset = 0;
+    for (size_t i = 0; i < imgs.size(); i++) {
+        if (imgs[i].empty()) {
+            continue;
+        }
+        int size = static_cast<int>(imgs[i].total());
+        masks[i] =
+            buffer.colRange(offset, offset + size).reshape(1, imgs[i].rows);
+        offset += size;
+    }
 
-    return mask;
+    int count = static_cast<int>(imgs.size());
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const cv::Mat& img = imgs[i];
+            cv::Mat& mask = masks[i];
+            if (img.empty()) {
+                continue;
+            }
+            for (int y = 0; y < img.rows; y++) {
+                uint8_t* row = mask.ptr<uint8_t>(y);
+                ColorClassifier::classifyBgrRow(img.ptr<uint8_t>(y), img.cols,
+                                                false, row);
+                for (int x = 0; x < img.cols; x++) {
+                    // 0 or 1 negated to 0x00 or 0xff, without a branch
+                    row[x] = static_cast<uint8_t>(-((row[x] >> id) & 1));
+                }
+            }
+            denoise(mask, cv::BORDER_CONSTANT | cv::BORDER_ISOLATED);
+        }
+    });
+
+    return masks;
+}
+
+/**
+ * @brief Detects the red color in each image of a batch.
+ *
+ * @param imgs The input images.
+ * @return vector<cv::Mat> The mask of each image, in one shared buffer.
+ */
+vector<cv::Mat> ColorDetector::detectRed(const vector<cv::Mat>& imgs) {
+    return detectBatch(imgs, COLOR_RED);
+}
+
+/**
+ * @brief Detects the blue color in each image of a batch.
+ *
+ * @param imgs The input images.
+ * @return vector<cv::Mat> The mask of each image, in one shared buffer.
+ */
+vector<cv::Mat> ColorDetector::detectBlue(const vector<cv::Mat>& imgs) {
+    return detectBatch(imgs, COLOR_BLUE);
 }
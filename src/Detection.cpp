@@ -0,0 +1,27 @@
+/**
+ * @brief Names of the sign kinds and directions reported in a `Detection`.
+ */
+#include "Detection.hpp"
+
+static const char* const SIGN_KIND_NAMES[SIGN_KIND_COUNT] = {
+    "blue_circle", "red_circle", "octagon", "square"};
+
+static const char* const SIGN_DIRECTION_NAMES[DIRECTION_COUNT] = {
+    "none", "left", "right", "highway", "car"};
+
+/**
+ * @brief Returns the lower-case name of a sign kind ("blue_circle", ...).
+ */
+const char* signKindName(SignKind kind) {
+    return kind >= 0 && kind < SIGN_KIND_COUNT ? SIGN_KIND_NAMES[kind]
+                                               : "unknown";
+}
+
+/**
+ * @brief Returns the lower-case name of a direction ("none", "left", ...).
+ */
+const char* signDirectionName(SignDirection direction) {
+    return direction >= 0 && direction < DIRECTION_COUNT
+               ? SIGN_DIRECTION_NAMES[direction]
+               : "unknown";
+}
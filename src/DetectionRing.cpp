@@ -0,0 +1,327 @@
+/**
+ * @brief A POSIX shared memory ring through which the `Analyser` publishes
+ * its detections to other processes on the same machine.
+ */
+#include "DetectionRing.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+// Offset of the first slot; slots are aligned to cache lines so that the
+// writer of one slot does not share a line with readers of the next
+#define RING_ALIGN 64
+
+static_assert(sizeof(RingDetection) == 40, "RingDetection must be packed");
+static_assert(sizeof(RingSlot) == 48, "RingSlot must be packed");
+static_assert(sizeof(RingHeader) <= RING_ALIGN, "RingHeader is too large");
+static_assert(atomic<uint64_t>::is_always_lock_free,
+              "The ring needs lock-free 64-bit atomics across processes");
+
+/**
+ * @brief Returns a time point as ns since the epoch of its clock.
+ */
+static int64_t toNs(LatencyClock::time_point time) {
+    return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief Returns the size of a slot, rounded up to a whole cache line.
+ */
+static size_t slotSize(uint32_t maxDetections, cv::Size thumbnail) {
+    size_t bytes = sizeof(RingSlot) + maxDetections * sizeof(RingDetection) +
+                   static_cast<size_t>(thumbnail.area());
+    return (bytes + RING_ALIGN - 1) / RING_ALIGN * RING_ALIGN;
+}
+
+/**
+ * @brief Returns a slot of a mapped ring.
+ */
+static RingSlot* slotAt(void* base, const RingHeader* header, uint64_t i) {
+    char* slots = static_cast<char*>(base) + RING_ALIGN;
+    return reinterpret_cast<RingSlot*>(slots + (i % header->slotCount) *
+                                                   header->slotBytes);
+}
+
+/**
+ * @brief Creates the shared memory object, replacing any stale one of the
+ * same name.
+ *
+ * @param name The object name, e.g. "/visao".
+ * @param slots The number of records the ring keeps.
+ * @param thumbnail The size of the mask thumbnails; empty for none.
+ * @throws std::runtime_error If the object cannot be created.
+ */
+DetectionPublisher::DetectionPublisher(const string& name, uint32_t slots,
+                                       cv::Size thumbnail)
+    : name(name) {
+    CV_Assert(slots > 0 && thumbnail.width >= 0 && thumbnail.height >= 0);
+    if (thumbnail.area() == 0) {
+        thumbnail = cv::Size();
+    }
+
+    // A ring left behind by a publisher that crashed is replaced; readers
+    // still mapping it keep the old object until they reopen
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw runtime_error("Cannot create shared memory " + name);
+    }
+
+    size_t slotBytes = slotSize(RING_MAX_DETECTIONS, thumbnail);
+    length = RING_ALIGN + slots * slotBytes;
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw runtime_error("Cannot size shared memory " + name);
+    }
+    base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        shm_unlink(name.c_str());
+        throw runtime_error("Cannot map shared memory " + name);
+    }
+
+    // The object is zero-filled, so every slot starts at sequence 0: empty.
+    // The magic is written last, so a reader never sees a half header
+    RingHeader* header = static_cast<RingHeader*>(base);
+    header->version = RING_VERSION;
+    header->slotCount = slots;
+    header->slotBytes = static_cast<uint32_t>(slotBytes);
+    header->maxDetections = RING_MAX_DETECTIONS;
+    header->thumbWidth = thumbnail.width;
+    header->thumbHeight = thumbnail.height;
+    new (&header->published) atomic<uint64_t>(0);
+    for (uint32_t i = 0; i < slots; i++) {
+        new (&slotAt(base, header, i)->sequence) atomic<uint64_t>(0);
+    }
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, RING_MAGIC, sizeof(header->magic));
+}
+
+DetectionPublisher::~DetectionPublisher() {
+    if (base != nullptr) {
+        munmap(base, length);
+        shm_unlink(name.c_str());
+    }
+}
+
+/**
+ * @brief Publishes the detections of a frame into the next slot, overwriting
+ * the oldest record. Never waits for readers.
+ *
+ * @param frame The frame number.
+ * @param captured The capture time of the frame.
+ * @param frameSize The size of the frame.
+ * @param detections The detections, in frame coordinates.
+ * @param mask The colour mask, thumbnailed when the ring has thumbnails; may
+ * be empty.
+ */
+void DetectionPublisher::publish(uint64_t frame,
+                                 LatencyClock::time_point captured,
+                                 cv::Size frameSize,
+                                 const vector<Detection>& detections,
+                                 const cv::Mat& mask) {
+    RingHeader* header = static_cast<RingHeader*>(base);
+    uint64_t n = header->published.load(memory_order_relaxed);
+    RingSlot* slot = slotAt(base, header, n);
+
+    // Mark the slot as being written before any of its payload changes
+    slot->sequence.store(2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint32_t count = static_cast<uint32_t>(
+        min<size_t>(detections.size(), header->maxDetections));
+    slot->frame = frame;
+    slot->capturedNs = toNs(captured);
+    slot->publishedNs = toNs(LatencyClock::now());
+    slot->width = frameSize.width;
+    slot->height = frameSize.height;
+    slot->count = count;
+    slot->truncated = static_cast<uint32_t>(detections.size() - count);
+
+    RingDetection* out = reinterpret_cast<RingDetection*>(slot + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const Detection& d = detections[i];
+        RingDetection r = {};
+        r.kind = static_cast<uint8_t>(d.kind);
+        r.direction = static_cast<uint8_t>(d.direction);
+        r.x = d.center.x;
+        r.y = d.center.y;
+        r.radius = d.radius;
+        r.massX = d.centerOfMass.x;
+        r.massY = d.centerOfMass.y;
+        if (!d.polygon.empty()) {
+            cv::Rect box = cv::boundingRect(d.polygon);
+            r.left = box.x;
+            r.top = box.y;
+            r.right = box.x + box.width;
+            r.bottom = box.y + box.height;
+        } else {
+            r.left = d.center.x - d.radius;
+            r.top = d.center.y - d.radius;
+            r.right = d.center.x + d.radius;
+            r.bottom = d.center.y + d.radius;
+        }
+        out[i] = r;
+    }
+
+    if (header->thumbWidth > 0) {
+        uint8_t* pixels = reinterpret_cast<uint8_t*>(
+            out + header->maxDetections);
+        cv::Mat thumb(static_cast<int>(header->thumbHeight),
+                      static_cast<int>(header->thumbWidth), CV_8UC1, pixels);
+        if (mask.empty()) {
+            thumb.setTo(0);
+        } else {
+            // Resized straight into the slot: the sizes match, so `resize`
+            // keeps the buffer rather than allocating its own
+            cv::resize(mask, thumb, thumb.size(), 0, 0, cv::INTER_AREA);
+        }
+    }
+
+    slot->sequence.store(2 * n + 2, memory_order_release);
+    header->published.store(n + 1, memory_order_release);
+}
+
+uint64_t DetectionPublisher::published() const {
+    const RingHeader* header = static_cast<const RingHeader*>(base);
+    return header->published.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Maps the shared memory object of a publisher, read-only.
+ *
+ * @param name The object name, as given to the publisher.
+ * @param fromOldest Whether to start with the oldest record still in the
+ * ring rather than with the next one published.
+ * @throws std::runtime_error If the object does not exist or is not a
+ * detection ring.
+ */
+DetectionSubscriber::DetectionSubscriber(const string& name,
+                                         bool fromOldest) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw runtime_error("Cannot open shared memory " + name);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < RING_ALIGN) {
+        ::close(fd);
+        throw runtime_error(name + " is not a detection ring");
+    }
+    length = static_cast<size_t>(st.st_size);
+    base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        throw runtime_error("Cannot map shared memory " + name);
+    }
+
+    const RingHeader* header = static_cast<const RingHeader*>(base);
+    bool valid =
+        memcmp(header->magic, RING_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == RING_VERSION && header->slotCount > 0;
+    atomic_thread_fence(memory_order_acquire);
+    if (valid) {
+        cv::Size thumbnail(header->thumbWidth, header->thumbHeight);
+        valid = header->slotBytes ==
+                    slotSize(header->maxDetections, thumbnail) &&
+                length >= RING_ALIGN + static_cast<size_t>(header->slotCount) *
+                                           header->slotBytes;
+    }
+    if (!valid) {
+        munmap(const_cast<void*>(base), length);
+        base = nullptr;
+        throw runtime_error(name + " is not a detection ring");
+    }
+
+    uint64_t published = header->published.load(memory_order_acquire);
+    next = published;
+    if (fromOldest) {
+        next = published > header->slotCount ? published - header->slotCount
+                                              : 0;
+    }
+}
+
+DetectionSubscriber::~DetectionSubscriber() {
+    if (base != nullptr) {
+        munmap(const_cast<void*>(base), length);
+    }
+}
+
+/**
+ * @brief Reads the next record, without waiting. A record overwritten
+ * before or while it is read is skipped and counted as lost, so a slow
+ * reader resynchronises with the writer instead of slowing it down.
+ *
+ * @param record Receives the record.
+ * @return bool False when no new record has been published.
+ */
+bool DetectionSubscriber::poll(RingRecord& record) {
+    const RingHeader* header = static_cast<const RingHeader*>(base);
+    void* mapped = const_cast<void*>(base);
+
+    for (;;) {
+        uint64_t published = header->published.load(memory_order_acquire);
+        if (next >= published) {
+            return false;
+        }
+        if (published - next > header->slotCount) {
+            // Lapped: everything older than the ring holds is gone
+            missed += published - header->slotCount - next;
+            next = published - header->slotCount;
+        }
+
+        const RingSlot* slot = slotAt(mapped, header, next);
+        uint64_t expected = 2 * next + 2;
+        if (slot->sequence.load(memory_order_acquire) != expected) {
+            missed++;
+            next++;
+            continue;
+        }
+
+        // Copy, then check that the writer did not touch the slot meanwhile;
+        // a torn copy is discarded rather than retried, as the writer has
+        // already moved past this record
+        uint32_t count = min(slot->count, header->maxDetections);
+        record.frame = slot->frame;
+        record.capturedNs = slot->capturedNs;
+        record.publishedNs = slot->publishedNs;
+        record.frameSize = cv::Size(slot->width, slot->height);
+        record.truncated = slot->truncated;
+        const RingDetection* in =
+            reinterpret_cast<const RingDetection*>(slot + 1);
+        record.detections.assign(in, in + count);
+        if (header->thumbWidth > 0) {
+            const uint8_t* pixels = reinterpret_cast<const uint8_t*>(
+                in + header->maxDetections);
+            record.thumbnail.create(static_cast<int>(header->thumbHeight),
+                                    static_cast<int>(header->thumbWidth),
+                                    CV_8UC1);
+            memcpy(record.thumbnail.data, pixels, record.thumbnail.total());
+        } else {
+            record.thumbnail.release();
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (slot->sequence.load(memory_order_relaxed) != expected) {
+            missed++;
+            next++;
+            continue;
+        }
+
+        record.sequence = next;
+        next++;
+        return true;
+    }
+}
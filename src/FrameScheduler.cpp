@@ -0,0 +1,166 @@
+/**
+ * @brief This class decouples capture from processing so that the pipeline
+ * always works on the newest frame and degrades quality under overload.
+ */
+#include "FrameScheduler.hpp"
+
+/**
+ * @brief Starts the capture thread.
+ *
+ * @param source The frame source; only the capture thread reads from it.
+ * @param budgetMs The per-frame processing budget in milliseconds.
+ */
+FrameScheduler::FrameScheduler(FrameSource& source, double budgetMs)
+    : source(source), budgetMs(budgetMs) {
+    worker = thread(&FrameScheduler::captureLoop, this);
+}
+
+FrameScheduler::~FrameScheduler() { stop(); }
+
+/**
+ * @brief Stops the capture thread. Called by the destructor.
+ */
+void FrameScheduler::stop() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    frameReady.notify_all();
+    frameTaken.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Reads frames as fast as the source delivers them and keeps only the
+ * newest one. Frames of a source that is not live are read only once the
+ * previous one was picked up, so none is dropped.
+ */
+void FrameScheduler::captureLoop() {
+    cv::Mat frame;
+    LatencyClock::time_point captured;
+    bool live = source.live();
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            if (!live) {
+                frameTaken.wait(guard, [this] { return !fresh || stopping; });
+            }
+            if (stopping) {
+                break;
+            }
+        }
+
+        if (!source.read(frame, captured)) {
+            break;
+        }
+
+        {
+            lock_guard<mutex> guard(lock);
+            counters.captured++;
+            if (fresh) {
+                // The previous frame was never picked up: it is stale now
+                counters.dropped++;
+            }
+            // Swap rather than copy; `frame` gets the old buffer to reuse
+            cv::swap(latest, frame);
+            latestCaptured = captured;
+            fresh = true;
+        }
+        frameReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        finished = true;
+    }
+    frameReady.notify_all();
+}
+
+/**
+ * @brief Waits for a frame newer than the previous one.
+ *
+ * @param frame Receives the newest captured frame.
+ * @param times When not null, receives the capture time of the frame and the
+ * time it was handed out.
+ * @return bool False once the source is exhausted.
+ */
+bool FrameScheduler::next(cv::Mat& frame, FrameTimes* times) {
+    unique_lock<mutex> guard(lock);
+    frameReady.wait(guard, [this] { return fresh || finished || stopping; });
+    if (!fresh) {
+        return false;
+    }
+
+    cv::swap(frame, latest);
+    fresh = false;
+    frameTaken.notify_one();
+    if (times != nullptr) {
+        times->captured = latestCaptured;
+        times->dequeued = LatencyClock::now();
+    }
+    counters.processed++;
+    if (counters.level >= QUALITY_ALTERNATE_FRAMES &&
+        counters.processed % 2 == 0) {
+        counters.skipped++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Tells whether the frame returned by the last `next` should run
+ * detection at the current quality level.
+ */
+bool FrameScheduler::shouldDetect() const {
+    lock_guard<mutex> guard(lock);
+    return counters.level < QUALITY_ALTERNATE_FRAMES ||
+           counters.processed % 2 != 0;
+}
+
+/**
+ * @brief Reports the processing time of the last frame and steps the
+ * quality level down or up accordingly.
+ *
+ * @param elapsedMs The time spent on the frame, in milliseconds.
+ */
+void FrameScheduler::report(double elapsedMs) {
+    lock_guard<mutex> guard(lock);
+
+    if (elapsedMs > budgetMs) {
+        counters.overBudget++;
+        overloadStreak++;
+        headroomStreak = 0;
+    } else if (elapsedMs < budgetMs * SCHEDULER_HEADROOM_RATIO) {
+        headroomStreak++;
+        overloadStreak = 0;
+    } else {
+        overloadStreak = 0;
+        headroomStreak = 0;
+    }
+
+    // Step down only under sustained overload, and up only after a long run
+    // of headroom, so a single slow frame does not make the level oscillate
+    if (overloadStreak >= SCHEDULER_OVERLOAD_FRAMES &&
+        counters.level + 1 < QUALITY_LEVEL_COUNT) {
+        counters.level = static_cast<QualityLevel>(counters.level + 1);
+        counters.degradations++;
+        overloadStreak = 0;
+    } else if (headroomStreak >= SCHEDULER_HEADROOM_FRAMES &&
+               counters.level > QUALITY_FULL) {
+        counters.level = static_cast<QualityLevel>(counters.level - 1);
+        counters.recoveries++;
+        headroomStreak = 0;
+    }
+}
+
+QualityLevel FrameScheduler::level() const {
+    lock_guard<mutex> guard(lock);
+    return counters.level;
+}
+
+SchedulerStats FrameScheduler::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
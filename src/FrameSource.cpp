@@ -0,0 +1,34 @@
+/**
+ * @brief Frames of a `cv::VideoCapture`, with their capture times.
+ */
+#include "FrameSource.hpp"
+
+/**
+ * @brief Reads the next frame. Camera backends such as V4L2 report the
+ * driver's timestamp on the monotonic clock; files report their position in
+ * the stream instead, which is far from the read time, and then the read
+ * time is used.
+ *
+ * @param frame Receives the frame.
+ * @param captured Receives the time the frame was captured.
+ * @return bool False once the capture ends.
+ */
+bool CameraSource::read(cv::Mat& frame, LatencyClock::time_point& captured) {
+    if (!cap.read(frame)) {
+        return false;
+    }
+    LatencyClock::time_point readAt = LatencyClock::now();
+    captured = readAt;
+
+    double ms = cap.get(cv::CAP_PROP_POS_MSEC);
+    if (ms > 0) {
+        LatencyClock::time_point stamp(
+            chrono::duration_cast<LatencyClock::duration>(
+                chrono::duration<double, milli>(ms)));
+        chrono::milliseconds maxAge(LATENCY_MAX_CAPTURE_AGE_MS);
+        if (stamp <= readAt && readAt - stamp < maxAge) {
+            captured = stamp;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,143 @@
+/**
+ * @brief Log-linear latency histograms and the per-stage latency report.
+ */
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS \
+    ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+static const char* const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {
+    "queue", "detect", "emit", "end-to-end"};
+
+/**
+ * @brief Returns the name of a latency stage ("queue", ...).
+ */
+const char* latencyStageName(LatencyStage stage) {
+    return stage >= 0 && stage < LATENCY_STAGE_COUNT
+               ? LATENCY_STAGE_NAMES[stage]
+               : "unknown";
+}
+
+/**
+ * @brief Returns the bucket of a value. Values below
+ * `2 * LATENCY_SUB_BUCKETS` have a bucket each; above, each power of two is
+ * split into `LATENCY_SUB_BUCKETS` buckets by the bits below its top bit.
+ */
+static int bucketOf(uint64_t us) {
+    if (us < 2 * LATENCY_SUB_BUCKETS) {
+        return static_cast<int>(us);
+    }
+    int topBit = 63 - __builtin_clzll(us);
+    int shift = topBit - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS +
+           static_cast<int>(us >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+/**
+ * @brief Returns the largest value of a bucket, so that percentiles are
+ * never under-reported.
+ */
+static uint64_t bucketHighest(int bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t mantissa = bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : counts(LATENCY_BUCKETS, 0) {}
+
+/**
+ * @brief Records one latency.
+ *
+ * @param ms The latency in milliseconds; negative values count as 0.
+ */
+void LatencyHistogram::record(double ms) {
+    const uint64_t limit = (uint64_t(1) << LATENCY_MAX_BITS) - 1;
+    uint64_t us = static_cast<uint64_t>(
+        min(max(ms * 1000.0, 0.0), static_cast<double>(limit)));
+
+    counts[bucketOf(us)]++;
+    total++;
+    maxUs = max(maxUs, us);
+}
+
+/**
+ * @brief Returns the latency at or below which `percent` of the recorded
+ * values fall, in milliseconds; 0 when empty.
+ */
+double LatencyHistogram::percentile(double percent) const {
+    if (total == 0) {
+        return 0.0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(
+        ceil(min(max(percent, 0.0), 100.0) / 100.0 * total));
+    rank = max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return min(bucketHighest(bucket), maxUs) / 1000.0;
+        }
+    }
+    return maximum();
+}
+
+void LatencyHistogram::reset() {
+    fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    maxUs = 0;
+}
+
+/**
+ * @brief Records the stage latencies of one frame.
+ */
+void LatencyTracker::record(const FrameTimes& times) {
+    auto ms = [](LatencyClock::time_point from, LatencyClock::time_point to) {
+        return chrono::duration<double, milli>(to - from).count();
+    };
+
+    histograms[LATENCY_QUEUE].record(ms(times.captured, times.dequeued));
+    histograms[LATENCY_DETECT].record(ms(times.dequeued, times.detected));
+    histograms[LATENCY_EMIT].record(ms(times.detected, times.emitted));
+    histograms[LATENCY_END_TO_END].record(ms(times.captured, times.emitted));
+}
+
+void LatencyTracker::reset() {
+    for (LatencyHistogram& histogram : histograms) {
+        histogram.reset();
+    }
+}
+
+/**
+ * @brief Prints p50, p95, p99 and the maximum of every stage.
+ */
+void printLatencyReport(const LatencyTracker& tracker, const char* title,
+                        ostream& out) {
+    out << title << " latency over " << tracker.frames() << " frames (ms)"
+        << endl;
+
+    ios::fmtflags flags = out.flags();
+    out << "  " << left << setw(14) << "stage" << right << setw(9) << "p50"
+        << setw(9) << "p95" << setw(9) << "p99" << setw(9) << "max" << endl;
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        const LatencyHistogram& histogram =
+            tracker.histogram(static_cast<LatencyStage>(stage));
+        out << "  " << left << setw(14)
+            << latencyStageName(static_cast<LatencyStage>(stage)) << right
+            << fixed << setprecision(3) << setw(9)
+            << histogram.percentile(50) << setw(9)
+            << histogram.percentile(95) << setw(9)
+            << histogram.percentile(99) << setw(9) << histogram.maximum()
+            << endl;
+    }
+    out.flags(flags);
+}
@@ -0,0 +1,118 @@
+/**
+ * @brief This class reads the hardware performance counters of the calling
+ * thread through `perf_event_open`.
+ */
+#include "PerfCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+/**
+ * @brief Opens one hardware event on the calling thread.
+ *
+ * @param config The PERF_COUNT_HW_* event.
+ * @param groupFd The group leader, or -1 to open a leader.
+ * @return int The file descriptor, or -1 with errno set.
+ */
+static int openEvent(uint64_t config, int groupFd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFd < 0 ? 1 : 0;
+    // User space only: allowed at perf_event_paranoid 2, and the pipeline
+    // does not spend its time in the kernel
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(
+        syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+
+#ifdef __linux__
+    static const uint64_t configs[PERF_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    leader = openEvent(configs[PERF_CYCLES], -1);
+    if (leader < 0) {
+        why = string("perf_event_open failed: ") + strerror(errno);
+        return;
+    }
+    fds[PERF_CYCLES] = leader;
+    slot[PERF_CYCLES] = opened++;
+
+    for (int i = PERF_CYCLES + 1; i < PERF_EVENT_COUNT; i++) {
+        fds[i] = openEvent(configs[i], leader);
+        if (fds[i] >= 0) {
+            slot[i] = opened++;
+        }
+    }
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    why = "hardware counters are only supported on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Reads the current raw count of every event, with the enabled and
+ * running times of the group. The counts are not scaled: see
+ * `PerfSample::since`.
+ */
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+
+#ifdef __linux__
+    if (leader < 0) {
+        return sample;
+    }
+
+    // nr, time enabled, time running, then one value per opened event
+    uint64_t buffer[3 + PERF_EVENT_COUNT] = {};
+    ssize_t size = ::read(leader, buffer, sizeof(buffer));
+    if (size < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+        return sample;
+    }
+
+    sample.enabled = buffer[1];
+    sample.running = buffer[2];
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (slot[i] < 0 || static_cast<uint64_t>(slot[i]) >= buffer[0]) {
+            continue;
+        }
+        sample.value[i] = buffer[3 + slot[i]];
+    }
+#endif
+
+    return sample;
+}
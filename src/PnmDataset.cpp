@@ -0,0 +1,222 @@
+/**
+ * @brief Zero-copy access to binary PGM/PPM files through mmap, and a
+ * sequential dataset sweep that prefetches the next files.
+ */
+#include "PnmDataset.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * @brief Skips whitespace and `#` comments in a PNM header.
+ *
+ * @param data The start of the file.
+ * @param length The length of the file.
+ * @param pos The current position, advanced past the skipped bytes.
+ */
+static inline void skipSpace(const char* data, size_t length, size_t& pos) {
+    while (pos < length) {
+        if (data[pos] == '#') {
+            while (pos < length && data[pos] != '\n') {
+                pos++;
+            }
+        } else if (isspace(static_cast<unsigned char>(data[pos]))) {
+            pos++;
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Reads one decimal header field.
+ *
+ * @return int The value, or -1 if there is no number at `pos`.
+ */
+static inline int readField(const char* data, size_t length, size_t& pos) {
+    skipSpace(data, length, pos);
+    if (pos >= length || !isdigit(static_cast<unsigned char>(data[pos]))) {
+        return -1;
+    }
+    int value = 0;
+    while (pos < length && isdigit(static_cast<unsigned char>(data[pos]))) {
+        value = value * 10 + (data[pos] - '0');
+        if (value > (1 << 24)) {
+            return -1;
+        }
+        pos++;
+    }
+    return value;
+}
+
+/**
+ * @brief Maps a file and parses its header.
+ *
+ * @param path The path of the P5 or P6 file.
+ * @throws std::runtime_error If the file cannot be mapped or is not an
+ * 8-bit binary PGM/PPM.
+ */
+MappedPnm::MappedPnm(const string& path) : filePath(path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        throw runtime_error("Cannot stat " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    // Private and writable: in-place processing copies pages on write and
+    // never reaches the file
+    base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        throw runtime_error("Cannot map " + path);
+    }
+
+    const char* data = static_cast<const char*>(base);
+    if (length < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+        unmap();
+        throw runtime_error(path + " is not a binary PGM/PPM file");
+    }
+    int channels = data[1] == '6' ? 3 : 1;
+
+    size_t pos = 2;
+    int width = readField(data, length, pos);
+    int height = readField(data, length, pos);
+    int maxValue = readField(data, length, pos);
+    // Exactly one whitespace byte separates the header from the samples
+    pos++;
+
+    if (width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 255) {
+        unmap();
+        throw runtime_error(path + " has an unsupported PNM header");
+    }
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    if (pos + rowBytes * height > length) {
+        unmap();
+        throw runtime_error(path + " is truncated");
+    }
+
+    mat = cv::Mat(height, width, CV_8UC(channels),
+                  static_cast<char*>(base) + pos, rowBytes);
+    madvise(base, length, MADV_SEQUENTIAL);
+}
+
+MappedPnm::~MappedPnm() { unmap(); }
+
+MappedPnm::MappedPnm(MappedPnm&& other) noexcept
+    : filePath(std::move(other.filePath)),
+      base(other.base),
+      length(other.length),
+      mat(std::move(other.mat)) {
+    other.base = nullptr;
+    other.length = 0;
+}
+
+MappedPnm& MappedPnm::operator=(MappedPnm&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        filePath = std::move(other.filePath);
+        base = other.base;
+        length = other.length;
+        mat = std::move(other.mat);
+        other.base = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+/**
+ * @brief Asks the kernel to read the pixel data ahead of use.
+ */
+void MappedPnm::prefetch() const {
+    if (base != nullptr) {
+        madvise(base, length, MADV_WILLNEED);
+    }
+}
+
+void MappedPnm::unmap() {
+    mat.release();
+    if (base != nullptr) {
+        munmap(base, length);
+        base = nullptr;
+        length = 0;
+    }
+}
+
+/**
+ * @brief Builds a dataset from a directory (every *.ppm and *.pgm in it, in
+ * name order) or from a single file.
+ *
+ * @param path A directory or a file.
+ * @param prefetchDepth How many files to map ahead of the current one.
+ */
+PnmDataset::PnmDataset(const string& path, int prefetchDepth)
+    : prefetchDepth(prefetchDepth) {
+    namespace fs = std::filesystem;
+
+    if (fs::is_directory(path)) {
+        for (const auto& entry : fs::directory_iterator(path)) {
+            string extension = entry.path().extension().string();
+            if (entry.is_regular_file() &&
+                (extension == ".ppm" || extension == ".pgm")) {
+                paths.push_back(entry.path().string());
+            }
+        }
+        sort(paths.begin(), paths.end());
+    } else {
+        paths.push_back(path);
+    }
+}
+
+/**
+ * @brief Builds a dataset from an explicit list of files.
+ */
+PnmDataset::PnmDataset(vector<string> paths, int prefetchDepth)
+    : paths(std::move(paths)), prefetchDepth(prefetchDepth) {}
+
+/**
+ * @brief Moves to the next file of the sweep.
+ *
+ * @param image Receives the mapped file.
+ * @return bool False once every file has been returned.
+ */
+bool PnmDataset::next(MappedPnm& image) {
+    fillAhead();
+    if (ahead.empty()) {
+        return false;
+    }
+
+    image = std::move(ahead.front());
+    ahead.pop_front();
+    // Keep the window full while the caller works on this file
+    fillAhead();
+
+    return true;
+}
+
+/**
+ * @brief Maps files until `prefetchDepth` of them are waiting, asking the
+ * kernel to start reading each one.
+ */
+void PnmDataset::fillAhead() {
+    while (ahead.size() < static_cast<size_t>(max(prefetchDepth, 1)) &&
+           nextToMap < paths.size()) {
+        MappedPnm image(paths[nextToMap++]);
+        image.prefetch();
+        ahead.push_back(std::move(image));
+    }
+}
@@ -0,0 +1,344 @@
+/**
+ * @brief Binary masks stored as runs of set pixels.
+ */
+#include "RunMask.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+/**
+ * @brief Returns the sums of x, x^2 and x^3 over the columns [start, end).
+ */
+static void columnSums(int start, int end, double& s1, double& s2,
+                       double& s3) {
+    // Sums over 0..n, exact in 64 bits for any frame width OpenCV handles
+    auto p1 = [](int64_t n) { return n * (n + 1) / 2; };
+    auto p2 = [](int64_t n) { return n * (n + 1) * (2 * n + 1) / 6; };
+    auto p3 = [&](int64_t n) { return p1(n) * p1(n); };
+    int64_t a = start - 1, b = end - 1;
+    s1 = static_cast<double>(p1(b) - p1(a));
+    s2 = static_cast<double>(p2(b) - p2(a));
+    s3 = static_cast<double>(p3(b) - p3(a));
+}
+
+/**
+ * @brief Returns the root of a run in the union-find forest, halving the
+ * path on the way.
+ */
+static int findRoot(vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * @brief Starts an empty mask of the given size, to be filled from the top
+ * with `appendRow`.
+ */
+RunMask::RunMask(cv::Size size) : canvas(size), rowStart(1, 0) {}
+
+/**
+ * @brief Encodes the pixels of an image where any of `bits` is set: a binary
+ * mask with the default, or one class straight from a class-bits image (see
+ * `ColorClassifier`).
+ *
+ * @param img The CV_8UC1 image.
+ * @param bits The bits that make a pixel part of the mask.
+ */
+RunMask RunMask::encode(const cv::Mat& img, uint8_t bits) {
+    CV_Assert(img.type() == CV_8UC1);
+
+    RunMask mask(img.size());
+    mask.rowStart.reserve(img.rows + 1);
+    for (int y = 0; y < img.rows; y++) {
+        mask.appendRow(img.ptr<uint8_t>(y), bits);
+    }
+    return mask;
+}
+
+/**
+ * @brief Encodes the next row of the mask. Empty stretches are skipped eight
+ * pixels at a time.
+ *
+ * @param row The pixels of the row, as wide as the mask.
+ * @param bits The bits that make a pixel part of the mask.
+ */
+void RunMask::appendRow(const uint8_t* row, uint8_t bits) {
+    int y = static_cast<int>(rowStart.size()) - 1;
+    if (y < 0 || y >= canvas.height) {
+        return;
+    }
+    uint64_t wordBits = 0x0101010101010101ull * bits;
+
+    int x = 0;
+    while (x < canvas.width) {
+        if (x + 8 <= canvas.width) {
+            uint64_t word;
+            memcpy(&word, row + x, sizeof(word));
+            if ((word & wordBits) == 0) {
+                x += 8;
+                continue;
+            }
+        }
+        if ((row[x] & bits) == 0) {
+            x++;
+            continue;
+        }
+        int start = x;
+        while (x < canvas.width && (row[x] & bits) != 0) {
+            x++;
+        }
+        spans.push_back({y, start, x});
+    }
+    rowStart.push_back(spans.size());
+}
+
+/**
+ * @brief Returns the mask as a CV_8UC1 image of 0 and 255.
+ */
+cv::Mat RunMask::toDense() const {
+    cv::Mat dense;
+    toDense(dense);
+    return dense;
+}
+
+/**
+ * @brief Writes the mask into a CV_8UC1 image of its size, as 0 and 255.
+ */
+void RunMask::toDense(cv::Mat& dense) const {
+    dense.create(canvas, CV_8UC1);
+    dense.setTo(0);
+    for (const MaskRun& run : spans) {
+        memset(dense.ptr<uint8_t>(run.row) + run.start, 255,
+               run.end - run.start);
+    }
+}
+
+/**
+ * @brief Returns the number of set pixels.
+ */
+int64_t RunMask::area() const {
+    int64_t total = 0;
+    for (const MaskRun& run : spans) {
+        total += run.end - run.start;
+    }
+    return total;
+}
+
+/**
+ * @brief Returns the spatial moments of the set pixels, each weighing 1, as
+ * `cv::moments(mask, true)` does. Each run adds closed-form sums over its
+ * columns, so the cost does not depend on its length.
+ */
+cv::Moments RunMask::moments() const {
+    double m00 = 0, m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;
+    double m30 = 0, m21 = 0, m12 = 0, m03 = 0;
+    for (const MaskRun& run : spans) {
+        double n = run.end - run.start;
+        double y = run.row;
+        double s1, s2, s3;
+        columnSums(run.start, run.end, s1, s2, s3);
+        m00 += n;
+        m10 += s1;
+        m01 += n * y;
+        m20 += s2;
+        m11 += s1 * y;
+        m02 += n * y * y;
+        m30 += s3;
+        m21 += s2 * y;
+        m12 += s1 * y * y;
+        m03 += n * y * y * y;
+    }
+    return cv::Moments(m00, m10, m01, m20, m11, m02, m30, m21, m12, m03);
+}
+
+/**
+ * @brief Whether any set pixel lies inside a rectangle.
+ */
+bool RunMask::intersects(cv::Rect roi) const {
+    roi &= cv::Rect(cv::Point(), canvas);
+    for (int y = roi.y; y < roi.y + roi.height; y++) {
+        pair<size_t, size_t> row = rowRuns(y);
+        for (size_t i = row.first; i < row.second; i++) {
+            if (spans[i].start < roi.x + roi.width &&
+                spans[i].end > roi.x) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the part of the mask inside a rectangle, in the rectangle's
+ * coordinates.
+ */
+RunMask RunMask::crop(cv::Rect roi) const {
+    roi &= cv::Rect(cv::Point(), canvas);
+
+    RunMask cropped;
+    cropped.canvas = roi.size();
+    int right = roi.x + roi.width;
+    for (int y = roi.y; y < roi.y + roi.height; y++) {
+        pair<size_t, size_t> row = rowRuns(y);
+        for (size_t i = row.first; i < row.second; i++) {
+            int start = max(spans[i].start, roi.x);
+            int end = min(spans[i].end, right);
+            if (start < end) {
+                cropped.spans.push_back({y - roi.y, start - roi.x,
+                                         end - roi.x});
+            }
+        }
+    }
+    cropped.indexRows();
+    return cropped;
+}
+
+/**
+ * @brief Returns the pixels set in both masks, which must have the same
+ * size. The runs of each row are merged like two sorted lists.
+ */
+RunMask RunMask::intersection(const RunMask& other) const {
+    CV_Assert(canvas == other.canvas);
+
+    RunMask both;
+    both.canvas = canvas;
+    for (int y = 0; y < canvas.height; y++) {
+        pair<size_t, size_t> a = rowRuns(y), b = other.rowRuns(y);
+        size_t i = a.first, j = b.first;
+        while (i < a.second && j < b.second) {
+            const MaskRun& p = spans[i];
+            const MaskRun& q = other.spans[j];
+            int start = max(p.start, q.start);
+            int end = min(p.end, q.end);
+            if (start < end) {
+                both.spans.push_back({y, start, end});
+            }
+            if (p.end < q.end) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+    }
+    both.indexRows();
+    return both;
+}
+
+/**
+ * @brief Returns the pixels set in either mask, which must have the same
+ * size. The runs of each row are merged like two sorted lists, joining those
+ * that overlap or touch.
+ */
+RunMask RunMask::unite(const RunMask& other) const {
+    CV_Assert(canvas == other.canvas);
+
+    RunMask either;
+    either.canvas = canvas;
+    for (int y = 0; y < canvas.height; y++) {
+        pair<size_t, size_t> a = rowRuns(y), b = other.rowRuns(y);
+        size_t i = a.first, j = b.first;
+        size_t rowFirst = either.spans.size();
+        while (i < a.second || j < b.second) {
+            // The run that starts first, from either mask
+            bool fromA =
+                j >= b.second ||
+                (i < a.second && spans[i].start <= other.spans[j].start);
+            const MaskRun& next = fromA ? spans[i++] : other.spans[j++];
+            if (either.spans.size() > rowFirst &&
+                next.start <= either.spans.back().end) {
+                either.spans.back().end =
+                    max(either.spans.back().end, next.end);
+            } else {
+                either.spans.push_back(next);
+            }
+        }
+    }
+    either.indexRows();
+    return either;
+}
+
+/**
+ * @brief Labels the 4- or 8-connected components of the mask. Runs of
+ * consecutive rows that touch are joined in a union-find forest, walking the
+ * two rows together; labels are then numbered in raster order of the first
+ * run of each component.
+ *
+ * @param labels Receives the label of each run, from 0.
+ * @param connectivity 4 or 8, as in `cv::connectedComponents`.
+ * @return int The number of components.
+ */
+int RunMask::label(vector<int>& labels, int connectivity) const {
+    CV_Assert(connectivity == 4 || connectivity == 8);
+    // Diagonal neighbours touch across one more column with 8-connectivity
+    int reach = connectivity == 8 ? 1 : 0;
+
+    vector<int> parent(spans.size());
+    iota(parent.begin(), parent.end(), 0);
+    for (int y = 1; y < canvas.height; y++) {
+        pair<size_t, size_t> above = rowRuns(y - 1), row = rowRuns(y);
+        size_t i = above.first, j = row.first;
+        while (i < above.second && j < row.second) {
+            const MaskRun& p = spans[i];
+            const MaskRun& q = spans[j];
+            if (p.start < q.end + reach && q.start < p.end + reach) {
+                int a = findRoot(parent, static_cast<int>(i));
+                int b = findRoot(parent, static_cast<int>(j));
+                // The older run stays the root, so roots come first in
+                // raster order
+                parent[max(a, b)] = min(a, b);
+            }
+            if (p.end < q.end) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+    }
+
+    labels.assign(spans.size(), -1);
+    int count = 0;
+    for (size_t i = 0; i < spans.size(); i++) {
+        int root = findRoot(parent, static_cast<int>(i));
+        if (labels[root] < 0) {
+            labels[root] = count++;
+        }
+        labels[i] = labels[root];
+    }
+    return count;
+}
+
+/**
+ * @brief Keeps the runs of the selected components.
+ *
+ * @param labels The labels returned by `label`.
+ * @param keep Whether to keep each component.
+ */
+RunMask RunMask::select(const vector<int>& labels,
+                        const vector<bool>& keep) const {
+    CV_Assert(labels.size() == spans.size());
+
+    RunMask selected;
+    selected.canvas = canvas;
+    for (size_t i = 0; i < spans.size(); i++) {
+        if (keep[labels[i]]) {
+            selected.spans.push_back(spans[i]);
+        }
+    }
+    selected.indexRows();
+    return selected;
+}
+
+/**
+ * @brief Rebuilds the index of the first run of each row.
+ */
+void RunMask::indexRows() {
+    rowStart.assign(canvas.height + 1, 0);
+    for (const MaskRun& run : spans) {
+        rowStart[run.row + 1]++;
+    }
+    partial_sum(rowStart.begin(), rowStart.end(), rowStart.begin());
+}
@@ -0,0 +1,288 @@
+/**
+ * @brief Recording of timestamped frames into a session file, and their
+ * replay from a memory mapping.
+ */
+#include "Session.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+static_assert(sizeof(SessionHeader) == 32, "SessionHeader must be packed");
+static_assert(sizeof(SessionRecord) == 40, "SessionRecord must be packed");
+static_assert(sizeof(SessionIndexEntry) == 16,
+              "SessionIndexEntry must be packed");
+
+/**
+ * @brief Returns a time point as ns since the epoch of its clock.
+ */
+static int64_t toNs(LatencyClock::time_point time) {
+    return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief Creates a session file, replacing any file at that path. The
+ * header is written with an empty index until the file is closed.
+ *
+ * @param path The path of the file.
+ * @param encoding How to store the pixels of each frame.
+ * @throws std::runtime_error If the file cannot be created.
+ */
+SessionWriter::SessionWriter(const string& path, SessionEncoding encoding)
+    : path(path), encoding(encoding) {
+    out.open(path, ios::binary | ios::trunc);
+    if (!out) {
+        throw runtime_error("Cannot create " + path);
+    }
+
+    SessionHeader header = {};
+    memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_VERSION;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset = sizeof(header);
+}
+
+SessionWriter::~SessionWriter() {
+    try {
+        close();
+    } catch (const exception&) {
+        // Destructors must not throw; the file is still readable unindexed
+    }
+}
+
+/**
+ * @brief Appends a frame.
+ *
+ * @param frame The frame.
+ * @param captured The time it was captured.
+ * @throws std::runtime_error If the frame cannot be encoded or written.
+ */
+void SessionWriter::append(const cv::Mat& frame,
+                           LatencyClock::time_point captured) {
+    CV_Assert(out.is_open() && !frame.empty());
+
+    SessionRecord record = {};
+    memcpy(record.magic, SESSION_RECORD_MAGIC, sizeof(record.magic));
+    record.encoding = encoding;
+    record.rows = frame.rows;
+    record.cols = frame.cols;
+    record.type = frame.type();
+    record.timestampNs = toNs(captured);
+
+    const char* pixels;
+    cv::Mat continuous;
+    if (encoding == SESSION_PNG) {
+        if (!cv::imencode(".png", frame, buffer,
+                          {cv::IMWRITE_PNG_COMPRESSION,
+                           SESSION_PNG_COMPRESSION})) {
+            throw runtime_error("Cannot encode a frame of " + path);
+        }
+        pixels = reinterpret_cast<const char*>(buffer.data());
+        record.bytes = buffer.size();
+    } else {
+        // Gaps between rows are not stored
+        continuous = frame.isContinuous() ? frame : frame.clone();
+        pixels = reinterpret_cast<const char*>(continuous.data);
+        record.bytes = continuous.total() * continuous.elemSize();
+    }
+
+    out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    out.write(pixels, static_cast<streamsize>(record.bytes));
+    if (!out) {
+        throw runtime_error("Cannot write " + path);
+    }
+
+    index.push_back({offset, record.timestampNs});
+    offset += sizeof(record) + record.bytes;
+}
+
+/**
+ * @brief Writes the index and the final header. Called by the destructor.
+ *
+ * @throws std::runtime_error If the file cannot be written.
+ */
+void SessionWriter::close() {
+    if (!out.is_open()) {
+        return;
+    }
+
+    SessionHeader header = {};
+    memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_VERSION;
+    header.frames = index.size();
+    header.indexOffset = offset;
+
+    out.write(reinterpret_cast<const char*>(index.data()),
+              static_cast<streamsize>(index.size() * sizeof(index[0])));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        throw runtime_error("Cannot write " + path);
+    }
+}
+
+/**
+ * @brief Maps a session file and loads its index, or rebuilds it when the
+ * recording was not closed.
+ *
+ * @param path The path of the file.
+ * @throws std::runtime_error If the file cannot be mapped or is not a
+ * session.
+ */
+SessionReader::SessionReader(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(SessionHeader)) {
+        ::close(fd);
+        throw runtime_error(path + " is not a session");
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    // Read-only: the replay copies each frame out, so no page is ever
+    // dirtied and those already read can be dropped from memory
+    base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        throw runtime_error("Cannot map " + path);
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    SessionHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SESSION_VERSION) {
+        munmap(base, length);
+        base = nullptr;
+        throw runtime_error(path + " is not a session");
+    }
+
+    size_t indexBytes = header.frames * sizeof(SessionIndexEntry);
+    if (header.indexOffset >= sizeof(header) &&
+        header.indexOffset <= length &&
+        indexBytes <= length - header.indexOffset) {
+        const char* entries = static_cast<const char*>(base) +
+                              header.indexOffset;
+        index.resize(header.frames);
+        memcpy(index.data(), entries, indexBytes);
+    } else {
+        rebuildIndex();
+    }
+}
+
+SessionReader::~SessionReader() {
+    if (base != nullptr) {
+        munmap(base, length);
+    }
+}
+
+/**
+ * @brief Indexes the file by walking its records, up to the first one that
+ * is cut short or damaged.
+ */
+void SessionReader::rebuildIndex() {
+    index.clear();
+    const char* data = static_cast<const char*>(base);
+    size_t offset = sizeof(SessionHeader);
+    while (length - offset >= sizeof(SessionRecord)) {
+        SessionRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+        if (memcmp(record.magic, SESSION_RECORD_MAGIC,
+                   sizeof(record.magic)) != 0 ||
+            record.bytes > length - offset - sizeof(record)) {
+            break;
+        }
+        index.push_back({offset, record.timestampNs});
+        offset += sizeof(record) + record.bytes;
+    }
+}
+
+/**
+ * @brief Returns a frame.
+ *
+ * @param i The index of the frame.
+ * @param frame Receives a read-only view of a raw frame, or a decoded PNG
+ * frame.
+ * @return bool False when the frame cannot be decoded.
+ */
+bool SessionReader::frame(size_t i, cv::Mat& frame) const {
+    frame.release();
+    uint64_t offset = index[i].offset;
+    if (offset > length || length - offset < sizeof(SessionRecord)) {
+        return false;
+    }
+
+    char* data = static_cast<char*>(base) + offset;
+    SessionRecord record;
+    memcpy(&record, data, sizeof(record));
+    char* pixels = data + sizeof(record);
+    if (record.bytes > length - offset - sizeof(record)) {
+        return false;
+    }
+
+    if (record.encoding == SESSION_PNG) {
+        cv::Mat encoded(1, static_cast<int>(record.bytes), CV_8UC1, pixels);
+        frame = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+    } else if (record.encoding == SESSION_RAW && record.rows > 0 &&
+               record.cols > 0 &&
+               record.bytes == static_cast<uint64_t>(record.rows) *
+                                   record.cols *
+                                   CV_ELEM_SIZE(record.type)) {
+        // A view of the mapping: the pixels are not copied
+        frame = cv::Mat(record.rows, record.cols, record.type, pixels);
+    }
+    return !frame.empty();
+}
+
+/**
+ * @brief Reads the next frame, waiting until it is due at recorded speed.
+ * At recorded speed the first frame is due at once and each next one as
+ * long after it as it was recorded.
+ *
+ * @param frame Receives a copy of the frame; its buffer is reused when it
+ * has the frame's size and type.
+ * @param captured Receives the time the frame is replayed as captured.
+ * @return bool False after the last frame.
+ */
+bool SessionReplay::read(cv::Mat& frame, LatencyClock::time_point& captured) {
+    if (position >= reader.frameCount()) {
+        return false;
+    }
+
+    if (realtime) {
+        if (position == 0) {
+            start = LatencyClock::now();
+        }
+        chrono::nanoseconds offset(reader.timestampNs(position) -
+                                   reader.timestampNs(0));
+        captured = start + chrono::duration_cast<LatencyClock::duration>(
+                               offset);
+        this_thread::sleep_until(captured);
+    }
+
+    // Copied into the caller's buffer, which the scheduler hands back to be
+    // reused: the pipeline equalises and annotates frames in place, which
+    // on a view would copy every page of the mapping it touches
+    cv::Mat view;
+    if (!reader.frame(position, view)) {
+        return false;
+    }
+    view.copyTo(frame);
+    if (!realtime) {
+        captured = LatencyClock::now();
+    }
+    position++;
+    return true;
+}
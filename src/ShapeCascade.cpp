@@ -0,0 +1,145 @@
+/**
+ * @brief Cheap per-blob features that reject blobs before the shape tests.
+ */
+#include "ShapeCascade.hpp"
+
+#include <climits>
+#include <iomanip>
+
+#include "ShapeDetector.hpp"
+
+static const char* const CASCADE_STAGE_NAMES[CASCADE_STAGE_COUNT] = {
+    "area", "aspect", "convexity", "fill", "unrouted"};
+
+/**
+ * @brief Returns the name of a cascade stage ("area", ...).
+ */
+const char* cascadeStageName(CascadeStage stage) {
+    return stage >= 0 && stage < CASCADE_STAGE_COUNT
+               ? CASCADE_STAGE_NAMES[stage]
+               : "unknown";
+}
+
+/**
+ * @brief Prints the blobs rejected by each stage and routed to each test.
+ */
+void printCascadeReport(const CascadeCounters& counters, ostream& out) {
+    out << "Cascade over " << counters.blobs << " blobs" << endl;
+    ios::fmtflags flags = out.flags();
+    for (int stage = 0; stage < CASCADE_STAGE_COUNT; stage++) {
+        out << "  " << left << setw(14)
+            << cascadeStageName(static_cast<CascadeStage>(stage)) << right
+            << setw(9) << counters.rejected[stage] << " rejected" << endl;
+    }
+    out.flags(flags);
+    out << "  routed: " << counters.circles << " to circles, "
+        << counters.octagons << " to octagons, " << counters.squares
+        << " to squares" << endl;
+}
+
+/**
+ * @brief Measures the blobs of a labelled mask. The runs come in raster
+ * order, so the runs of a blob on one row are together: the row hull of a
+ * blob grows by the span of its previous row each time it starts a new one.
+ *
+ * @param runs The mask.
+ * @param labels The label of each run, from `RunMask::label`.
+ * @param count The number of labels.
+ * @return vector<BlobFeatures> The features of each label.
+ */
+vector<BlobFeatures> ShapeCascade::measure(const RunMask& runs,
+                                           const vector<int>& labels,
+                                           int count) {
+    CV_Assert(labels.size() == runs.runs().size());
+
+    vector<BlobFeatures> blobs(count);
+    // Per blob, the last row it was seen on and that row's span
+    vector<int> lastRow(count, -1);
+    vector<int> rowLeft(count), rowRight(count);
+    vector<cv::Point> low(count, cv::Point(INT_MAX, INT_MAX));
+    vector<cv::Point> high(count, cv::Point(INT_MIN, INT_MIN));
+
+    for (size_t i = 0; i < labels.size(); i++) {
+        const MaskRun& run = runs.runs()[i];
+        int blob = labels[i];
+        blobs[blob].area += run.end - run.start;
+        if (lastRow[blob] != run.row) {
+            if (lastRow[blob] >= 0) {
+                blobs[blob].hullArea += rowRight[blob] - rowLeft[blob];
+            }
+            lastRow[blob] = run.row;
+            rowLeft[blob] = run.start;
+        }
+        rowRight[blob] = run.end;
+
+        low[blob].x = min(low[blob].x, run.start);
+        low[blob].y = min(low[blob].y, run.row);
+        high[blob].x = max(high[blob].x, run.end);
+        high[blob].y = max(high[blob].y, run.row + 1);
+    }
+
+    for (int blob = 0; blob < count; blob++) {
+        if (lastRow[blob] >= 0) {
+            blobs[blob].hullArea += rowRight[blob] - rowLeft[blob];
+            blobs[blob].box = cv::Rect(low[blob], high[blob]);
+        }
+    }
+    return blobs;
+}
+
+/**
+ * @brief Runs a blob through the cascade. The stages reject what no sign
+ * can look like; the routes then follow the convexity of the outline, with
+ * the size limits the shape tests apply themselves.
+ *
+ * @param blob The features of the blob.
+ * @param counters When not null, the blob is counted against the stage that
+ * rejected it or the tests it was routed to.
+ * @return uint8_t The `ShapeRoute` bits of the tests the blob fits; 0 when
+ * it was rejected.
+ */
+uint8_t ShapeCascade::route(const BlobFeatures& blob,
+                            CascadeCounters* counters) {
+    int rejected = CASCADE_STAGE_COUNT;
+    uint8_t routes = 0;
+    if (blob.area < CASCADE_MIN_AREA) {
+        rejected = CASCADE_AREA;
+    } else if (blob.aspect() < CASCADE_MIN_ASPECT) {
+        rejected = CASCADE_ASPECT;
+    } else if (blob.convexity() < CASCADE_MIN_CONVEXITY) {
+        rejected = CASCADE_CONVEXITY;
+    } else if (blob.fill() < CASCADE_MIN_FILL) {
+        rejected = CASCADE_FILL;
+    } else {
+        double convexity = blob.convexity();
+        bool round = convexity >= CASCADE_ROUND_MIN_CONVEXITY &&
+                     convexity <= CASCADE_ROUND_MAX_CONVEXITY;
+        // The least area a circle of MIN_RADIUS passes the fill test with
+        double circleArea =
+            CASCADE_CIRCLE_MIN_FILL * CV_PI * MIN_RADIUS * MIN_RADIUS;
+        if (round && blob.area >= circleArea) {
+            routes |= SHAPE_ROUTE_CIRCLE;
+        }
+        if (round) {
+            routes |= SHAPE_ROUTE_OCTAGON;
+        }
+        if (convexity >= CASCADE_SQUARE_MIN_CONVEXITY &&
+            blob.box.area() > CASCADE_SQUARE_MIN_BOX_AREA) {
+            routes |= SHAPE_ROUTE_SQUARE;
+        }
+        if (routes == 0) {
+            rejected = CASCADE_UNROUTED;
+        }
+    }
+
+    if (counters != nullptr) {
+        counters->blobs++;
+        if (rejected < CASCADE_STAGE_COUNT) {
+            counters->rejected[rejected]++;
+        }
+        counters->circles += (routes & SHAPE_ROUTE_CIRCLE) != 0;
+        counters->octagons += (routes & SHAPE_ROUTE_OCTAGON) != 0;
+        counters->squares += (routes & SHAPE_ROUTE_SQUARE) != 0;
+    }
+    return routes;
+}
@@ -4,91 +4,252 @@
  */
 #include "ShapeDetector.hpp"
 
+CircleBackend ShapeDetector::circleBackend = CIRCLE_BACKEND_DEFAULT;
+
+/**
+ * @brief Closes small holes in the image and encodes it as runs.
+ *
+ * @param img The input image.
+ * @param regions When not null, the areas the closing runs on.
+ * @param morphSize The size of the structuring element.
+ * @return RunMask The closed image.
+ */
+RunMask ShapeDetector::closeComponents(const cv::Mat& img,
+                                       const vector<cv::Rect>* regions,
+                                       int morphSize) {
+    cv::Mat imgProcessed;
+
+    // Use morphological closing to close small holes in the image
+    cv::Mat element = cv::getStructuringElement(
+        cv::MORPH_RECT, cv::Size(2 * morphSize + 1, 2 * morphSize + 1),
+        cv::Point(morphSize, morphSize));
+    if (regions == nullptr) {
+        cv::morphologyEx(img, imgProcessed, cv::MORPH_CLOSE, element);
+    } else {
+        // Padded by the reach of the closing, so that each region comes out
+        // as it would on the whole image
+        cv::Rect frame(cv::Point(), img.size());
+        int reach = 2 * morphSize;
+        imgProcessed = cv::Mat::zeros(img.size(), CV_8UC1);
+        for (const cv::Rect& region : *regions) {
+            cv::Rect padded(region.x - reach, region.y - reach,
+                            region.width + 2 * reach,
+                            region.height + 2 * reach);
+            padded &= frame;
+
+            cv::Mat part;
+            cv::morphologyEx(img(padded), part, cv::MORPH_CLOSE, element);
+            part(region - padded.tl()).copyTo(imgProcessed(region));
+        }
+    }
+
+    return RunMask::encode(imgProcessed);
+}
+
 /**
  * @brief Removes small components from the image based on their area.
  *
  * @param img The input image.
+ * @param regions When not null, areas covering every set pixel of `img`
+ * with a margin wider than `morphSize` (see `TileOccupancy::regions`): the
+ * closing only runs on them.
  * @param minComponentArea The minimum area of the components to keep.
  * @param morphSize The size of the structuring element used for
  * morphological operations.
  * @return cv::Mat The image after removing small components.
  */
 cv::Mat ShapeDetector::removeSmallComponents(const cv::Mat& img,
+                                             const vector<cv::Rect>* regions,
                                              double minComponentArea,
                                              int morphSize) {
-    cv::Mat imgProcessed;
+    // Find connected components on the runs of the mask: one pass over
+    // them instead of one pass over the frame per component
+    RunMask runs = closeComponents(img, regions, morphSize);
+    vector<int> labels;
+    int numComponents = runs.label(labels, 4);
+    vector<BlobFeatures> blobs =
+        ShapeCascade::measure(runs, labels, numComponents);
 
-    // Use morphological closing to close small holes in the image
-    cv::Mat element = cv::getStructuringElement(
-        cv::MORPH_RECT, cv::Size(2 * morphSize + 1, 2 * morphSize + 1),
-        cv::Point(morphSize, morphSize));
-    cv::morphologyEx(img, imgProcessed, cv::MORPH_CLOSE, element);
+    // Keep the components whose area is large enough
+    vector<bool> keep(numComponents);
+    for (int i = 0; i < numComponents; i++) {
+        keep[i] = blobs[i].area >= minComponentArea;
+    }
 
-    // Find connected components
-    cv::Mat labels;
-    int numComponents = cv::connectedComponents(imgProcessed, labels, 4);
+    return runs.select(labels, keep).toDense();
+}
 
-    cv::Mat mask = cv::Mat::zeros(img.size(), CV_8UC1);
+/**
+ * @brief Returns the runs of the selected components and their bounds,
+ * padded by `SHAPE_ROI_MARGIN` so that edge and contour searches see the
+ * background around them.
+ */
+static RunMask selectCandidates(const RunMask& runs, const vector<int>& labels,
+                                const vector<bool>& keep,
+                                const vector<BlobFeatures>& blobs,
+                                cv::Rect& roi) {
+    roi = cv::Rect();
+    for (size_t i = 0; i < blobs.size(); i++) {
+        if (keep[i]) {
+            roi = roi.empty() ? blobs[i].box : (roi | blobs[i].box);
+        }
+    }
+    if (!roi.empty()) {
+        roi = cv::Rect(roi.x - SHAPE_ROI_MARGIN, roi.y - SHAPE_ROI_MARGIN,
+                       roi.width + 2 * SHAPE_ROI_MARGIN,
+                       roi.height + 2 * SHAPE_ROI_MARGIN) &
+              cv::Rect(cv::Point(), runs.size());
+    }
+    return runs.select(labels, keep);
+}
 
-    // For each component, if its area is large enough, draw it on the mask
-    for (int i = 1; i < numComponents; i++) {
-        cv::Mat component = (labels == i);
+/**
+ * @brief Removes small components from the image, as `removeSmallComponents`
+ * does, and runs the others through the `ShapeCascade`. Each shape test then
+ * only sees the components that could pass it. The candidates stay as runs,
+ * so no image of the frame's size is made for them.
+ *
+ * @param img The input image.
+ * @param regions When not null, areas covering every set pixel of `img`
+ * with a margin wider than `morphSize`: the closing only runs on them.
+ * @param counters When not null, receives the outcome of the cascade.
+ * @param minComponentArea The minimum area of the components to keep.
+ * @param morphSize The size of the structuring element used for
+ * morphological operations.
+ * @return ShapeCandidateRuns The components kept, and those routed to each
+ * shape test.
+ */
+ShapeCandidateRuns ShapeDetector::findCandidates(
+    const cv::Mat& img, const vector<cv::Rect>* regions,
+    CascadeCounters* counters, double minComponentArea, int morphSize) {
+    return routeCandidates(closeComponents(img, regions, morphSize), counters,
+                           minComponentArea);
+}
 
-        double area = cv::countNonZero(component);
+/**
+ * @brief Runs the components of a closed mask through the `ShapeCascade`,
+ * as `findCandidates` does once it has closed the image, and keeps the
+ * candidates as runs.
+ *
+ * @param runs The closed mask.
+ * @param counters When not null, receives the outcome of the cascade.
+ * @param minComponentArea The minimum area of the components to keep.
+ * @return ShapeCandidateRuns The components kept, and those routed to each
+ * shape test.
+ */
+ShapeCandidateRuns ShapeDetector::routeCandidates(const RunMask& runs,
+                                                  CascadeCounters* counters,
+                                                  double minComponentArea) {
+    vector<int> labels;
+    int numComponents = runs.label(labels, 4);
+    vector<BlobFeatures> blobs =
+        ShapeCascade::measure(runs, labels, numComponents);
 
-        // Skip if component area is less than threshold
-        if (area < minComponentArea) {
+    vector<bool> keep(numComponents), circles(numComponents),
+        octagons(numComponents), squares(numComponents);
+    for (int i = 0; i < numComponents; i++) {
+        keep[i] = blobs[i].area >= minComponentArea;
+        if (!keep[i]) {
             continue;
         }
-
-        mask = mask | component;
+        uint8_t routes = ShapeCascade::route(blobs[i], counters);
+        circles[i] = (routes & SHAPE_ROUTE_CIRCLE) != 0;
+        octagons[i] = (routes & SHAPE_ROUTE_OCTAGON) != 0;
+        squares[i] = (routes & SHAPE_ROUTE_SQUARE) != 0;
     }
 
-    return mask;
+    ShapeCandidateRuns candidates;
+    candidates.mask = runs.select(labels, keep);
+    candidates.circles = selectCandidates(runs, labels, circles, blobs,
+                                          candidates.circleRoi);
+    candidates.octagons = selectCandidates(runs, labels, octagons, blobs,
+                                           candidates.octagonRoi);
+    candidates.squares = selectCandidates(runs, labels, squares, blobs,
+                                          candidates.squareRoi);
+    return candidates;
 }
 
 /**
- * @brief Detects circles in the input image.
+ * @brief Selects the circle detector of `detectCircles` for the whole
+ * process. Call it before detection starts.
  *
- * @param img The input image.
- * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> A vector of pairs,
- * each consisting of a circle and its centroid.
+ * @param backend The circle detector.
  */
-vector<pair<cv::Vec3f, cv::Point2f>> ShapeDetector::detectCircles(
-    const cv::Mat& img) {
+void ShapeDetector::setCircleBackend(CircleBackend backend) {
+    circleBackend = backend;
+}
+
+/**
+ * @brief Runs the circle detector chosen by `setCircleBackend` on a mask.
+ *
+ * @param view The mask to search.
+ * @param minDist The minimum distance between the centers of two circles.
+ * @return vector<cv::Vec3f> The circles, in the coordinates of `view`.
+ */
+vector<cv::Vec3f> ShapeDetector::houghCircles(const cv::Mat& view,
+                                              int minDist) {
     vector<cv::Vec3f> circles;
-    cv::HoughCircles(img, circles, cv::HOUGH_GRADIENT, 1, img.rows / 8,
-                     CIRCLE_DETECTION_PARAM1, CIRCLE_DETECTION_PARAM2,
-                     MIN_RADIUS, MAX_RADIUS);
+    if (circleBackend == CIRCLE_BACKEND_CONTOUR) {
+        CircleHough::detect(view, circles, minDist, MIN_RADIUS, MAX_RADIUS);
+    } else {
+        cv::HoughCircles(view, circles, cv::HOUGH_GRADIENT, 1, minDist,
+                         CIRCLE_DETECTION_PARAM1, CIRCLE_DETECTION_PARAM2,
+                         MIN_RADIUS, MAX_RADIUS);
+    }
+    return circles;
+}
 
+/**
+ * @brief Keeps the circles whose disc is filled by the mask to the extent
+ * of a sign, each with the centroid of the mask inside it. Each circle is
+ * checked on the runs of the mask around it rather than on a copy of the
+ * whole frame.
+ *
+ * @param circles The circles found on `runs`.
+ * @param runs The mask searched.
+ * @param offset The position of `runs` in the frame.
+ * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> The circles kept
+ * and their centroids, in frame coordinates.
+ */
+static vector<pair<cv::Vec3f, cv::Point2f>> checkCircles(
+    const vector<cv::Vec3f>& circles, const RunMask& runs, cv::Point offset) {
     vector<pair<cv::Vec3f, cv::Point2f>> result;
+    cv::Rect frame(cv::Point(), runs.size());
 
     for (const auto& circle : circles) {
         if (circle[2] < 30 || circle[2] > 500) {
             continue;
         }
-        cv::Mat circleMask = cv::Mat::zeros(img.rows, img.cols, CV_8U);
-        cv::circle(circleMask, cv::Point(circle[0], circle[1]), circle[2],
-                   cv::Scalar(255), -1);
-
-        cv::Mat maskedImg;
-        img.copyTo(maskedImg, circleMask);
+        cv::Point center(circle[0], circle[1]);
+        int radius = circle[2];
+        cv::Rect box = cv::Rect(center.x - radius, center.y - radius,
+                                2 * radius + 1, 2 * radius + 1) &
+                       frame;
+        if (box.empty()) {
+            continue;
+        }
+        cv::Mat circleMask = cv::Mat::zeros(box.size(), CV_8U);
+        cv::circle(circleMask, center - box.tl(), radius, cv::Scalar(255),
+                   -1);
+        RunMask inside =
+            runs.crop(box).intersection(RunMask::encode(circleMask));
 
         double expectedArea = CV_PI * circle[2] * circle[2];
-        double actualArea =
-            cv::countNonZero(maskedImg);  // count the number of white
-                                          // pixels inside the circle
+        // count the number of white pixels inside the circle
+        double actualArea = static_cast<double>(inside.area());
 
         if (actualArea / expectedArea > 0.6 &&
             actualArea / expectedArea < 0.84) {
-            cout << actualArea / expectedArea << endl;
-            cv::Moments mu = cv::moments(
-                maskedImg,
-                false);  // compute the moments of the masked binary image
-            cv::Point2f mc =
-                cv::Point2f(static_cast<float>(mu.m10 / (mu.m00 + 1e-5)),
-                            static_cast<float>(mu.m01 / (mu.m00 + 1e-5)));
-            result.emplace_back(circle, mc);
+            // compute the moments of the mask inside the circle
+            cv::Moments mu = inside.moments();
+            cv::Point2f mc = cv::Point2f(
+                static_cast<float>(mu.m10 / (mu.m00 + 1e-5) + box.x +
+                                   offset.x),
+                static_cast<float>(mu.m01 / (mu.m00 + 1e-5) + box.y +
+                                   offset.y));
+            cv::Vec3f found(circle[0] + offset.x, circle[1] + offset.y,
+                            circle[2]);
+            result.emplace_back(found, mc);
         }
     }
 
@@ -96,19 +257,74 @@ vector<pair<cv::Vec3f, cv::Point2f>> ShapeDetector::detectCircles(
 }
 
 /**
- * @brief Detects octagons in the input image.
+ * @brief Detects circles in the input image, with the detector chosen by
+ * `setCircleBackend`.
  *
  * @param img The input image.
+ * @param roi The only part of `img` that can hold set pixels; the search is
+ * limited to it.
+ * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> A vector of pairs,
+ * each consisting of a circle and its centroid.
+ */
+vector<pair<cv::Vec3f, cv::Point2f>> ShapeDetector::detectCircles(
+    const cv::Mat& img, cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), img.size());
+    if (roi.empty()) {
+        return {};
+    }
+    cv::Mat view = img(roi);
+
+    // The minimum distance stays that of the whole image
+    vector<cv::Vec3f> circles = houghCircles(view, img.rows / 8);
+    if (circles.empty()) {
+        return {};
+    }
+    return checkCircles(circles, RunMask::encode(view), roi.tl());
+}
+
+/**
+ * @brief Detects circles in a mask kept as runs, as `detectCircles` does on
+ * the image of the mask. Only the part inside `roi` is made an image.
+ *
+ * @param mask The input mask.
+ * @param roi The only part of `mask` that can hold set pixels; the search
+ * is limited to it.
+ * @return std::vector<std::pair<cv::Vec3f, cv::Point2f>> A vector of pairs,
+ * each consisting of a circle and its centroid.
+ */
+vector<pair<cv::Vec3f, cv::Point2f>> ShapeDetector::detectCircles(
+    const RunMask& mask, cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), mask.size());
+    if (roi.empty()) {
+        return {};
+    }
+    RunMask part = mask.crop(roi);
+
+    vector<cv::Vec3f> circles =
+        houghCircles(part.toDense(), mask.size().height / 8);
+    if (circles.empty()) {
+        return {};
+    }
+    return checkCircles(circles, part, roi.tl());
+}
+
+/**
+ * @brief Finds the octagons among the contours of a mask.
+ *
+ * @param view The mask to search.
  * @param minPerimeter The minimum perimeter of the octagons to detect.
- * @return std::vector<std::vector<cv::Point>> A vector of detected
- * octagons, each represented by a vector of its vertices.
+ * @param offset The position of `view` in the frame.
+ * @return std::vector<std::vector<cv::Point>> The vertices of each octagon,
+ * in frame coordinates.
  */
-vector<vector<cv::Point>> ShapeDetector::detectOctagons(const cv::Mat& img,
-                                                        double minPerimeter) {
+static vector<vector<cv::Point>> findOctagons(const cv::Mat& view,
+                                              double minPerimeter,
+                                              cv::Point offset) {
+    vector<vector<cv::Point>> octagons;
     vector<vector<cv::Point>> contours;
-    cv::findContours(img, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    cv::findContours(view, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE,
+                     offset);
 
-    vector<vector<cv::Point>> octagons;
     for (const auto& contour : contours) {
         double contourLength = cv::arcLength(contour, true);
 
@@ -145,19 +361,62 @@ vector<vector<cv::Point>> ShapeDetector::detectOctagons(const cv::Mat& img,
 }
 
 /**
- * @brief Detects squares in the input image.
+ * @brief Detects octagons in the input image.
  *
  * @param img The input image.
- * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> A
- * vector of pairs, each consisting of a square and its centroid.
+ * @param minPerimeter The minimum perimeter of the octagons to detect.
+ * @param roi The only part of `img` that can hold set pixels; the search is
+ * limited to it.
+ * @return std::vector<std::vector<cv::Point>> A vector of detected
+ * octagons, each represented by a vector of its vertices.
  */
-vector<pair<vector<cv::Point>, cv::Point2f>> ShapeDetector::detectSquares(
-    const cv::Mat& img) {
-    vector<vector<cv::Point>> contours;
-    cv::findContours(img.clone(), contours, cv::RETR_TREE,
-                     cv::CHAIN_APPROX_SIMPLE);
+vector<vector<cv::Point>> ShapeDetector::detectOctagons(const cv::Mat& img,
+                                                        double minPerimeter,
+                                                        cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), img.size());
+    if (roi.empty()) {
+        return {};
+    }
+    return findOctagons(img(roi), minPerimeter, roi.tl());
+}
 
+/**
+ * @brief Detects octagons in a mask kept as runs, as `detectOctagons` does
+ * on the image of the mask. Only the part inside `roi` is made an image.
+ *
+ * @param mask The input mask.
+ * @param minPerimeter The minimum perimeter of the octagons to detect.
+ * @param roi The only part of `mask` that can hold set pixels; the search
+ * is limited to it.
+ * @return std::vector<std::vector<cv::Point>> A vector of detected
+ * octagons, each represented by a vector of its vertices.
+ */
+vector<vector<cv::Point>> ShapeDetector::detectOctagons(const RunMask& mask,
+                                                        double minPerimeter,
+                                                        cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), mask.size());
+    if (roi.empty()) {
+        return {};
+    }
+    return findOctagons(mask.crop(roi).toDense(), minPerimeter, roi.tl());
+}
+
+/**
+ * @brief Finds the squares among the contours of a mask.
+ *
+ * @param view The mask to search.
+ * @param offset The position of `view` in the frame.
+ * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> Each
+ * square and the center of mass of the mask pixels inside it, in frame
+ * coordinates.
+ */
+static vector<pair<vector<cv::Point>, cv::Point2f>> findSquares(
+    const cv::Mat& view, cv::Point offset) {
     vector<pair<vector<cv::Point>, cv::Point2f>> squares;
+    vector<vector<cv::Point>> contours;
+    // Older OpenCV versions modify the image they search
+    cv::findContours(view.clone(), contours, cv::RETR_TREE,
+                     cv::CHAIN_APPROX_SIMPLE, offset);
 
     for (const auto& contour : contours) {
         vector<cv::Point> approx;
@@ -174,14 +433,66 @@ vector<pair<vector<cv::Point>, cv::Point2f>> ShapeDetector::detectSquares(
             double min_side = *min_element(sides.begin(), sides.end());
 
             if (max_side <= 1.2 * min_side) {
-                cv::Moments m = cv::moments(contour, false);
+                // The pictogram is the hole in the mask: the moments of the
+                // outline alone only give the middle of the square
+                cv::Rect box = cv::boundingRect(approx) - offset;
+                box &= cv::Rect(cv::Point(), view.size());
+                cv::Mat inside = cv::Mat::zeros(box.size(), CV_8U);
+                cv::fillPoly(inside, vector<vector<cv::Point>>{approx},
+                             cv::Scalar(255), cv::LINE_8, 0,
+                             -offset - box.tl());
+                inside &= view(box);
+
+                cv::Moments m = cv::moments(inside, true);
+                cv::Point2f origin = offset + box.tl();
                 squares.emplace_back(
                     approx,
-                    cv::Point2f(static_cast<float>(m.m10 / (m.m00 + 1e-5)),
-                                static_cast<float>(m.m01 / (m.m00 + 1e-5))));
+                    cv::Point2f(
+                        static_cast<float>(m.m10 / (m.m00 + 1e-5)) + origin.x,
+                        static_cast<float>(m.m01 / (m.m00 + 1e-5)) +
+                            origin.y));
             }
         }
     }
 
     return squares;
 }
+
+/**
+ * @brief Detects squares in the input image.
+ *
+ * @param img The input image.
+ * @param roi The only part of `img` that can hold set pixels; the search is
+ * limited to it.
+ * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> A
+ * vector of pairs, each consisting of a square and the center of mass of
+ * the pixels inside it.
+ */
+vector<pair<vector<cv::Point>, cv::Point2f>> ShapeDetector::detectSquares(
+    const cv::Mat& img, cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), img.size());
+    if (roi.empty()) {
+        return {};
+    }
+    return findSquares(img(roi), roi.tl());
+}
+
+/**
+ * @brief Detects squares in a mask kept as runs, as `detectSquares` does on
+ * the image of the mask. Only the part inside `roi` is made an image.
+ *
+ * @param mask The input mask.
+ * @param roi The only part of `mask` that can hold set pixels; the search
+ * is limited to it.
+ * @return std::vector<std::pair<std::vector<cv::Point>, cv::Point2f>> A
+ * vector of pairs, each consisting of a square and the center of mass of
+ * the pixels inside it.
+ */
+vector<pair<vector<cv::Point>, cv::Point2f>> ShapeDetector::detectSquares(
+    const RunMask& mask, cv::Rect roi) {
+    roi &= cv::Rect(cv::Point(), mask.size());
+    if (roi.empty()) {
+        return {};
+    }
+    return findSquares(mask.crop(roi).toDense(), roi.tl());
+}
@@ -0,0 +1,64 @@
+/**
+ * @brief Names of the pipeline stages timed through `StageTimings`.
+ */
+#include "StageTimings.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+    "prepare",      "classify",      "red_mask",        "blue_mask",
+    "red_cleanup",  "blue_cleanup",  "blue_circles",    "red_circles",
+    "octagons",     "squares",       "annotate"};
+
+/**
+ * @brief Returns the name of a pipeline stage ("prepare", ...).
+ */
+const char* stageName(PipelineStage stage) {
+    return stage >= 0 && stage < STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+/**
+ * @brief Prints, per stage, the mean time per frame and, when hardware
+ * counters were sampled, the IPC and the cache and branch misses per pixel,
+ * then the outcome of the shape cascade.
+ */
+void printStageReport(const StageTimings& timings, ostream& out) {
+    bool hardware = timings.perf != nullptr && timings.perf->available();
+    double frames = static_cast<double>(max<uint64_t>(timings.frames, 1));
+    double pixels = static_cast<double>(max<uint64_t>(timings.pixels, 1));
+
+    out << "Stage report over " << timings.frames << " frames" << endl;
+    if (timings.perf != nullptr && !hardware) {
+        out << "  hardware counters unavailable ("
+            << timings.perf->reason() << "); wall-clock only" << endl;
+    }
+
+    ios::fmtflags flags = out.flags();
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        const PerfSample& sample = timings.counters[stage];
+        out << "  " << left << setw(14)
+            << stageName(static_cast<PipelineStage>(stage)) << right << fixed
+            << setprecision(3) << setw(9) << timings.ms[stage] / frames
+            << " ms/frame";
+        if (hardware) {
+            double cycles = static_cast<double>(sample.value[PERF_CYCLES]);
+            double instructions =
+                static_cast<double>(sample.value[PERF_INSTRUCTIONS]);
+            out << setprecision(2) << "  IPC " << setw(5)
+                << (cycles > 0 ? instructions / cycles : 0.0)
+                << setprecision(4);
+            if (timings.perf->has(PERF_CACHE_MISSES)) {
+                out << "  cache-miss/px " << setw(8)
+                    << sample.value[PERF_CACHE_MISSES] / pixels;
+            }
+            if (timings.perf->has(PERF_BRANCH_MISSES)) {
+                out << "  branch-miss/px " << setw(8)
+                    << sample.value[PERF_BRANCH_MISSES] / pixels;
+            }
+        }
+        out << endl;
+    }
+    out.flags(flags);
+    printCascadeReport(timings.cascade, out);
+}
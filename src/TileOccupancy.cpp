@@ -0,0 +1,155 @@
+/**
+ * @brief Per-tile counts of the colour classes of a class-bits image.
+ */
+#include "TileOccupancy.hpp"
+
+#include <algorithm>
+#include <array>
+
+/**
+ * @brief Returns, for each class-bits value, one byte lane per class holding
+ * that class's bit. Adding the lanes of up to 255 pixels counts every class
+ * at once without overflowing a lane.
+ */
+static const array<uint64_t, 256>& laneTable() {
+    static const array<uint64_t, 256> lanes = [] {
+        array<uint64_t, 256> table;
+        for (int value = 0; value < 256; value++) {
+            uint64_t spread = 0;
+            for (int c = 0; c < COLOR_CLASS_COUNT; c++) {
+                spread |= static_cast<uint64_t>((value >> c) & 1) << (8 * c);
+            }
+            table[value] = spread;
+        }
+        return table;
+    }();
+    return lanes;
+}
+
+/**
+ * @brief Clears the counts for a class-bits image of the given size.
+ */
+void TileOccupancy::reset(cv::Size size) {
+    frame = size;
+    int tile = OCCUPANCY_TILE_SIZE;
+    tiles = cv::Size((size.width + tile - 1) / tile,
+                     (size.height + tile - 1) / tile);
+    counts.assign(static_cast<size_t>(tiles.area()) * COLOR_CLASS_COUNT, 0);
+}
+
+/**
+ * @brief Adds one row of class bits to the counts. The pixels of a row
+ * within one tile are summed in byte lanes, then spread to the classes.
+ *
+ * @param y The row.
+ * @param bits The class bits of the row.
+ */
+void TileOccupancy::addRow(int y, const uint8_t* bits) {
+    static_assert(OCCUPANCY_TILE_SIZE < 256, "a tile row must fit a lane");
+    const array<uint64_t, 256>& lanes = laneTable();
+
+    size_t tileY = static_cast<size_t>(y / OCCUPANCY_TILE_SIZE);
+    int32_t* row = counts.data() + tileY * tiles.width * COLOR_CLASS_COUNT;
+    for (int tileX = 0; tileX < tiles.width; tileX++) {
+        int start = tileX * OCCUPANCY_TILE_SIZE;
+        int end = min(start + OCCUPANCY_TILE_SIZE, frame.width);
+        uint64_t sum = 0;
+        for (int x = start; x < end; x++) {
+            sum += lanes[bits[x]];
+        }
+        if (sum == 0) {
+            continue;
+        }
+        int32_t* tile = row + tileX * COLOR_CLASS_COUNT;
+        for (int c = 0; c < COLOR_CLASS_COUNT; c++) {
+            tile[c] += static_cast<int32_t>((sum >> (8 * c)) & 0xFF);
+        }
+    }
+}
+
+/**
+ * @brief Returns the share of tiles holding a pixel of any class in
+ * `classes`, a set of class bits.
+ */
+double TileOccupancy::occupiedRatio(uint8_t classes) const {
+    if (tiles.area() == 0) {
+        return 0.0;
+    }
+    int occupied = 0;
+    for (int i = 0; i < tiles.area(); i++) {
+        occupied += holds(i, classes) ? 1 : 0;
+    }
+    return static_cast<double>(occupied) / tiles.area();
+}
+
+/**
+ * @brief Returns rectangles, in pixels, that together cover every pixel
+ * within one tile of a pixel of any class in `classes`. The occupied tiles
+ * are grown by one tile, grouped into 8-connected groups on the tile grid,
+ * and each group becomes its bounding box. Above `OCCUPANCY_DENSE_RATIO` it
+ * is the whole frame.
+ *
+ * @param classes A set of class bits, e.g. `1 << COLOR_RED`.
+ * @return vector<cv::Rect> The regions; empty when no pixel is of those
+ * classes.
+ */
+vector<cv::Rect> TileOccupancy::regions(uint8_t classes) const {
+    vector<cv::Rect> result;
+    double ratio = occupiedRatio(classes);
+    if (ratio == 0.0) {
+        return result;
+    }
+    cv::Rect frameRect(cv::Point(), frame);
+    if (ratio > OCCUPANCY_DENSE_RATIO) {
+        result.push_back(frameRect);
+        return result;
+    }
+
+    cv::Mat occupied(tiles, CV_8UC1);
+    for (int i = 0; i < tiles.area(); i++) {
+        occupied.at<uint8_t>(i / tiles.width, i % tiles.width) =
+            holds(i, classes) ? 255 : 0;
+    }
+    cv::dilate(occupied, occupied,
+               cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+
+    cv::Mat labels, stats, centroids;
+    int groups =
+        cv::connectedComponentsWithStats(occupied, labels, stats, centroids, 8);
+    for (int i = 1; i < groups; i++) {
+        cv::Rect box(stats.at<int>(i, cv::CC_STAT_LEFT) * OCCUPANCY_TILE_SIZE,
+                     stats.at<int>(i, cv::CC_STAT_TOP) * OCCUPANCY_TILE_SIZE,
+                     stats.at<int>(i, cv::CC_STAT_WIDTH) * OCCUPANCY_TILE_SIZE,
+                     stats.at<int>(i, cv::CC_STAT_HEIGHT) *
+                         OCCUPANCY_TILE_SIZE);
+        result.push_back(box & frameRect);
+    }
+    return result;
+}
+
+/**
+ * @brief Whether a tile, by index in raster order, holds a pixel of any
+ * class in `classes`.
+ */
+bool TileOccupancy::holds(int tile, uint8_t classes) const {
+    const int32_t* count = counts.data() + tile * COLOR_CLASS_COUNT;
+    for (int c = 0; c < COLOR_CLASS_COUNT; c++) {
+        if ((classes >> c & 1) != 0 && count[c] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the bounding box of a set of regions; empty without any.
+ */
+cv::Rect TileOccupancy::bounds(const vector<cv::Rect>& regions) {
+    cv::Rect box;
+    for (const cv::Rect& region : regions) {
+        if (!region.empty()) {
+            box = box.empty() ? region : (box | region);
+        }
+    }
+    return box;
+}
@@ -0,0 +1,189 @@
+/**
+ * @brief This class archives annotated frames through a bounded queue and a
+ * dedicated encoder thread.
+ */
+#include "VideoSink.hpp"
+
+#include <iostream>
+#include <utility>
+
+/**
+ * @brief Starts the encoder thread. The writers are opened on the first
+ * frame, once the frame size is known; when one cannot be opened, the sink
+ * says so on the standard error and counts the frames it loses.
+ */
+VideoSink::VideoSink(VideoSinkConfig config) : config(std::move(config)) {
+    if (this->config.mode == SINK_AROUND_DETECTIONS) {
+        // The pre-roll is flushed all at once when a detection arrives
+        this->config.queueCapacity =
+            max(this->config.queueCapacity,
+                static_cast<size_t>(max(this->config.preRoll, 0)) + 1);
+    }
+    worker = thread(&VideoSink::encodeLoop, this);
+}
+
+VideoSink::~VideoSink() { close(); }
+
+/**
+ * @brief Writes the queued frames and closes the files. Called by the
+ * destructor.
+ */
+void VideoSink::close() {
+    {
+        lock_guard<mutex> guard(lock);
+        closing = true;
+    }
+    itemReady.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Offers a frame to the sink. Never waits for the encoder.
+ *
+ * @param frame The annotated frame; copied if it is kept.
+ * @param mask The mask of the frame, or an empty Mat.
+ * @param hasDetections Whether the frame has detections, for
+ * `SINK_AROUND_DETECTIONS`.
+ */
+void VideoSink::push(const cv::Mat& frame, const cv::Mat& mask,
+                     bool hasDetections) {
+    uint64_t index = frameIndex++;
+    {
+        lock_guard<mutex> guard(lock);
+        counters.submitted++;
+    }
+
+    bool keepMask = !config.maskPath.empty() && !mask.empty();
+
+    if (config.mode == SINK_ALL) {
+        if (index % max(config.decimation, 1) != 0) {
+            return;
+        }
+        enqueue({frame.clone(), keepMask ? mask.clone() : cv::Mat()});
+        return;
+    }
+
+    if (hasDetections) {
+        // Write out the frames leading up to the detection first
+        while (!preRoll.empty()) {
+            enqueue(std::move(preRoll.front()));
+            preRoll.pop_front();
+        }
+        postRollLeft = config.postRoll;
+        enqueue({frame.clone(), keepMask ? mask.clone() : cv::Mat()});
+    } else if (postRollLeft > 0) {
+        postRollLeft--;
+        enqueue({frame.clone(), keepMask ? mask.clone() : cv::Mat()});
+    } else if (config.preRoll > 0) {
+        // Recycle the oldest buffers instead of allocating new ones
+        Item item;
+        if (static_cast<int>(preRoll.size()) >= config.preRoll) {
+            item = std::move(preRoll.front());
+            preRoll.pop_front();
+        }
+        frame.copyTo(item.frame);
+        if (keepMask) {
+            mask.copyTo(item.mask);
+        } else {
+            // A recycled item may still hold the mask of an older frame
+            item.mask.release();
+        }
+        preRoll.push_back(std::move(item));
+    }
+}
+
+/**
+ * @brief Adds a selected frame to the queue, applying the drop policy when
+ * the queue is full.
+ */
+void VideoSink::enqueue(Item item) {
+    {
+        lock_guard<mutex> guard(lock);
+        counters.selected++;
+        if (queue.size() >= max(config.queueCapacity, size_t(1))) {
+            counters.dropped++;
+            if (config.dropPolicy == SINK_DROP_NEWEST) {
+                return;
+            }
+            queue.pop_front();
+        }
+        queue.push_back(std::move(item));
+    }
+    itemReady.notify_one();
+}
+
+/**
+ * @brief Encodes queued frames until the sink is closed and the queue is
+ * empty.
+ */
+void VideoSink::encodeLoop() {
+    cv::VideoWriter writer, maskWriter;
+    cv::Size maskSize;
+    // A writer that did not open is not retried on every frame
+    bool writerFailed = false, maskWriterFailed = false;
+
+    while (true) {
+        Item item;
+        {
+            unique_lock<mutex> guard(lock);
+            itemReady.wait(guard, [this] { return closing || !queue.empty(); });
+            if (queue.empty()) {
+                break;
+            }
+            item = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        if (!writer.isOpened() && !writerFailed) {
+            writer.open(config.path, config.fourcc, config.fps,
+                        item.frame.size(), item.frame.channels() == 3);
+            if (!writer.isOpened()) {
+                cerr << "VideoSink: cannot open " << config.path
+                     << " for writing" << endl;
+                writerFailed = true;
+            }
+        }
+        if (writer.isOpened()) {
+            writer.write(item.frame);
+        }
+
+        if (!item.mask.empty() && !maskWriterFailed) {
+            if (!maskWriter.isOpened()) {
+                maskSize = item.mask.size();
+                maskWriter.open(config.maskPath, config.fourcc, config.fps,
+                                maskSize, false);
+                if (!maskWriter.isOpened()) {
+                    cerr << "VideoSink: cannot open " << config.maskPath
+                         << " for writing" << endl;
+                    maskWriterFailed = true;
+                }
+            }
+            if (maskWriter.isOpened()) {
+                // Masks shrink at reduced quality levels; keep one stream
+                // size
+                if (item.mask.size() != maskSize) {
+                    cv::resize(item.mask, item.mask, maskSize, 0, 0,
+                               cv::INTER_NEAREST);
+                }
+                maskWriter.write(item.mask);
+            }
+        }
+
+        lock_guard<mutex> guard(lock);
+        if (writer.isOpened()) {
+            counters.written++;
+        } else {
+            counters.failed++;
+        }
+    }
+
+    writer.release();
+    maskWriter.release();
+}
+
+SinkStats VideoSink::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
@@ -0,0 +1,320 @@
+/**
+ * @brief Raw YUV frames, their colour classification straight from YUV, and
+ * a reader for raw YUV files.
+ */
+#include "YuvFrame.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <vector>
+
+#include "ColorClassifier.hpp"
+
+// Fixed-point BT.601 coefficients of OpenCV's YUV to BGR conversions
+#define YUV_COEFF_Y 1220542
+#define YUV_COEFF_UB 2116026
+#define YUV_COEFF_UG -409993
+#define YUV_COEFF_VG -852492
+#define YUV_COEFF_VR 1673527
+#define YUV_COEFF_SHIFT 20
+
+#define YUV_LUT_SHIFT (8 - YUV_LUT_BITS)
+#define YUV_LUT_SIZE (1 << (3 * YUV_LUT_BITS))
+
+/**
+ * @brief Parses a format name ("yuyv", "nv12" or "i420").
+ *
+ * @return bool False when the name is not a known format.
+ */
+bool parseYuvFormat(const string& name, YuvFormat& format) {
+    string lower = name;
+    transform(lower.begin(), lower.end(), lower.begin(),
+              [](unsigned char c) { return tolower(c); });
+
+    if (lower == "yuyv" || lower == "yuy2") {
+        format = YUV_YUYV;
+    } else if (lower == "nv12") {
+        format = YUV_NV12;
+    } else if (lower == "i420" || lower == "yuv420p") {
+        format = YUV_I420;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the size in bytes of one frame.
+ */
+size_t yuvFrameBytes(YuvFormat format, int width, int height) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    return format == YUV_YUYV ? 2 * pixels : pixels * 3 / 2;
+}
+
+/**
+ * @brief Wraps a buffer holding one frame, without copying it.
+ */
+YuvFrame::YuvFrame(YuvFormat format, int width, int height, void* buffer)
+    : format(format), width(width), height(height) {
+    CV_Assert(width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0);
+    if (format == YUV_YUYV) {
+        data = cv::Mat(height, width, CV_8UC2, buffer);
+    } else {
+        data = cv::Mat(height * 3 / 2, width, CV_8UC1, buffer);
+    }
+}
+
+/**
+ * @brief Equalises the histogram of the Y plane in place. This is the YUV
+ * counterpart of the V-channel equalisation of the BGR path.
+ */
+void YuvFrame::equalizeLuma() {
+    if (format == YUV_YUYV) {
+        cv::Mat luma;
+        cv::extractChannel(data, luma, 0);
+        cv::equalizeHist(luma, luma);
+        cv::insertChannel(luma, data, 0);
+    } else {
+        cv::Mat luma = data.rowRange(0, height);
+        cv::equalizeHist(luma, luma);
+    }
+}
+
+/**
+ * @brief Converts the frame to BGR, e.g. to draw an overlay on it.
+ */
+void YuvFrame::toBgr(cv::Mat& bgr) const {
+    static const int codes[YUV_FORMAT_COUNT] = {cv::COLOR_YUV2BGR_YUYV,
+                                                cv::COLOR_YUV2BGR_NV12,
+                                                cv::COLOR_YUV2BGR_I420};
+    cv::cvtColor(data, bgr, codes[format]);
+}
+
+/**
+ * @brief Classifies one YUV pixel exactly: converts it to BGR with the
+ * fixed-point arithmetic of `cv::cvtColor` and classifies the result.
+ *
+ * @return uint8_t Bit `i` is set when the pixel belongs to class `i`.
+ */
+uint8_t YuvClassifier::classifyPixel(uint8_t y, uint8_t u, uint8_t v) {
+    int luma = max(0, y - 16) * YUV_COEFF_Y + (1 << (YUV_COEFF_SHIFT - 1));
+    int du = u - 128;
+    int dv = v - 128;
+
+    uint8_t r = cv::saturate_cast<uint8_t>(
+        (luma + YUV_COEFF_VR * dv) >> YUV_COEFF_SHIFT);
+    uint8_t g = cv::saturate_cast<uint8_t>(
+        (luma + YUV_COEFF_VG * dv + YUV_COEFF_UG * du) >> YUV_COEFF_SHIFT);
+    uint8_t b = cv::saturate_cast<uint8_t>(
+        (luma + YUV_COEFF_UB * du) >> YUV_COEFF_SHIFT);
+
+    return ColorClassifier::classifyBgrPixel(b, g, r);
+}
+
+/**
+ * @brief Returns the cell table, built on first use. Each cell holds the
+ * class bits of its YUV values when they all agree, and
+ * `YUV_LUT_AMBIGUOUS` otherwise.
+ */
+const uint8_t* YuvClassifier::table() {
+    static_assert(COLOR_CLASS_COUNT < 8,
+                  "the top bit of a cell flags ambiguous cells");
+
+    static const vector<uint8_t> cells = [] {
+        vector<uint8_t> lut(YUV_LUT_SIZE);
+        const int side = 1 << YUV_LUT_BITS;
+        const int span = 1 << YUV_LUT_SHIFT;
+
+        // Every YUV value is classified once, one luma slice per task
+        cv::parallel_for_(cv::Range(0, side), [&](const cv::Range& range) {
+            for (int cellY = range.start; cellY < range.end; cellY++) {
+                for (int cellU = 0; cellU < side; cellU++) {
+                    for (int cellV = 0; cellV < side; cellV++) {
+                        int first = classifyPixel(
+                            static_cast<uint8_t>(cellY * span),
+                            static_cast<uint8_t>(cellU * span),
+                            static_cast<uint8_t>(cellV * span));
+                        bool ambiguous = false;
+                        for (int i = 1; i < span * span * span; i++) {
+                            int y = cellY * span + i / (span * span);
+                            int u = cellU * span + i / span % span;
+                            int v = cellV * span + i % span;
+                            if (classifyPixel(static_cast<uint8_t>(y),
+                                              static_cast<uint8_t>(u),
+                                              static_cast<uint8_t>(v)) !=
+                                first) {
+                                ambiguous = true;
+                                break;
+                            }
+                        }
+                        int index = (cellY << (2 * YUV_LUT_BITS)) |
+                                    (cellU << YUV_LUT_BITS) | cellV;
+                        lut[index] = static_cast<uint8_t>(
+                            ambiguous ? YUV_LUT_AMBIGUOUS : first);
+                    }
+                }
+            }
+        });
+
+        return lut;
+    }();
+
+    return cells.data();
+}
+
+/**
+ * @brief Classifies a frame. Each pixel is looked up in the cell table, and
+ * only pixels of ambiguous cells are converted exactly.
+ *
+ * @param frame The YUV frame.
+ * @param step 1 for full resolution; 2 samples every other pixel and row,
+ * which for the 4:2:0 formats is the resolution of the chroma planes.
+ * @param occupancy When not null, receives the per-tile counts of each
+ * class, gathered as the rows are classified.
+ * @return cv::Mat A CV_8UC1 image of class bits, one bit per class.
+ */
+cv::Mat YuvClassifier::classify(const YuvFrame& frame, int step,
+                                TileOccupancy* occupancy) {
+    CV_Assert(!frame.empty() && frame.data.isContinuous() &&
+              (step == 1 || step == 2));
+
+    const uint8_t* lut = table();
+    const uint8_t* base = frame.data.ptr<uint8_t>();
+    size_t lumaBytes = static_cast<size_t>(frame.width) * frame.height;
+    int chromaWidth = frame.width / 2;
+
+    // Distance between consecutive Y samples and between chroma samples
+    int lumaStride = frame.format == YUV_YUYV ? 2 : 1;
+    int chromaStride = frame.format == YUV_YUYV ? 4
+                       : frame.format == YUV_NV12 ? 2
+                                                  : 1;
+
+    cv::Mat bits(frame.height / step, frame.width / step, CV_8UC1);
+    if (occupancy != nullptr) {
+        occupancy->reset(bits.size());
+    }
+    for (int row = 0; row < bits.rows; row++) {
+        int y = row * step;
+        const uint8_t *lumaRow, *uRow, *vRow;
+        if (frame.format == YUV_YUYV) {
+            lumaRow = base + static_cast<size_t>(y) * frame.width * 2;
+            uRow = lumaRow + 1;
+            vRow = lumaRow + 3;
+        } else if (frame.format == YUV_NV12) {
+            lumaRow = base + static_cast<size_t>(y) * frame.width;
+            uRow = base + lumaBytes + static_cast<size_t>(y / 2) * frame.width;
+            vRow = uRow + 1;
+        } else {
+            lumaRow = base + static_cast<size_t>(y) * frame.width;
+            uRow = base + lumaBytes + static_cast<size_t>(y / 2) * chromaWidth;
+            vRow = uRow + lumaBytes / 4;
+        }
+
+        uint8_t* dst = bits.ptr<uint8_t>(row);
+        for (int col = 0; col < bits.cols; col++) {
+            int x = col * step;
+            uint8_t luma = lumaRow[x * lumaStride];
+            uint8_t u = uRow[(x / 2) * chromaStride];
+            uint8_t v = vRow[(x / 2) * chromaStride];
+
+            uint8_t cell =
+                lut[((luma >> YUV_LUT_SHIFT) << (2 * YUV_LUT_BITS)) |
+                    ((u >> YUV_LUT_SHIFT) << YUV_LUT_BITS) |
+                    (v >> YUV_LUT_SHIFT)];
+            dst[col] = cell & YUV_LUT_AMBIGUOUS ? classifyPixel(luma, u, v)
+                                                : cell;
+        }
+        if (occupancy != nullptr) {
+            occupancy->addRow(row, dst);
+        }
+    }
+
+    return bits;
+}
+
+/**
+ * @brief Maps a raw YUV file.
+ *
+ * @param path The path of the file.
+ * @param format The layout of the frames.
+ * @param width The frame width, even.
+ * @param height The frame height, even.
+ * @throws std::runtime_error If the file cannot be mapped or the size is
+ * not valid for the format.
+ */
+YuvReader::YuvReader(const string& path, YuvFormat format, int width,
+                     int height)
+    : format(format), width(width), height(height) {
+    if (width <= 0 || height <= 0 || width % 2 != 0 || height % 2 != 0) {
+        throw runtime_error("YUV frame size must be even and positive");
+    }
+    frameBytes = yuvFrameBytes(format, width, height);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < frameBytes) {
+        ::close(fd);
+        throw runtime_error(path + " is shorter than one frame");
+    }
+    length = static_cast<size_t>(st.st_size);
+    frames = length / frameBytes;
+
+    // Private and writable, like `MappedPnm`: equalising a frame in place
+    // copies the touched pages and never reaches the file. `next` drops
+    // those copies once the frame is done with
+    base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        throw runtime_error("Cannot map " + path);
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+}
+
+YuvReader::~YuvReader() {
+    if (base != nullptr) {
+        munmap(base, length);
+    }
+}
+
+/**
+ * @brief Returns the next frame. The pages of the previous one are released
+ * first, so that the copies made by modifying it in place do not pile up
+ * over the file; reading them again gives the file's bytes.
+ *
+ * @param frame Receives a view of the frame, valid until the next call.
+ * @return bool False once every frame has been read.
+ */
+bool YuvReader::next(YuvFrame& frame) {
+    if (position > 0) {
+        // Whole pages only; one shared with the next frame holds bytes of it
+        // that were not modified, and is read back from the file as is
+        uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t first = reinterpret_cast<uintptr_t>(base) +
+                          (position - 1) * frameBytes;
+        uintptr_t last = first + frameBytes;
+        first -= first % page;
+        last = min(last + (page - last % page) % page,
+                   reinterpret_cast<uintptr_t>(base) + length);
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    }
+    if (position >= frames) {
+        return false;
+    }
+
+    frame = YuvFrame(format, width, height,
+                     static_cast<char*>(base) + position * frameBytes);
+    position++;
+    return true;
+}
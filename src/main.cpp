@@ -1,17 +1,272 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
 #include "Analyser.hpp"
+#include "BatchProcessor.hpp"
+
+#define SUBSCRIBE_POLL_MS 1
+
+/**
+ * Prints the command line options.
+ */
+static void usage(const char* program) {
+    cerr << "usage: " << program << " [options]\n"
+         << "  --dataset <path>       sweep PGM/PPM images headlessly\n"
+         << "  --stream               sweep --dataset in row bands\n"
+         << "  --batch <dir|list>     process an image archive in parallel\n"
+         << "  --batch-output <file>  results of --batch (results.tsv)\n"
+         << "  --batch-resume         resume --batch from its checkpoint\n"
+         << "  --batch-threads <n>    detection threads of --batch\n"
+         << "  --yuv <file>           sweep a raw YUV file headlessly\n"
+         << "  --yuv-format <format>  yuyv, nv12 or i420 (default i420)\n"
+         << "  --yuv-size <w>x<h>     frame size of --yuv\n"
+         << "  --overlay              show the annotated --yuv frames\n"
+         << "  --output <file>        archive the annotated video\n"
+         << "  --output-mask <file>   archive the colour mask video\n"
+         << "  --output-every <n>     archive one frame out of n\n"
+         << "  --output-detections    archive only around detections\n"
+         << "  --output-drop-newest   drop new frames when the encoder lags\n"
+         << "  --perf                 report per-stage time and hw counters\n"
+         << "  --circles <backend>    opencv or contour (default opencv)\n"
+         << "  --record <file>        record the camera into a session file\n"
+         << "  --record-png           store recorded frames as PNG\n"
+         << "  --replay <file>        analyse a session at recorded speed\n"
+         << "  --replay-fast          replay every frame as fast as possible\n"
+         << "  --headless             do not show any window\n"
+         << "  --publish <name>       share detections in a shm ring\n"
+         << "  --subscribe <name>     print the detections of a shm ring\n"
+         << endl;
+}
 
 /**
- * Entry point of the application. It opens a video capture from the default
- * camera, processes the video through the `Analyser` class, and returns a
- * status code.
+ * Prints the records of a detection ring as they are published, one line
+ * per record and one per detection, until interrupted. Polls every
+ * `SUBSCRIBE_POLL_MS` when the ring has nothing new.
  */
-int main() {
+static void subscribe(const string& name) {
+    DetectionSubscriber subscriber(name);
+    RingRecord record;
+    uint64_t lost = 0;
+    for (;;) {
+        if (!subscriber.poll(record)) {
+            this_thread::sleep_for(chrono::milliseconds(SUBSCRIBE_POLL_MS));
+            continue;
+        }
+        if (subscriber.lost() != lost) {
+            cout << "lost " << subscriber.lost() - lost << endl;
+            lost = subscriber.lost();
+        }
+
+        int64_t now = chrono::duration_cast<chrono::nanoseconds>(
+                          LatencyClock::now().time_since_epoch())
+                          .count();
+        cout << "record " << record.sequence << " frame " << record.frame
+             << " age " << (now - record.capturedNs) / 1e6 << " ms, "
+             << record.detections.size() << " detections";
+        if (record.truncated > 0) {
+            cout << " (" << record.truncated << " truncated)";
+        }
+        cout << endl;
+        for (const RingDetection& d : record.detections) {
+            cout << "  " << signKindName(static_cast<SignKind>(d.kind)) << " "
+                 << signDirectionName(static_cast<SignDirection>(d.direction))
+                 << " at " << d.x << "," << d.y << " r " << d.radius << endl;
+        }
+    }
+}
+
+/**
+ * Entry point of the application. By default it opens a video capture from
+ * the default camera and processes the video through the `Analyser` class.
+ * With `--dataset <path>` it sweeps a directory of PGM/PPM images (or a
+ * single image) headlessly instead, in bands of rows with `--stream`, and
+ * with `--batch <dir|list>` it runs the detector over an image archive on
+ * every core, writing the results to a file. With `--yuv <file>` it sweeps
+ * the frames of a raw YUV file, which are classified without any conversion
+ * to BGR. `--record <file>` saves the camera frames with their capture times
+ * instead, and `--replay <file>` analyses such a recording in place of the
+ * camera, so that changes can be compared on the same input.
+ * `--publish <name>` shares the detections with other local processes
+ * through shared memory, which `--subscribe <name>` prints. Returns a status
+ * code.
+ */
+int main(int argc, char** argv) {
+    string dataset;
+    BatchConfig batch;
+    batch.output = "results.tsv";
+    VideoSinkConfig sinkConfig;
+    bool profile = false;
+    bool stream = false;
+    string yuvPath;
+    YuvFormat yuvFormat = YUV_I420;
+    int yuvWidth = 0, yuvHeight = 0;
+    bool overlay = false;
+    CircleBackend circleBackend = CIRCLE_BACKEND_DEFAULT;
+    string recordPath, replayPath;
+    SessionEncoding recordEncoding = SESSION_RAW;
+    bool replayRealtime = true;
+    bool display = true;
+    string publishName, subscribeName;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--dataset") == 0 && hasValue) {
+            dataset = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--batch") == 0 && hasValue) {
+            batch.input = argv[++i];
+        } else if (strcmp(argv[i], "--batch-output") == 0 && hasValue) {
+            batch.output = argv[++i];
+        } else if (strcmp(argv[i], "--batch-resume") == 0) {
+            batch.resume = true;
+        } else if (strcmp(argv[i], "--batch-threads") == 0 && hasValue) {
+            batch.detectThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--yuv") == 0 && hasValue) {
+            yuvPath = argv[++i];
+        } else if (strcmp(argv[i], "--yuv-format") == 0 && hasValue &&
+                   parseYuvFormat(argv[i + 1], yuvFormat)) {
+            i++;
+        } else if (strcmp(argv[i], "--yuv-size") == 0 && hasValue &&
+                   sscanf(argv[i + 1], "%dx%d", &yuvWidth, &yuvHeight) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--overlay") == 0) {
+            overlay = true;
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            sinkConfig.path = argv[++i];
+        } else if (strcmp(argv[i], "--output-mask") == 0 && hasValue) {
+            sinkConfig.maskPath = argv[++i];
+        } else if (strcmp(argv[i], "--output-every") == 0 && hasValue) {
+            sinkConfig.decimation = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-detections") == 0) {
+            sinkConfig.mode = SINK_AROUND_DETECTIONS;
+        } else if (strcmp(argv[i], "--output-drop-newest") == 0) {
+            sinkConfig.dropPolicy = SINK_DROP_NEWEST;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--record-png") == 0) {
+            recordEncoding = SESSION_PNG;
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay-fast") == 0) {
+            replayRealtime = false;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            display = false;
+        } else if (strcmp(argv[i], "--publish") == 0 && hasValue) {
+            publishName = argv[++i];
+        } else if (strcmp(argv[i], "--subscribe") == 0 && hasValue) {
+            subscribeName = argv[++i];
+        } else if (strcmp(argv[i], "--circles") == 0 && hasValue &&
+                   parseCircleBackend(argv[i + 1], circleBackend)) {
+            i++;
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    ShapeDetector::setCircleBackend(circleBackend);
+
+    if (!subscribeName.empty()) {
+        try {
+            subscribe(subscribeName);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!batch.input.empty()) {
+        try {
+            BatchStats stats = BatchProcessor::run(batch);
+            cout << "Batch: " << stats.processed << " images in "
+                 << stats.seconds << " s ("
+                 << stats.processed / max(stats.seconds, 1e-9)
+                 << " images/s), " << stats.failed << " failed, "
+                 << stats.skipped << " resumed" << endl;
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!yuvPath.empty()) {
+        try {
+            YuvReader reader(yuvPath, yuvFormat, yuvWidth, yuvHeight);
+            Analyser::processYuv(reader, overlay, profile);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!dataset.empty()) {
+        try {
+            PnmDataset images(dataset);
+            Analyser::processDataset(images, profile, stream);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    VideoOptions options;
+    options.profile = profile;
+    options.display = display;
+    unique_ptr<VideoSink> sink;
+    if (!sinkConfig.path.empty()) {
+        sink = make_unique<VideoSink>(sinkConfig);
+        options.sink = sink.get();
+    }
+    unique_ptr<DetectionPublisher> ring;
+    if (!publishName.empty()) {
+        try {
+            ring = make_unique<DetectionPublisher>(publishName);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        options.ring = ring.get();
+    }
+
+    if (!replayPath.empty()) {
+        try {
+            SessionReader session(replayPath);
+            SessionReplay replay(session, replayRealtime);
+            Analyser::processVideo(replay, options);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
     cv::VideoCapture cap(0);
     if (!cap.isOpened()) {
         return -1;
     }
+    CameraSource camera(cap);
+
+    if (!recordPath.empty()) {
+        try {
+            SessionWriter writer(recordPath, recordEncoding);
+            Analyser::recordSession(camera, writer, display);
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
 
-    Analyser::processVideo(cap);
+    Analyser::processVideo(camera, options);
 
     return 0;
 }
@@ -0,0 +1,477 @@
+/**
+ * Equivalence and speed of the course kernels in `aulas/` against OpenCV.
+ *
+ * `bench_aulas [--check] [<w>x<h> ...]` builds a synthetic scene at each
+ * resolution and runs every kernel next to its OpenCV counterpart, printing
+ * the equivalence error and the best time of each. With `--check` it fails
+ * when a kernel meant to be equivalent is not:
+ *
+ *  - convertToHSV within one level of `cv::cvtColor` on every channel;
+ *  - inRange identical to `cv::inRange`;
+ *  - erode, dilate, open and close identical to OpenCV with a rectangular
+ *    kernel, away from the border the course kernels leave untouched;
+ *  - findContours identical to `cv::findContours` (RETR_LIST) on a clean
+ *    mask;
+ *  - findCircles finding every disc of the clean mask;
+ *  - measureContour matching `cv::contourArea`, `cv::arcLength` and
+ *    `cv::moments` within `MEASURE_TOLERANCE` (relative) on the contours of
+ *    both masks. It is timed against OpenCV and against the
+ *    calculateArea, calculatePerimeter and getCircleFromContour passes it
+ *    replaces.
+ *
+ * equalizeHistogram is only reported: it starts the CDF at its minimum
+ * rather than at the first occupied level, so it is not meant to match.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ColorClassifier.hpp"
+#include "cv.hpp"
+
+#define BENCH_RUNS 3
+#define MORPH_KERNEL_SIZE 3
+#define CIRCULARITY 0.8
+#define MEASURE_TOLERANCE 1e-6  // arcLength sums in float
+
+using namespace std;
+
+/**
+ * @brief A disc drawn in the clean mask.
+ */
+struct Disc {
+    cv::Point center;
+    int radius;
+};
+
+/**
+ * @brief Returns the best wall-clock time of a few runs, in ms.
+ */
+template <typename F>
+static double bestMs(F&& run) {
+    double best = numeric_limits<double>::max();
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        auto start = chrono::steady_clock::now();
+        run();
+        chrono::duration<double, milli> elapsed =
+            chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+/**
+ * @brief Builds a BGR scene: a colour gradient with noise and red and blue
+ * signs of several sizes.
+ */
+static cv::Mat makeScene(cv::Size size) {
+    cv::Mat scene(size, CV_8UC3);
+    for (int y = 0; y < size.height; y++) {
+        for (int x = 0; x < size.width; x++) {
+            scene.at<cv::Vec3b>(y, x) =
+                cv::Vec3b(static_cast<uint8_t>(60 + 120 * x / size.width),
+                          static_cast<uint8_t>(90 + 80 * y / size.height),
+                          static_cast<uint8_t>(70 + 60 * x / size.width));
+        }
+    }
+
+    cv::Mat noise(size, CV_8UC3);
+    cv::RNG rng(42);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 24);
+    scene += noise;
+
+    int s = min(size.width, size.height);
+    cv::circle(scene, cv::Point(size.width / 4, size.height / 3), s / 8,
+               cv::Scalar(30, 30, 200), -1);
+    cv::circle(scene, cv::Point(3 * size.width / 4, size.height / 3), s / 6,
+               cv::Scalar(180, 60, 20), -1);
+    cv::rectangle(scene, cv::Rect(size.width / 2 - s / 10, 2 * size.height / 3,
+                                  s / 5, s / 5),
+                  cv::Scalar(190, 70, 30), -1);
+    return scene;
+}
+
+/**
+ * @brief Builds a clean 0/255 mask of discs, a square and a ring.
+ *
+ * @param discs Receives the discs that must be found as circles.
+ */
+static cv::Mat makeMask(cv::Size size, vector<Disc>& discs) {
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    int s = min(size.width, size.height);
+
+    discs = {{cv::Point(size.width / 4, size.height / 3), s * 12 / 100},
+             {cv::Point(3 * size.width / 4, 2 * size.height / 3), s / 5}};
+    for (const Disc& disc : discs) {
+        cv::circle(mask, disc.center, disc.radius, cv::Scalar(255), -1);
+    }
+    cv::rectangle(mask, cv::Rect(size.width / 2 - s / 10, size.height / 8,
+                                 s / 5, s / 5),
+                  cv::Scalar(255), -1);
+
+    Disc ring = {cv::Point(size.width / 4, 3 * size.height / 4),
+                 s * 15 / 100};
+    cv::circle(mask, ring.center, ring.radius, cv::Scalar(255), -1);
+    cv::circle(mask, ring.center, s * 7 / 100, cv::Scalar(0), -1);
+    discs.push_back(ring);
+
+    return mask;
+}
+
+/**
+ * @brief Converts a single-channel mask to an `aulas::Image`.
+ */
+static aulas::Image maskToImage(const cv::Mat& mask) {
+    cv::Mat bgr;
+    cv::cvtColor(mask, bgr, cv::COLOR_GRAY2BGR);
+    return aulas::matToImage(bgr);
+}
+
+/**
+ * @brief Returns one channel of an `aulas::Image` as a cv::Mat.
+ */
+static cv::Mat imageChannel(const aulas::Image& image, int channel) {
+    cv::Mat result;
+    cv::extractChannel(aulas::imageToMat(image), result, channel);
+    return result;
+}
+
+/**
+ * @brief Counts the differing pixels of two masks, ignoring a border.
+ */
+static int countMismatches(const cv::Mat& a, const cv::Mat& b, int margin) {
+    cv::Rect inner(margin, margin, a.cols - 2 * margin, a.rows - 2 * margin);
+    cv::Mat diff;
+    cv::compare(a(inner), b(inner), diff, cv::CMP_NE);
+    return cv::countNonZero(diff);
+}
+
+/**
+ * @brief Returns the error of a value relative to the expected one, or the
+ * absolute error when the expected value is below 1.
+ */
+static double relativeError(double value, double expected) {
+    return fabs(value - expected) / max(fabs(expected), 1.0);
+}
+
+/**
+ * @brief Returns the largest relative error of `measureContour` against
+ * `cv::contourArea`, `cv::arcLength` and `cv::moments` over the contours.
+ * Contour points hold the row in `x`, so the axes of the moments swap.
+ */
+static double measureError(const vector<vector<aulas::Point>>& contours,
+                           const vector<vector<cv::Point>>& cvContours) {
+    double error = 0.0;
+    for (size_t i = 0; i < contours.size(); i++) {
+        aulas::ContourFeatures features =
+            aulas::measureContour(contours[i].data(), contours[i].size());
+        cv::Moments m = cv::moments(cvContours[i]);
+        const double pairs[][2] = {
+            {features.area, cv::contourArea(cvContours[i])},
+            {features.perimeter, cv::arcLength(cvContours[i], true)},
+            {features.area, m.m00},
+            {features.m01, m.m10},
+            {features.m10, m.m01},
+            {features.m02, m.m20},
+            {features.m11, m.m11},
+            {features.m20, m.m02},
+        };
+        for (const auto& pair : pairs) {
+            error = max(error, relativeError(pair[0], pair[1]));
+        }
+    }
+    return error;
+}
+
+/**
+ * @brief Prints one row of the report.
+ */
+static void report(const string& kernel, cv::Size size, const string& error,
+                   double aulasMs, double opencvMs) {
+    cout << left << setw(12) << kernel << right << setw(5) << size.width
+         << "x" << left << setw(6) << size.height << setw(34) << error
+         << right << fixed << setprecision(3) << setw(10) << aulasMs
+         << " ms" << setw(10) << opencvMs << " ms" << setprecision(1)
+         << setw(9) << aulasMs / max(opencvMs, 1e-6) << "x" << endl;
+}
+
+/**
+ * @brief Runs every kernel at one resolution.
+ *
+ * @return int The number of failed equivalence checks.
+ */
+static int runResolution(cv::Size size) {
+    int failures = 0;
+    auto check = [&](bool ok, const string& kernel) {
+        if (!ok) {
+            cout << "FAIL " << kernel << " at " << size.width << "x"
+                 << size.height << endl;
+            failures++;
+        }
+    };
+
+    cv::Mat scene = makeScene(size);
+    cv::Mat rgb;
+    cv::cvtColor(scene, rgb, cv::COLOR_BGR2RGB);
+    aulas::Image rgbImage = aulas::matToImage(rgb);
+
+    // Colour conversion
+    aulas::Image hsvImage = aulas::convertToHSV(rgbImage);
+    cv::Mat hsv;
+    double aulasMs = bestMs([&] { hsvImage = aulas::convertToHSV(rgbImage); });
+    double opencvMs =
+        bestMs([&] { cv::cvtColor(scene, hsv, cv::COLOR_BGR2HSV); });
+    int maxError[3] = {};
+    for (int y = 0; y < size.height; y++) {
+        for (int x = 0; x < size.width; x++) {
+            const cv::Vec3b& expected = hsv.at<cv::Vec3b>(y, x);
+            for (int c = 0; c < 3; c++) {
+                int error = abs(hsvImage.data[y][x][c] - expected[c]);
+                if (c == 0) {
+                    error = min(error, 180 - error);  // Hue wraps around
+                }
+                maxError[c] = max(maxError[c], error);
+            }
+        }
+    }
+    report("hsv", size,
+           "max |dH| " + to_string(maxError[0]) + " |dS| " +
+               to_string(maxError[1]) + " |dV| " + to_string(maxError[2]),
+           aulasMs, opencvMs);
+    check(maxError[0] <= 1 && maxError[1] <= 1 && maxError[2] <= 1, "hsv");
+
+    // Thresholding, on the same HSV input
+    const HsvRange& range = COLOR_CLASSES[COLOR_BLUE].ranges[0];
+    vector<uint8_t> lower = {range.hLow, range.sLow, range.vLow};
+    vector<uint8_t> upper = {range.hHigh, range.sHigh, range.vHigh};
+    aulas::Image hsvInput = aulas::matToImage(hsv);
+    aulas::Image maskImage = aulas::inRange(hsvInput, lower, upper);
+    cv::Mat mask;
+    aulasMs =
+        bestMs([&] { maskImage = aulas::inRange(hsvInput, lower, upper); });
+    opencvMs = bestMs([&] {
+        cv::inRange(hsv, cv::Scalar(lower[0], lower[1], lower[2]),
+                    cv::Scalar(upper[0], upper[1], upper[2]), mask);
+    });
+    int mismatches = countMismatches(imageChannel(maskImage, 0), mask, 0);
+    report("inRange", size, to_string(mismatches) + " pixels differ", aulasMs,
+           opencvMs);
+    check(mismatches == 0, "inRange");
+
+    // Morphology, on the thresholded mask
+    aulas::Image morphInput = maskToImage(mask);
+    cv::Mat element = cv::getStructuringElement(
+        cv::MORPH_RECT, cv::Size(MORPH_KERNEL_SIZE, MORPH_KERNEL_SIZE));
+    int radius = MORPH_KERNEL_SIZE / 2;
+    const struct {
+        const char* name;
+        aulas::Image (*kernel)(aulas::Image, int);
+        int operation;
+        int margin;
+    } morphologies[] = {
+        {"erode", aulas::erode, cv::MORPH_ERODE, radius},
+        {"dilate", aulas::dilate, cv::MORPH_DILATE, radius},
+        {"open", aulas::open, cv::MORPH_OPEN, 2 * radius},
+        {"close", aulas::close, cv::MORPH_CLOSE, 2 * radius},
+    };
+    for (const auto& morphology : morphologies) {
+        aulas::Image result =
+            morphology.kernel(morphInput, MORPH_KERNEL_SIZE);
+        cv::Mat expected;
+        aulasMs = bestMs([&] {
+            result = morphology.kernel(morphInput, MORPH_KERNEL_SIZE);
+        });
+        opencvMs = bestMs([&] {
+            cv::morphologyEx(mask, expected, morphology.operation, element);
+        });
+        mismatches = countMismatches(imageChannel(result, 0), expected,
+                                     morphology.margin);
+        report(morphology.name, size,
+               to_string(mismatches) + " pixels differ inside",
+               aulasMs, opencvMs);
+        check(mismatches == 0, morphology.name);
+    }
+
+    // Equalisation of the V channel
+    aulas::Image equalized = aulas::equalizeHistogram(hsvInput);
+    cv::Mat value, expectedValue;
+    cv::extractChannel(hsv, value, 2);
+    aulasMs = bestMs([&] { equalized = aulas::equalizeHistogram(hsvInput); });
+    opencvMs = bestMs([&] { cv::equalizeHist(value, expectedValue); });
+    cv::Mat difference;
+    cv::absdiff(imageChannel(equalized, 2), expectedValue, difference);
+    double maxDifference;
+    cv::minMaxLoc(difference, nullptr, &maxDifference);
+    report("equalize", size,
+           "max |dV| " + to_string(static_cast<int>(maxDifference)) +
+               " mean " + to_string(cv::mean(difference)[0]).substr(0, 5),
+           aulasMs, opencvMs);
+
+    // Contours, on the clean mask and on the opened thresholded mask
+    vector<Disc> discs;
+    cv::Mat clean = makeMask(size, discs);
+    cv::Mat opened;
+    cv::morphologyEx(mask, opened, cv::MORPH_OPEN, element);
+    const struct {
+        const char* name;
+        const cv::Mat& mask;
+        bool checked;
+    } contourInputs[] = {{"contours", clean, true},
+                         {"contours*", opened, false}};
+    for (const auto& input : contourInputs) {
+        aulas::Image image = maskToImage(input.mask);
+        vector<vector<aulas::Point>> contours = aulas::findContours(image);
+        vector<vector<cv::Point>> expected;
+        aulasMs = bestMs([&] { contours = aulas::findContours(image); });
+        opencvMs = bestMs([&] {
+            cv::findContours(input.mask, expected, cv::RETR_LIST,
+                             cv::CHAIN_APPROX_NONE);
+        });
+        size_t points = 0, expectedPoints = 0;
+        for (const auto& contour : contours) {
+            points += contour.size();
+        }
+        for (const auto& contour : expected) {
+            expectedPoints += contour.size();
+        }
+        report(input.name, size,
+               to_string(contours.size()) + "/" + to_string(expected.size()) +
+                   " contours, " + to_string(points) + "/" +
+                   to_string(expectedPoints) + " points",
+               aulasMs, opencvMs);
+        if (input.checked) {
+            check(contours.size() == expected.size() &&
+                      points == expectedPoints,
+                  input.name);
+        }
+    }
+
+    // Contour measures, on the contours of both masks
+    for (const auto& input : contourInputs) {
+        vector<vector<aulas::Point>> contours =
+            aulas::findContours(maskToImage(input.mask));
+        vector<vector<cv::Point>> cvContours;
+        for (const auto& contour : contours) {
+            cvContours.emplace_back();
+            for (const aulas::Point& point : contour) {
+                cvContours.back().emplace_back(point.y, point.x);
+            }
+        }
+
+        double error = measureError(contours, cvContours);
+        volatile double sink = 0.0;
+        double measureMs = bestMs([&] {
+            for (const auto& contour : contours) {
+                sink = sink + aulas::measureContour(contour.data(),
+                                                    contour.size())
+                                  .area;
+            }
+        });
+        double calculateMs = bestMs([&] {
+            for (const auto& contour : contours) {
+                sink = sink + aulas::calculateArea(contour) +
+                       aulas::calculatePerimeter(contour) +
+                       aulas::getCircleFromContour(contour).radius;
+            }
+        });
+        opencvMs = bestMs([&] {
+            for (const auto& contour : cvContours) {
+                sink = sink + cv::moments(contour).m00 +
+                       cv::contourArea(contour) +
+                       cv::arcLength(contour, true);
+            }
+        });
+        ostringstream measured, replaced;
+        measured << "max rel err " << scientific << setprecision(1) << error;
+        replaced << "old path, " << fixed << setprecision(1)
+                 << calculateMs / max(measureMs, 1e-6) << "x measure";
+        report(input.checked ? "measure" : "measure*", size, measured.str(),
+               measureMs, opencvMs);
+        report(input.checked ? "calculate" : "calculate*", size,
+               replaced.str(), calculateMs, opencvMs);
+        check(error <= MEASURE_TOLERANCE, "measure");
+    }
+
+    // Circles, on the clean mask
+    aulas::Image cleanImage = maskToImage(clean);
+    vector<aulas::Circle> circles =
+        aulas::findCircles(cleanImage, CIRCULARITY);
+    vector<cv::Vec3f> houghCircles;
+    aulasMs = bestMs(
+        [&] { circles = aulas::findCircles(cleanImage, CIRCULARITY); });
+    opencvMs = bestMs([&] {
+        cv::HoughCircles(clean, houghCircles, cv::HOUGH_GRADIENT, 1,
+                         clean.rows / 8, 40, 10, 5, clean.rows / 2);
+    });
+    int found = 0, houghFound = 0;
+    for (const Disc& disc : discs) {
+        double tolerance = max(2.0, 0.1 * disc.radius);
+        for (const aulas::Circle& circle : circles) {
+            // Contour points hold the row in x and the column in y
+            if (hypot(circle.center.y - disc.center.x,
+                      circle.center.x - disc.center.y) <= tolerance &&
+                fabs(circle.radius - disc.radius) <= tolerance) {
+                found++;
+                break;
+            }
+        }
+        for (const cv::Vec3f& circle : houghCircles) {
+            if (hypot(circle[0] - disc.center.x, circle[1] - disc.center.y) <=
+                    tolerance &&
+                fabs(circle[2] - disc.radius) <= tolerance) {
+                houghFound++;
+                break;
+            }
+        }
+    }
+    report("circles", size,
+           to_string(found) + "/" + to_string(discs.size()) + " discs (" +
+               to_string(circles.size()) + " found), hough " +
+               to_string(houghFound) + "/" + to_string(discs.size()),
+           aulasMs, opencvMs);
+    check(found == static_cast<int>(discs.size()), "circles");
+
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    bool checking = false;
+    vector<cv::Size> sizes;
+    for (int i = 1; i < argc; i++) {
+        int width, height;
+        if (strcmp(argv[i], "--check") == 0) {
+            checking = true;
+        } else if (sscanf(argv[i], "%dx%d", &width, &height) == 2 &&
+                   width >= 32 && height >= 32) {
+            sizes.emplace_back(width, height);
+        } else {
+            cerr << "usage: " << argv[0] << " [--check] [<w>x<h> ...]"
+                 << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (sizes.empty()) {
+        sizes = {cv::Size(320, 240), cv::Size(640, 480), cv::Size(1280, 720)};
+    }
+
+    cout << left << setw(12) << "kernel" << setw(12) << "size" << setw(34)
+         << "equivalence" << right << setw(13) << "aulas" << setw(13)
+         << "opencv" << setw(10) << "ratio" << endl;
+    int failures = 0;
+    for (const cv::Size& size : sizes) {
+        failures += runResolution(size);
+    }
+    cout << "* contours of the opened threshold mask; only measure is checked"
+         << endl;
+
+    return checking && failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/**
+ * Speed and agreement of `CircleHough` against `cv::HoughCircles`.
+ *
+ * `bench_circles [--check] [--sinais <dir>] [<w>x<h> ...]` builds a
+ * synthetic mask at each resolution (discs, a ring, a disc on a pole, a
+ * square and an octagon) and runs both circle detectors on it with the
+ * parameters of `ShapeDetector::detectCircles`, printing the discs each one
+ * found, the circles that match no disc and the best time of each. With
+ * `--sinais` it also runs both on the colour mask of every image in the
+ * directory and reports how many circles they agree on. With `--check` it
+ * fails when `CircleHough` misses a disc of the synthetic mask.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Analyser.hpp"
+#include "CircleHough.hpp"
+
+#define BENCH_RUNS 3
+#define MATCH_TOLERANCE 0.05
+
+using namespace std;
+namespace fs = std::filesystem;
+
+/**
+ * @brief A disc drawn in the synthetic mask.
+ */
+struct Disc {
+    cv::Point center;
+    int radius;
+};
+
+/**
+ * @brief Returns the best wall-clock time of a few runs, in ms.
+ */
+template <typename F>
+static double bestMs(F&& run) {
+    double best = numeric_limits<double>::max();
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        auto start = chrono::steady_clock::now();
+        run();
+        chrono::duration<double, milli> elapsed =
+            chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+/**
+ * @brief Runs `cv::HoughCircles` as `ShapeDetector::detectCircles` does.
+ */
+static void opencvCircles(const cv::Mat& mask, vector<cv::Vec3f>& circles) {
+    cv::HoughCircles(mask, circles, cv::HOUGH_GRADIENT, 1, mask.rows / 8,
+                     CIRCLE_DETECTION_PARAM1, CIRCLE_DETECTION_PARAM2,
+                     MIN_RADIUS, MAX_RADIUS);
+}
+
+/**
+ * @brief Runs `CircleHough` as `ShapeDetector::detectCircles` does.
+ */
+static void contourCircles(const cv::Mat& mask, vector<cv::Vec3f>& circles) {
+    CircleHough::detect(mask, circles, mask.rows / 8, MIN_RADIUS, MAX_RADIUS);
+}
+
+/**
+ * @brief Whether two circles have the same centre and radius, within
+ * `MATCH_TOLERANCE` of the radius.
+ */
+static bool sameCircle(const cv::Vec3f& a, const cv::Vec3f& b) {
+    double tolerance = max(2.0, MATCH_TOLERANCE * b[2]);
+    return hypot(a[0] - b[0], a[1] - b[1]) <= tolerance &&
+           fabs(a[2] - b[2]) <= tolerance;
+}
+
+/**
+ * @brief Counts the circles of `found` that match one of `expected`.
+ */
+static int countMatches(const vector<cv::Vec3f>& found,
+                        const vector<cv::Vec3f>& expected) {
+    int matches = 0;
+    for (const cv::Vec3f& circle : found) {
+        for (const cv::Vec3f& target : expected) {
+            if (sameCircle(circle, target)) {
+                matches++;
+                break;
+            }
+        }
+    }
+    return matches;
+}
+
+/**
+ * @brief Builds a 0/255 mask of discs, a ring and a disc on a pole, which
+ * are circles, and a square and an octagon, which are not.
+ *
+ * @param discs Receives the circles that must be found.
+ */
+static cv::Mat makeMask(cv::Size size, vector<cv::Vec3f>& discs) {
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    int s = min(size.width, size.height);
+
+    vector<Disc> shapes = {
+        {cv::Point(size.width / 5, size.height / 4), s * 12 / 100},
+        {cv::Point(4 * size.width / 5, 3 * size.height / 4), s / 5}};
+    for (const Disc& disc : shapes) {
+        cv::circle(mask, disc.center, disc.radius, cv::Scalar(255), -1);
+    }
+
+    Disc ring = {cv::Point(size.width / 5, 3 * size.height / 4),
+                 s * 15 / 100};
+    cv::circle(mask, ring.center, ring.radius, cv::Scalar(255), -1);
+    cv::circle(mask, ring.center, s * 7 / 100, cv::Scalar(0), -1);
+    shapes.push_back(ring);
+
+    // The pole stretches the blob's bounding box below the disc
+    Disc sign = {cv::Point(size.width / 2, size.height / 4), s / 10};
+    cv::circle(mask, sign.center, sign.radius, cv::Scalar(255), -1);
+    cv::rectangle(mask,
+                  cv::Rect(sign.center.x - s / 60, sign.center.y, s / 30,
+                           s / 3),
+                  cv::Scalar(255), -1);
+    shapes.push_back(sign);
+
+    cv::rectangle(mask,
+                  cv::Rect(7 * size.width / 10, size.height / 10, s / 5,
+                           s / 5),
+                  cv::Scalar(255), -1);
+
+    vector<cv::Point> octagon;
+    cv::Point center(size.width / 2, 3 * size.height / 4);
+    for (int k = 0; k < 8; k++) {
+        double angle = CV_PI / 8 + k * CV_PI / 4;
+        octagon.emplace_back(center.x + cvRound(s / 8 * cos(angle)),
+                             center.y + cvRound(s / 8 * sin(angle)));
+    }
+    cv::fillPoly(mask, vector<vector<cv::Point>>{octagon}, cv::Scalar(255));
+
+    discs.clear();
+    for (const Disc& disc : shapes) {
+        discs.emplace_back(static_cast<float>(disc.center.x),
+                           static_cast<float>(disc.center.y),
+                           static_cast<float>(disc.radius));
+    }
+    return mask;
+}
+
+/**
+ * @brief Prints one row of the report.
+ */
+static void report(const string& input, const string& agreement,
+                   double contourMs, double opencvMs) {
+    cout << left << setw(24) << input << setw(40) << agreement << right
+         << fixed << setprecision(3) << setw(10) << contourMs << " ms"
+         << setw(10) << opencvMs << " ms" << setprecision(1) << setw(9)
+         << opencvMs / max(contourMs, 1e-6) << "x" << endl;
+}
+
+/**
+ * @brief Runs both detectors on the synthetic mask at one resolution.
+ *
+ * @return bool Whether `CircleHough` found every disc.
+ */
+static bool runResolution(cv::Size size) {
+    vector<cv::Vec3f> discs;
+    cv::Mat mask = makeMask(size, discs);
+
+    vector<cv::Vec3f> contour, opencv;
+    double contourMs = bestMs([&] { contourCircles(mask, contour); });
+    double opencvMs = bestMs([&] { opencvCircles(mask, opencv); });
+
+    // Discs found by each, then circles matching no disc
+    int found = countMatches(discs, contour);
+    int opencvFound = countMatches(discs, opencv);
+    int extra = static_cast<int>(contour.size()) -
+                countMatches(contour, discs);
+    int opencvExtra = static_cast<int>(opencv.size()) -
+                      countMatches(opencv, discs);
+
+    string name = to_string(size.width) + "x" + to_string(size.height);
+    report(name,
+           to_string(found) + "/" + to_string(discs.size()) + " +" +
+               to_string(extra) + ", opencv " + to_string(opencvFound) +
+               "/" + to_string(discs.size()) + " +" + to_string(opencvExtra),
+           contourMs, opencvMs);
+
+    if (found != static_cast<int>(discs.size())) {
+        cout << "FAIL circles at " << name << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs both detectors on the colour mask of every image of a
+ * directory. Reported only: there is no ground truth for the masks.
+ */
+static void runSinais(const string& dir) {
+    vector<fs::path> paths;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.is_regular_file()) {
+            paths.push_back(entry.path());
+        }
+    }
+    sort(paths.begin(), paths.end());
+
+    for (const fs::path& path : paths) {
+        cv::Mat frame = cv::imread(path.string());
+        if (frame.empty()) {
+            continue;
+        }
+        cv::Mat colorMask;
+        Analyser::detect(frame, colorMask);
+
+        vector<cv::Vec3f> contour, opencv;
+        double contourMs = bestMs([&] { contourCircles(colorMask, contour); });
+        double opencvMs = bestMs([&] { opencvCircles(colorMask, opencv); });
+
+        report(path.filename().string(),
+               to_string(countMatches(contour, opencv)) + " of " +
+                   to_string(contour.size()) + " in opencv's " +
+                   to_string(opencv.size()),
+               contourMs, opencvMs);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool checking = false;
+    string sinais;
+    vector<cv::Size> sizes;
+    for (int i = 1; i < argc; i++) {
+        int width, height;
+        if (strcmp(argv[i], "--check") == 0) {
+            checking = true;
+        } else if (strcmp(argv[i], "--sinais") == 0 && i + 1 < argc) {
+            sinais = argv[++i];
+        } else if (sscanf(argv[i], "%dx%d", &width, &height) == 2 &&
+                   min(width, height) >= 400) {
+            sizes.emplace_back(width, height);
+        } else {
+            cerr << "usage: " << argv[0]
+                 << " [--check] [--sinais <dir>] [<w>x<h> ...]\n"
+                 << "sizes must be at least 400 pixels on each side, so "
+                    "that every disc is above MIN_RADIUS"
+                 << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (sizes.empty()) {
+        sizes = {cv::Size(640, 480), cv::Size(1280, 720),
+                 cv::Size(1920, 1080)};
+    }
+
+    cout << left << setw(24) << "input" << setw(40)
+         << "found +extra / agreement" << right << setw(13) << "contour"
+         << setw(13) << "opencv" << setw(10) << "speedup" << endl;
+    int failures = 0;
+    for (const cv::Size& size : sizes) {
+        failures += runResolution(size) ? 0 : 1;
+    }
+    if (!sinais.empty()) {
+        runSinais(sinais);
+    }
+
+    return checking && failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/**
+ * Two-process test of the shared memory detection ring.
+ *
+ * `test_ring [<name>]` creates a `DetectionPublisher` and forks a reader
+ * process that maps the ring with a `DetectionSubscriber`. The publisher
+ * first writes records at a pace the reader can follow, then, while the
+ * reader is told to stall, a burst several times the size of the ring. The
+ * reader checks that every record it receives is whole (its detections and
+ * thumbnail all derive from its frame number), that sequence numbers only
+ * increase, that the stall made it lose records rather than block the
+ * publisher, and that received and lost records add up to all published.
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DetectionRing.hpp"
+
+#define TEST_SLOTS 16
+#define PACED_RECORDS (4 * TEST_SLOTS)
+#define BURST_RECORDS (8 * TEST_SLOTS)
+#define PACE_US 500
+#define STALL_MS 200
+#define READER_TIMEOUT_S 20
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 480
+
+using namespace std;
+
+/**
+ * @brief Returns the detections published with a frame: as many as the
+ * frame number modulo a bit more than a slot holds, so that some records
+ * are truncated.
+ */
+static vector<Detection> detectionsOf(uint64_t frame) {
+    vector<Detection> detections(frame % (RING_MAX_DETECTIONS + 3));
+    for (size_t i = 0; i < detections.size(); i++) {
+        Detection& d = detections[i];
+        d.kind = static_cast<SignKind>(i % SIGN_KIND_COUNT);
+        d.direction = static_cast<SignDirection>(frame % DIRECTION_COUNT);
+        d.center = cv::Point2f(frame % FRAME_WIDTH, i);
+        d.radius = 10.0f + i;
+        d.centerOfMass = d.center;
+    }
+    return detections;
+}
+
+/**
+ * @brief Checks that a record is the one published for its frame.
+ */
+static bool wellFormed(const RingRecord& record) {
+    vector<Detection> expected = detectionsOf(record.frame);
+    size_t kept = min<size_t>(expected.size(), RING_MAX_DETECTIONS);
+    if (record.frame != record.sequence + 1 ||
+        record.frameSize != cv::Size(FRAME_WIDTH, FRAME_HEIGHT) ||
+        record.detections.size() != kept ||
+        record.truncated != expected.size() - kept ||
+        record.publishedNs < record.capturedNs) {
+        return false;
+    }
+    for (size_t i = 0; i < kept; i++) {
+        const RingDetection& d = record.detections[i];
+        const Detection& e = expected[i];
+        if (d.kind != e.kind || d.direction != e.direction ||
+            d.x != e.center.x || d.y != e.center.y || d.radius != e.radius ||
+            d.left != e.center.x - e.radius ||
+            d.bottom != e.center.y + e.radius) {
+            return false;
+        }
+    }
+    cv::Mat differs = record.thumbnail != static_cast<int>(record.frame % 256);
+    return record.thumbnail.size() ==
+               cv::Size(RING_THUMB_WIDTH, RING_THUMB_HEIGHT) &&
+           cv::countNonZero(differs) == 0;
+}
+
+/**
+ * @brief The reader process. Reports on `ready` once subscribed and once
+ * it has stalled, and returns the exit status.
+ */
+static int reader(const string& name, int ready) {
+    DetectionSubscriber subscriber(name);
+    char byte = 'r';
+    if (write(ready, &byte, 1) != 1) {
+        return 1;
+    }
+
+    const uint64_t total = PACED_RECORDS + BURST_RECORDS;
+    auto deadline =
+        chrono::steady_clock::now() + chrono::seconds(READER_TIMEOUT_S);
+    RingRecord record;
+    uint64_t received = 0, last = 0;
+    bool stalled = false;
+    while (received + subscriber.lost() < total) {
+        if (chrono::steady_clock::now() > deadline) {
+            cerr << "reader: timed out after " << received << " records, "
+                 << subscriber.lost() << " lost" << endl;
+            return 1;
+        }
+        if (!subscriber.poll(record)) {
+            this_thread::sleep_for(chrono::microseconds(50));
+            continue;
+        }
+        if (!wellFormed(record)) {
+            cerr << "reader: torn or wrong record " << record.sequence << endl;
+            return 1;
+        }
+        if (received > 0 && record.sequence <= last) {
+            cerr << "reader: sequence " << record.sequence << " after "
+                 << last << endl;
+            return 1;
+        }
+        last = record.sequence;
+        received++;
+
+        // Fall behind by much more than the ring holds
+        if (!stalled && record.sequence + 1 == PACED_RECORDS) {
+            stalled = true;
+            byte = 's';
+            if (write(ready, &byte, 1) != 1) {
+                return 1;
+            }
+            this_thread::sleep_for(chrono::milliseconds(STALL_MS));
+        }
+    }
+
+    cout << "reader: received " << received << ", lost " << subscriber.lost()
+         << endl;
+    if (received + subscriber.lost() != total ||
+        subscriber.lost() < BURST_RECORDS - TEST_SLOTS) {
+        cerr << "reader: expected at least " << BURST_RECORDS - TEST_SLOTS
+             << " lost records" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Publishes a record for a frame.
+ */
+static void publish(DetectionPublisher& publisher, uint64_t frame) {
+    cv::Mat mask(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1,
+                 cv::Scalar(static_cast<double>(frame % 256)));
+    publisher.publish(frame, LatencyClock::now(),
+                      cv::Size(FRAME_WIDTH, FRAME_HEIGHT), detectionsOf(frame),
+                      mask);
+}
+
+int main(int argc, char** argv) {
+    string name =
+        argc > 1 ? argv[1] : "/visao_test_ring_" + to_string(getpid());
+
+    try {
+        DetectionSubscriber missing(name);
+        cerr << "subscribed to a ring that does not exist" << endl;
+        return 1;
+    } catch (const runtime_error&) {
+        // Expected
+    }
+
+    DetectionPublisher publisher(name, TEST_SLOTS);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        cerr << "cannot create a pipe" << endl;
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child < 0) {
+        cerr << "cannot fork" << endl;
+        return 1;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        int status;
+        try {
+            status = reader(name, fds[1]);
+        } catch (const exception& e) {
+            cerr << "reader: " << e.what() << endl;
+            status = 1;
+        }
+        // Leave the ring to the parent, which unlinks it
+        _exit(status);
+    }
+    close(fds[1]);
+
+    char byte;
+    if (read(fds[0], &byte, 1) != 1) {
+        cerr << "reader did not subscribe" << endl;
+        waitpid(child, nullptr, 0);
+        return 1;
+    }
+
+    uint64_t frame = 1;
+    for (int i = 0; i < PACED_RECORDS; i++) {
+        publish(publisher, frame++);
+        this_thread::sleep_for(chrono::microseconds(PACE_US));
+    }
+
+    // The burst must not wait for the stalled reader
+    if (read(fds[0], &byte, 1) != 1) {
+        cerr << "reader did not stall" << endl;
+        waitpid(child, nullptr, 0);
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < BURST_RECORDS; i++) {
+        publish(publisher, frame++);
+    }
+    chrono::duration<double, milli> burst = chrono::steady_clock::now() - start;
+    cout << "publisher: " << publisher.published() << " records, burst of "
+         << BURST_RECORDS << " in " << burst.count() << " ms" << endl;
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    close(fds[0]);
+    if (burst.count() >= STALL_MS) {
+        cerr << "the publisher waited for the reader" << endl;
+        return 1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        cerr << "reader failed" << endl;
+        return 1;
+    }
+    cout << "ring: ok" << endl;
+    return 0;
+}
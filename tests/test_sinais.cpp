@@ -0,0 +1,630 @@
+/**
+ * Regression tests over the sign images in `sinais/`.
+ *
+ * `test_sinais accuracy <sinais dir> <golden file>` runs the detector on
+ * every image listed in the golden file and checks that the expected sign
+ * is found: same kind, same direction, center within tolerance. PNM images
+ * are mapped with `MappedPnm`, any other format is decoded by `cv::imread`.
+ * A golden line may end with `no-equalize` to run that image at
+ * `QUALITY_NO_EQUALIZE`, for signs that equalisation flattens into the dark
+ * end of the histogram.
+ *
+ * `test_sinais accuracy-yuv <sinais dir> <golden file>` does the same
+ * through the raw YUV path: each image is written to disk as an I420 file,
+ * read back with `YuvReader` and analysed with `Analyser::detectYuv`.
+ *
+ * Both accuracy modes take an optional circle backend after the golden file
+ * ("opencv" or "contour", see `ShapeDetector::setCircleBackend`).
+ *
+ * `test_sinais lut <sinais dir>` checks the BGR colour table of
+ * `ColorClassifier` against the HSV path: the class bits of every 8-bit
+ * colour in both channel orders, then the red and blue masks of
+ * `ColorDetector::detectRed` and `detectBlue` on every image of the
+ * directory, as read and as equalised by the pipeline.
+ *
+ * `test_sinais stream <sinais dir>` runs every image of the directory
+ * through the `BandPipeline` and checks that the masks of kept components
+ * are those of the whole-frame stages, pixel for pixel, and that
+ * `Analyser::detectStreaming` finds the same signs as `Analyser::detect`.
+ *
+ * `test_sinais batch <sinais dir>` cuts every image of the directory into
+ * 320x240 crops and checks that the batch entry points of `ColorDetector`
+ * give each crop the mask it gets on its own, in one shared buffer, then
+ * does the same over the whole images and over synthetic crops with bars on
+ * their first and last rows. The time of both is printed.
+ *
+ * `test_sinais timing <sinais dir> <golden file> <baseline> <tolerance %>`
+ * times each pipeline stage over the same images, normalised by a fixed
+ * calibration loop so that the numbers carry across machines, and fails
+ * when a stage is slower than the baseline by more than the tolerance. The
+ * baselines are committed, one per build type, and a missing baseline or
+ * one recorded for another build type fails the test. With
+ * `VISAO_UPDATE_BASELINE` set, the baseline is recorded instead and the
+ * test exits with `TIMING_SKIPPED`: nothing was checked.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Analyser.hpp"
+
+#define CALIBRATION_RUNS 5
+#define TIMING_RUNS 5
+#define TIMING_NOISE_FLOOR_MS 0.1
+#define TIMING_SKIPPED 77  // Exit code ctest reports as skipped
+
+#ifndef VISAO_BUILD_TYPE
+#define VISAO_BUILD_TYPE "unknown"
+#endif
+
+using namespace std;
+
+/**
+ * @brief One line of the golden file.
+ */
+struct Golden {
+    string image;
+    string kind;
+    string direction;
+    cv::Point2f center;
+    float tolerance;
+    QualityLevel level = QUALITY_FULL;
+};
+
+/**
+ * @brief Reads the golden file, skipping blank lines and `#` comments.
+ */
+static vector<Golden> readGoldens(const string& path) {
+    vector<Golden> goldens;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream fields(line);
+        Golden golden;
+        string quality;
+        if (!(fields >> golden.image >> golden.kind >> golden.direction >>
+              golden.center.x >> golden.center.y >> golden.tolerance)) {
+            continue;
+        }
+        if (fields >> quality) {
+            if (quality != "no-equalize") {
+                cerr << "unknown quality " << quality << " in " << path
+                     << endl;
+                continue;
+            }
+            golden.level = QUALITY_NO_EQUALIZE;
+        }
+        goldens.push_back(golden);
+    }
+    return goldens;
+}
+
+/**
+ * @brief Reads one image of the corpus: PNM through `MappedPnm`, in the
+ * order it is stored, anything else through `cv::imread`, in BGR.
+ */
+static cv::Mat readImage(const string& path, bool& rgb) {
+    string extension = filesystem::path(path).extension().string();
+    if (extension == ".ppm" || extension == ".pgm") {
+        MappedPnm image(path);
+        rgb = image.isRgb();
+        return image.image().clone();
+    }
+    rgb = false;
+    cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+    if (image.empty()) {
+        throw runtime_error("Cannot read " + path);
+    }
+    return image;
+}
+
+/**
+ * @brief Runs the detector on one image of the corpus.
+ */
+static vector<Detection> detectImage(const string& path, cv::Mat& frame,
+                                     QualityLevel level = QUALITY_FULL,
+                                     StageTimings* timings = nullptr) {
+    bool rgb;
+    frame = readImage(path, rgb);
+    cv::Mat colorMask;
+    vector<Detection> detections =
+        Analyser::detect(frame, colorMask, level, rgb, timings);
+    {
+        StageScope scope(timings, STAGE_ANNOTATE);
+        Analyser::annotate(detections, frame);
+    }
+    return detections;
+}
+
+/**
+ * @brief Runs the detector on one image of the corpus through a raw I420
+ * file, as frames from a camera or a decoder would arrive.
+ */
+static vector<Detection> detectYuvImage(const string& path,
+                                        QualityLevel level) {
+    bool rgb;
+    cv::Mat bgr = readImage(path, rgb), i420;
+    if (rgb) {
+        cv::cvtColor(bgr, bgr, cv::COLOR_RGB2BGR);
+    } else if (bgr.channels() == 1) {
+        cv::cvtColor(bgr, bgr, cv::COLOR_GRAY2BGR);
+    }
+    cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+
+    string rawPath =
+        (filesystem::temp_directory_path() / "test_sinais.yuv").string();
+    {
+        ofstream raw(rawPath, ios::binary | ios::trunc);
+        raw.write(i420.ptr<char>(), i420.total() * i420.elemSize());
+    }
+
+    YuvReader reader(rawPath, YUV_I420, bgr.cols, bgr.rows);
+    YuvFrame frame;
+    reader.next(frame);
+    cv::Mat colorMask;
+    vector<Detection> detections =
+        Analyser::detectYuv(frame, colorMask, level);
+    filesystem::remove(rawPath);
+
+    return detections;
+}
+
+static int runAccuracy(const string& dir, const vector<Golden>& goldens,
+                       bool yuv) {
+    int failures = 0;
+
+    for (const auto& golden : goldens) {
+        cv::Mat frame;
+        string path = dir + "/" + golden.image;
+        vector<Detection> detections =
+            yuv ? detectYuvImage(path, golden.level)
+                : detectImage(path, frame, golden.level);
+
+        bool found = false;
+        for (const auto& detection : detections) {
+            float dx = detection.center.x - golden.center.x;
+            float dy = detection.center.y - golden.center.y;
+            if (golden.kind == signKindName(detection.kind) &&
+                (golden.direction == "-" ||
+                 golden.direction == signDirectionName(detection.direction)) &&
+                sqrt(dx * dx + dy * dy) <= golden.tolerance) {
+                found = true;
+            }
+        }
+
+        cout << (found ? "PASS " : "FAIL ") << golden.image << ": expected "
+             << golden.kind << " " << golden.direction << " at ("
+             << golden.center.x << ", " << golden.center.y << "), got";
+        for (const auto& detection : detections) {
+            cout << " [" << signKindName(detection.kind) << " "
+                 << signDirectionName(detection.direction) << " ("
+                 << detection.center.x << ", " << detection.center.y << ")]";
+        }
+        cout << endl;
+
+        if (!found) {
+            failures++;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Returns the paths of the files of a directory, sorted.
+ */
+static vector<string> imagePaths(const string& dir) {
+    vector<string> paths;
+    for (const auto& entry : filesystem::directory_iterator(dir)) {
+        paths.push_back(entry.path().string());
+    }
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+/**
+ * @brief Counts the pixels whose class bits differ between the colour table
+ * and the HSV path.
+ */
+static int tableMismatches(const cv::Mat& img, bool rgb) {
+    cv::Mat hsv;
+    cv::cvtColor(img, hsv, rgb ? cv::COLOR_RGB2HSV : cv::COLOR_BGR2HSV);
+    cv::Mat expected = ColorClassifier::classify(hsv);
+    cv::Mat actual = ColorClassifier::classifyBgr(img, rgb);
+    return cv::countNonZero(expected != actual);
+}
+
+/**
+ * @brief Counts the pixels whose red or blue mask differs between
+ * `ColorDetector` and the masks of the HSV class bits.
+ */
+static int maskMismatches(const cv::Mat& bgr) {
+    cv::Mat hsv;
+    cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat bits = ColorClassifier::classify(hsv);
+    return cv::countNonZero(ColorDetector::detectRed(bgr) !=
+                            ColorDetector::detect(bits, COLOR_RED)) +
+           cv::countNonZero(ColorDetector::detectBlue(bgr) !=
+                            ColorDetector::detect(bits, COLOR_BLUE));
+}
+
+static int runLut(const string& dir) {
+    int failures = 0;
+
+    // Every 8-bit colour once
+    cv::Mat colours(4096, 4096, CV_8UC3);
+    cv::Vec3b* pixel = colours.ptr<cv::Vec3b>();
+    for (int i = 0; i < 1 << 24; i++) {
+        pixel[i] = cv::Vec3b(static_cast<uint8_t>(i >> 16),
+                             static_cast<uint8_t>(i >> 8),
+                             static_cast<uint8_t>(i));
+    }
+    for (bool rgb : {false, true}) {
+        int differ = tableMismatches(colours, rgb);
+        cout << (differ == 0 ? "PASS " : "FAIL ") << "every "
+             << (rgb ? "RGB" : "BGR") << " colour: " << differ
+             << " differ from the HSV path" << endl;
+        failures += differ != 0;
+    }
+
+    for (const string& path : imagePaths(dir)) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            continue;
+        }
+        cv::Mat equalised = image.clone();
+        Analyser::prepareFrame(equalised);
+
+        int differ = maskMismatches(image) + maskMismatches(equalised);
+        cout << (differ == 0 ? "PASS " : "FAIL ")
+             << filesystem::path(path).filename().string() << ": " << differ
+             << " mask pixels differ from the HSV path" << endl;
+        failures += differ != 0;
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Counts the pixels whose mask of kept components differs between
+ * the runs of the `BandPipeline` and the whole-frame stages.
+ */
+static int streamMismatches(const RunMask& streamed, const cv::Mat& classBits,
+                            ColorClassId id) {
+    cv::Mat expected =
+        ShapeDetector::findCandidates(ColorDetector::detect(classBits, id))
+            .mask.toDense();
+    cv::Mat actual = ShapeDetector::routeCandidates(streamed).mask.toDense();
+    return cv::countNonZero(expected != actual);
+}
+
+/**
+ * @brief Whether two lists of detections are the same, in the same order.
+ */
+static bool sameDetections(const vector<Detection>& a,
+                           const vector<Detection>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].kind != b[i].kind || a[i].direction != b[i].direction ||
+            a[i].center != b[i].center || a[i].radius != b[i].radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int runStream(const string& dir) {
+    int failures = 0;
+    BandPipeline pipeline;
+
+    for (const string& path : imagePaths(dir)) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            continue;
+        }
+        RunMask red, blue;
+        pipeline.run(image, red, blue);
+
+        cv::Mat equalised = image.clone();
+        Analyser::prepareFrame(equalised);
+        cv::Mat classBits = ColorDetector::classify(equalised);
+        int differ = streamMismatches(red, classBits, COLOR_RED) +
+                     streamMismatches(blue, classBits, COLOR_BLUE);
+
+        cv::Mat frame = image.clone(), colorMask;
+        bool same = sameDetections(Analyser::detect(frame, colorMask),
+                                   Analyser::detectStreaming(image, pipeline));
+
+        cout << (differ == 0 && same ? "PASS " : "FAIL ")
+             << filesystem::path(path).filename().string() << ": " << differ
+             << " mask pixels differ, detections "
+             << (same ? "match" : "differ") << ", working set "
+             << pipeline.workingSetBytes() / 1024 << " KiB" << endl;
+        failures += differ != 0 || !same;
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Counts the pixels of the batch masks that differ from the masks of
+ * the images one at a time, and the masks outside the batch's buffer.
+ */
+static int batchMismatches(const vector<cv::Mat>& crops,
+                           const vector<cv::Mat>& masks,
+                           cv::Mat (*single)(const cv::Mat&)) {
+    int differ = 0;
+    for (size_t i = 0; i < crops.size(); i++) {
+        differ += masks[i].datastart != masks[0].datastart;
+        differ += cv::countNonZero(single(crops[i]) != masks[i]);
+    }
+    return differ;
+}
+
+static int runBatch(const string& dir) {
+    int failures = 0;
+
+    // Tracker-sized crops of every image, as views into it
+    vector<cv::Mat> images, crops;
+    for (const string& path : imagePaths(dir)) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            continue;
+        }
+        images.push_back(image);
+        for (int y = 0; y + 240 <= image.rows; y += 240) {
+            for (int x = 0; x + 320 <= image.cols; x += 320) {
+                crops.push_back(image(cv::Rect(x, y, 320, 240)));
+            }
+        }
+    }
+
+    if (crops.empty()) {
+        cout << "FAIL no image of 320x240 or more in " << dir << endl;
+        return EXIT_FAILURE;
+    }
+
+    // One call first, so that neither timing includes building the colour
+    // table and the denoising kernel on first use
+    ColorDetector::detectRed(crops.front());
+
+    auto start = chrono::steady_clock::now();
+    vector<cv::Mat> red = ColorDetector::detectRed(crops);
+    vector<cv::Mat> blue = ColorDetector::detectBlue(crops);
+    chrono::duration<double, milli> batched =
+        chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    for (const cv::Mat& crop : crops) {
+        ColorDetector::detectRed(crop);
+        ColorDetector::detectBlue(crop);
+    }
+    chrono::duration<double, milli> single =
+        chrono::steady_clock::now() - start;
+
+    int differ = batchMismatches(crops, red, ColorDetector::detectRed) +
+                 batchMismatches(crops, blue, ColorDetector::detectBlue);
+    cout << (differ == 0 ? "PASS " : "FAIL ") << crops.size()
+         << " crops of 320x240: " << differ << " mismatches; "
+         << batched.count() << " ms batched, " << single.count()
+         << " ms one at a time" << endl;
+    failures += differ != 0;
+
+    // Whole images of different sizes in one batch
+    differ = batchMismatches(images, ColorDetector::detectRed(images),
+                             ColorDetector::detectRed);
+    cout << (differ == 0 ? "PASS " : "FAIL ") << images.size()
+         << " whole images: " << differ << " mismatches" << endl;
+    failures += differ != 0;
+
+    // Red and blue bars along the first and last rows, in crops that follow
+    // each other in the buffer: each mask has set rows at its edges next to
+    // a mask without any, so any bleed across them shows up
+    vector<cv::Mat> edges;
+    for (int i = 0; i < 4; i++) {
+        cv::Mat crop(24, 32, CV_8UC3, cv::Scalar(128, 128, 128));
+        cv::Scalar color = i % 2 == 0 ? cv::Scalar(0, 0, 255)
+                                      : cv::Scalar(255, 0, 0);
+        crop.rowRange(0, 3).setTo(color);
+        crop.rowRange(crop.rows - 3, crop.rows).setTo(color);
+        edges.push_back(crop);
+    }
+    differ = batchMismatches(edges, ColorDetector::detectRed(edges),
+                             ColorDetector::detectRed) +
+             batchMismatches(edges, ColorDetector::detectBlue(edges),
+                             ColorDetector::detectBlue);
+    cout << (differ == 0 ? "PASS " : "FAIL ") << edges.size()
+         << " crops with bars on their edge rows: " << differ
+         << " mismatches" << endl;
+    failures += differ != 0;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Times a fixed arithmetic and memory workload. Stage times are
+ * expressed in units of this loop so that the baseline does not depend on
+ * the speed of the machine.
+ *
+ * @return double The best time over `CALIBRATION_RUNS` runs, in ms.
+ */
+static double calibrate() {
+    vector<float> buffer(1 << 20);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<float>(i % 251);
+    }
+
+    double best = numeric_limits<double>::max();
+    volatile float sink = 0.0f;
+    for (int run = 0; run < CALIBRATION_RUNS; run++) {
+        auto start = chrono::steady_clock::now();
+        float accumulator = 0.0f;
+        for (int pass = 0; pass < 16; pass++) {
+            for (size_t i = 0; i < buffer.size(); i++) {
+                accumulator = accumulator * 0.999f + buffer[i];
+                buffer[i] = accumulator * 0.001f;
+            }
+        }
+        sink = accumulator;
+        chrono::duration<double, milli> elapsed =
+            chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    (void)sink;
+
+    return best;
+}
+
+static int runTiming(const string& dir, const vector<Golden>& goldens,
+                     const string& baselinePath, double tolerance) {
+    double calibrationMs = calibrate();
+
+    // Per stage, the best of TIMING_RUNS runs, summed over the images
+    double stageMs[STAGE_COUNT] = {};
+    for (const auto& golden : goldens) {
+        StageTimings best;
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            best.ms[stage] = numeric_limits<double>::max();
+        }
+        for (int run = 0; run < TIMING_RUNS; run++) {
+            StageTimings timings;
+            cv::Mat frame;
+            detectImage(dir + "/" + golden.image, frame, golden.level,
+                        &timings);
+            for (int stage = 0; stage < STAGE_COUNT; stage++) {
+                best.ms[stage] = min(best.ms[stage], timings.ms[stage]);
+            }
+        }
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            stageMs[stage] += best.ms[stage];
+        }
+    }
+
+    if (getenv("VISAO_UPDATE_BASELINE") != nullptr) {
+        ofstream out(baselinePath);
+        out << "# Per-stage cost in units of the calibration loop.\n"
+            << "# build " << VISAO_BUILD_TYPE << "\n";
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            out << stageName(static_cast<PipelineStage>(stage)) << " "
+                << stageMs[stage] / calibrationMs << "\n";
+        }
+        if (!out) {
+            cerr << "Cannot write timing baseline " << baselinePath << endl;
+            return EXIT_FAILURE;
+        }
+        cout << "Recorded timing baseline in " << baselinePath
+             << "; review and commit it. Skipping timing checks" << endl;
+        return TIMING_SKIPPED;
+    }
+
+    ifstream baselineFile(baselinePath);
+    if (!baselineFile) {
+        cout << "FAIL no timing baseline " << baselinePath << " for a "
+             << VISAO_BUILD_TYPE
+             << " build; record one with VISAO_UPDATE_BASELINE=1" << endl;
+        return EXIT_FAILURE;
+    }
+
+    string line, build;
+    vector<pair<string, double>> baseline;
+    while (getline(baselineFile, line)) {
+        if (line.rfind("# build ", 0) == 0) {
+            build = line.substr(8);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream fields(line);
+        string stage;
+        double cost;
+        if (fields >> stage >> cost) {
+            baseline.emplace_back(stage, cost);
+        }
+    }
+    if (build != VISAO_BUILD_TYPE) {
+        // Debug and Release costs are not comparable
+        cout << "FAIL baseline " << baselinePath << " was recorded for a "
+             << build << " build, this is a " << VISAO_BUILD_TYPE << " build"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    cout << "Calibration loop: " << calibrationMs << " ms" << endl;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        const char* name = stageName(static_cast<PipelineStage>(stage));
+        double cost = stageMs[stage] / calibrationMs;
+
+        double expected = -1.0;
+        for (const auto& entry : baseline) {
+            if (entry.first == name) {
+                expected = entry.second;
+            }
+        }
+
+        bool checked =
+            expected > 0.0 && stageMs[stage] >= TIMING_NOISE_FLOOR_MS;
+        bool regressed = checked && cost > expected * (1.0 + tolerance / 100.0);
+        cout << (regressed ? "FAIL " : checked ? "PASS " : "SKIP ") << left
+             << setw(14) << name << fixed << setprecision(3) << stageMs[stage]
+             << " ms, cost " << cost << " (baseline " << expected << ")"
+             << endl;
+        if (regressed) {
+            failures++;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+    string mode = argc >= 2 ? argv[1] : "";
+    if (argc >= 4 && (mode == "accuracy" || mode == "accuracy-yuv")) {
+        CircleBackend backend = CIRCLE_BACKEND_DEFAULT;
+        if (argc >= 5 && !parseCircleBackend(argv[4], backend)) {
+            cerr << "unknown circle backend " << argv[4] << endl;
+            return EXIT_FAILURE;
+        }
+        ShapeDetector::setCircleBackend(backend);
+        return runAccuracy(argv[2], readGoldens(argv[3]),
+                           mode == "accuracy-yuv");
+    }
+    if (argc >= 3 && mode == "lut") {
+        return runLut(argv[2]);
+    }
+    if (argc >= 3 && mode == "stream") {
+        return runStream(argv[2]);
+    }
+    if (argc >= 3 && mode == "batch") {
+        return runBatch(argv[2]);
+    }
+    if (argc >= 6 && mode == "timing") {
+        return runTiming(argv[2], readGoldens(argv[3]), argv[4],
+                         atof(argv[5]));
+    }
+
+    cerr << "usage: " << argv[0]
+         << " accuracy <sinais dir> <golden file> [<circle backend>]\n"
+         << "       " << argv[0]
+         << " accuracy-yuv <sinais dir> <golden file> [<circle backend>]\n"
+         << "       " << argv[0] << " lut <sinais dir>\n"
+         << "       " << argv[0] << " stream <sinais dir>\n"
+         << "       " << argv[0] << " batch <sinais dir>\n"
+         << "       " << argv[0]
+         << " timing <sinais dir> <golden file> <baseline> <tolerance %>"
+         << endl;
+    return EXIT_FAILURE;
+}